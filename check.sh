@@ -0,0 +1,93 @@
+#!/bin/sh
+# Regression check of the agenda, unattended: builds it (warnings are errors), replays simulated days against the
+# schedule (--simulate exits with 1 on a missed, duplicated or late notification) and checks a few answers.
+# Usage: ./check.sh (from the directory of granny.c); the exit status is the number of failed checks.
+cd "$(dirname "$0")" || exit 1
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failed=0
+CC=${CC:-gcc}
+FLAGS="-O2 -Wall -Wextra -Werror -pthread"
+
+check() { # name, expected exit status, command...
+	name=$1
+	status=$2
+	shift 2
+	"$@" > "$dir/out" 2>&1
+	got=$?
+	if [ "$got" -eq "$status" ]; then
+		echo "ok      $name"
+	else
+		echo "FAILED  $name (exit status $got, expected $status)"
+		sed 's/^/        /' "$dir/out" | head -20
+		failed=$((failed + 1))
+	fi
+}
+
+contains() { # name, text expected in the output of the last check
+	if grep -qF -- "$2" "$dir/out"; then
+		echo "ok      $1"
+	else
+		echo "FAILED  $1 (no \"$2\" in the output)"
+		failed=$((failed + 1))
+	fi
+}
+
+check "build" 0 $CC $FLAGS granny.c -o "$dir/granny"
+check "build with the benchmarks" 0 $CC $FLAGS -DGRANNY_BENCH granny.c -o "$dir/granny_bench"
+[ -x "$dir/granny" ] || exit 1
+
+# The predesigned schedule for a year, with granny answering some of the time
+cat > "$dir/script" <<'EOF'
+# at,question,answer
+7:10,7:00,yes
+9:30,9:00,no
+12:05,12:00,yes
+22:00,21:10,yes
+EOF
+check "simulate a year" 0 "$dir/granny" --simulate 365
+check "simulate a month with a script" 0 "$dir/granny" --simulate 30 --script "$dir/script"
+contains "granny's answers acknowledged" "acknowledged by granny           90"
+
+# Times to the second, short activities (no warning), a night activity and days of the week
+cat > "$dir/schedule" <<'EOF'
+08:00:30,08:01,Pills
+09:00,09:10,Tea
+10:00,11:00,Walk
+[weekdays] 14:00,15:30,Piano
+[sat sun] 14:00,16:00,Visit
+[every 3 days from 2026-01-01] 17:00,17:45,Bath
+23:55,00:03,Night pills
+EOF
+check "simulate a schedule with short and recurring activities" 0 "$dir/granny" --schedule "$dir/schedule" --simulate 28
+grep -v '^\[' "$dir/schedule" > "$dir/daily"
+check "simulate the daily activities only" 0 "$dir/granny" --schedule "$dir/daily" --simulate 28
+contains "no warning for activities of 10 minutes or less" "10 minutes remaining           28           28"
+
+# Late wake-ups: within a minute they're fine, later they're caught
+check "simulate wake-ups up to 59 s late" 0 "$dir/granny" --simulate 30 --jitter 59000
+check "simulate wake-ups up to 2 min late (must fail)" 1 "$dir/granny" --simulate 30 --jitter 120000
+
+# The adherence history of a simulation, read back
+check "simulate with a history" 0 "$dir/granny" --simulate 60 --script "$dir/script" --history "$dir/history"
+check "history report" 0 "$dir/granny" --history-report "$dir/history"
+contains "history report lists the activities" "Breakfast"
+
+# Batch answers
+printf '10:00\n23:30\n6:59\nnoon\n' > "$dir/times"
+check "batch" 0 "$dir/granny" --batch "$dir/times"
+contains "batch answer" "$(printf '10:00\tPlay instrument')"
+contains "batch answer past midnight" "$(printf '23:30\tRead book and sleep')"
+contains "batch answer to no time" "$(printf 'noon\t?')"
+
+# The same schedule compiled into the agenda
+check "compile the schedule" 0 "$dir/granny" --schedule "$dir/schedule" --compile "$dir/compiled.h"
+check "build with the compiled schedule" 0 $CC $FLAGS -DGRANNY_SCHEDULE="\"$dir/compiled.h\"" granny.c -o "$dir/granny_compiled"
+check "simulate the compiled schedule" 0 "$dir/granny_compiled" --simulate 28
+sed -n 2,5p "$dir/out" > "$dir/compiled"
+check "simulate the parsed schedule" 0 "$dir/granny" --schedule "$dir/schedule" --simulate 28
+sed -n 2,5p "$dir/out" > "$dir/parsed"
+check "compiled schedule notified like the parsed one" 0 cmp "$dir/compiled" "$dir/parsed"
+
+echo "$failed failed"
+exit "$failed"
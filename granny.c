@@ -1,9 +1,12 @@
 // Comments (possible optimizations) 
 // Possible aspects to optmize: 
-// 1) Consider using one member instead of counted1 / counted2 or a global variable protected by a mutex
-// 2) Algorithm for calculating 3 real life seconds (from any last printed output, not just the outputs that 
-//    are produced when granny inputs something) could be optimized / redesigned. For now, it works.
-// 3) A new feature could be adding a restart feature, to start a new day, just before breakfast.
+// 1) The start / 10 minutes left / end events are kept in a hierarchical timer wheel, so a single scheduler thread
+//    sleeps until the next one instead of polling (the old counted / counted2 members are gone).
+// 2) The 3 real life seconds between outputs (and after granny inputs something) are enforced by a single output
+//    dispatcher thread that sleeps on the monotonic clock; the other threads only queue their messages.
+// 3) The agenda doesn't stop once the night activity ends anymore: activities recur (every day, on some days of the
+//    week, every N days or on some dates) and the next occurrence of each one is armed when the last one ends, so a
+//    new day needs no restart and no work at midnight (see the recurring activities section).
 
 // Important assumptions: 
 // 1) Assumed granny will input the hour correctly, ie minutes 0-59, hours 0-23, otherwise some control
@@ -14,20 +17,18 @@
 //    This is important because based on this condition this last activity will be marked as done, otherwise the 
 //    controls would have to be modified. Eg. 23.00 pm - 6.00 am
 // 4) Since it was asked to design a schedule for granny and she has a bad memory, a schedule was predesigned
-//    for her here. A new feature in the future could be making the schedule modifiable.
+//    for her here. Another schedule can be loaded from a file at start-up (--schedule FILE).
 // 5) Important: corner cases (like going from one day to the next) were considered to detect the last activity
 //    when receiving user input, to detect 10 minutes remaining for an activity that ends at midnight (limit case),
 //    and to mark the last activity as done (sleeping, roll to the next day).
-// 6) Important: we're assuming that the last, largest (in time) printf to the console will be when the last activity 
-//    starts, meaning eg. book + sleep from 23.00-6:00 am, and that granny won't input anything after that
-//    because she should be sleeping. 
-//    This way, this will be the largest static point of reference in time, so that when the activity ends
-//    around 6 am for instance, it will be marked as done and the program will print the correct output (please
-//    see three_seconds function in the code).
+// 6) The 3 seconds between outputs are measured on the monotonic clock, so (unlike the old static points of
+//    reference, which compared hours and minutes) they're not affected by midnight or by the night activity.
 // 7) Assumed activities cannot start / end at the same time (like act1: 19.00-20.00, act2: 20:00-21.00);
-//    and that the start/end times are dedicated to the activity.
+//    and that the start/end times are dedicated to the activity. A schedule file is checked when it's loaded (see
+//    the interval index section): overlapping activities that can occur the same day are reported.
 
 // Libraries ********************************************************************************************
+#define _GNU_SOURCE // sendmmsg()
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -37,553 +38,7868 @@
 #include <semaphore.h>
 #include <unistd.h>
 #include <sched.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
 
 // Global struct definition *****************************************************************************
-struct activity { 
-	int start_hour; // range: 0-24 
+// The activities are stored as a structure of arrays: what the lookup table, the scheduler and the scans need
+// (start / end as minutes of the day and the state as a few bits) is packed in small arrays, and the
+// names, which are only needed when printing, are kept apart in one arena of interned strings (a name used by many
+// activities, like "Lunch" every day, is stored once). That's 14 bytes per activity plus the names, instead of
+// ~140 bytes per activity with a struct of strings. HH:MM strings are formatted when printing.
+// Times can also be given to the second or the millisecond (reminders like medication): the part past the minute is
+// kept in two more arrays, which only exist once an activity needs them, and only the events use it (granny's
+// questions, the lookup table and the overlaps are about minutes).
+// The state of an activity is one atomic word: a few flags and the occurrence (day) they belong to. Any thread reads
+// it without locking, and every transition (undone -> done, start / 10 minutes remaining notified) is a single
+// compare-and-swap, whose result tells the caller whether it made the transition or somebody else did it first.
+// The first transition of a new occurrence replaces the flags of the previous one, so a new day doesn't touch the
+// states at all: flags of an older day simply don't count when the state of today's occurrence is asked.
+enum activity_flag {
+	FLAG_DONE, // set: done, otherwise undone
+	FLAG_STARTED, // the start of the activity was notified
+	FLAG_WARNED, // the 10 minutes remaining were notified
+	ACTIVITY_FLAGS
+};
+#define STATE_FLAGS 3 // low bits of a state word holding the flags, the rest is the day
+struct journal;
+struct history;
+struct rule;
+
+struct intern_entry {
+	uint32_t offset; // offset of the name in names + 1 (0: empty entry)
+	uint32_t hash; // hash of the name, to skip most string comparisons
+};
+
+struct schedule {
+	int count; // number of activities
+	int capacity; // size of the arrays below
+	uint16_t *start; // start of activity i, minute of the day (0-1439)
+	uint16_t *end; // end of activity i, minute of the day (smaller than start for activities past midnight)
+	uint16_t *start_ms; // ms past the start minute of activity i (0-59999), NULL while every time is a whole minute
+	uint16_t *end_ms; // ms past its end minute (same)
+	uint32_t *name; // offset of the name of activity i in names
+	uint16_t *rule; // days activity i occurs on, index in rules (0: every day)
+	_Atomic uint32_t *state; // day of the last occurrence of activity i << STATE_FLAGS | its flags
+	char *names; // interned names, each one followed by a null char
+	size_t names_size; // bytes used in names
+	size_t names_capacity;
+	struct intern_entry *intern; // open addressing hash table of the names, to intern them
+	uint32_t intern_capacity; // power of two
+	uint32_t intern_count;
+	struct rule *rules; // rules[0] is every day (NULL until another one is added, see the recurring activities section)
+	int rules_count, rules_capacity;
+	uint32_t *dates; // days of the RULE_DATES rules, sorted for each rule
+	uint32_t dates_count, dates_capacity;
+	struct journal *journal; // every transition is appended to it (NULL: not journaled, see the journal section)
+	struct history *history; // the outcome of every occurrence is appended to it (NULL: none, see the adherence history section)
+	bool reserved; // arrays mapped at their maximum size, they never move (see schedule_reserve())
+	bool compiled; // arrays in the .rodata of a compiled schedule, only the states are allocated (see below)
+};
+
+// Granny's predesigned schedule, from earliest to latest, used when no schedule file is given
+struct default_activity { 
+	int start_hour; // range: 0-23
 	int start_minute; // range: 0-59
-	int end_hour; // range: 0-24
+	int end_hour; // range: 0-23
 	int end_minute; // range: 0-59
-	char start_time[6]; // simply for printing to console without internal integer - str conversion 
+	const char *name; // max 100 characters; name of the activity
+} default_acts[] = {
+{7,0,8,30,"Breakfast"}, 
+{9,0,11,40,"Play instrument"},
+{12,0,13,30,"Lunch"},
+{14,0,16,15,"Knitting"},
+{16,30,17,0,"Tea time"},
+{17,15,19,15,"Play cards"},
+{19,30,21,0,"Dinner"},
+{21,10,6,45,"Read book and sleep"}};
+
+// The schedule in use: either default_acts or the activities loaded from a file (see the schedule file section)
+struct schedule acts;
+
+// Global variables / mutexes ****************************************************************************
+// Outputs go through the output dispatcher (see below) so that the user can perceive 3 seconds between them.
+// The internal clock (which can go faster than the one in the real world) is derived from the monotonic clock,
+// see the internal clock section below.
+// There will be mutexes (and atomics) to synchronize threads and protect global variables, thus making the program
+// thread safe (below). Nothing sleeps while holding a mutex.
+
+// Output dispatcher *************************************************************************************
+// Every output to the console is formatted straight into a slot of a lock-free multi-producer / single-consumer
+// ring (bounded queue with a sequence number per slot), so the threads producing messages never wait: they claim a
+// slot with one compare-and-swap, write the message, publish it and post a semaphore. The dispatcher thread is the
+// only one writing to the console; it sleeps on the semaphore while there's nothing to print, and with
+// sem_clockwait() until 3 seconds (monotonic) have passed since the last output or the last input from granny.
+// If the ring is ever full (a burst of notifications at a high --speed, a dense schedule: the console only takes one
+// message every 3 seconds) the producer doesn't wait either: the message goes into a node malloc()ed for it, pushed
+// on a lock-free stack. While anything is in that overflow, new messages go there too so that they stay in order;
+// the dispatcher takes the whole stack with one exchange, keeps it in order in its backlog and prints it once the
+// ring is empty. A message is only lost if there's no memory for its node (reported on stderr and by --stats).
+// The console is one sink; the dispatcher also hands every message, without waiting for the console's pacing, to
+// the sinks given on the command line: a log file (--log FILE, rotated when it reaches OUTPUT_LOG_MAX bytes: the
+// old ones are FILE.1 to FILE.OUTPUT_LOG_KEEP) and a local datagram socket (--log-socket PATH, one datagram per
+// message for some other process; they're lost rather than waited for if nobody reads them). Whatever is ready in
+// the ring (after OUTPUT_LINGER_NS, so that a burst isn't taken one message at a time) is gathered OUTPUT_BATCH
+// messages at a time, with the internal time each was queued at, and written with a single writev() to the file and
+// a single sendmmsg() to the socket, so a burst of notifications costs one system call per sink. A slot is freed once the console has had it (the console writes one message at a time, 3 seconds
+// apart, so batching it wouldn't change anything).
+#define OUTPUT_RING 256 // number of slots, power of two
+#define OUTPUT_TEXT 248 // max length of one message, including the null char
+#define OUTPUT_SPACING_NS 3000000000LL // 3 seconds between outputs
+#define OUTPUT_BATCH 64 // messages per writev() / sendmmsg()
+#define OUTPUT_LINGER_NS 200000 // how long a batch that isn't full waits for more messages
+#define OUTPUT_LOG_MAX (8LL << 20) // bytes of the log file before it's rotated
+#define OUTPUT_LOG_KEEP 3 // old log files kept
+
+struct output_slot {
+	_Atomic unsigned long sequence; // == position: free for the producer, == position + 1: ready for the dispatcher
+	long long mark_ns; // > 0: not a message but the time granny input something (CLOCK_MONOTONIC)
+	long long queued_ms; // internal time the message was queued at (for the log)
+	char text[OUTPUT_TEXT];
+};
+
+struct output_overflow { // a message that found the ring full
+	struct output_slot slot; // (its sequence isn't used)
+	struct output_overflow *next;
+};
+
+struct output_slot output_ring[OUTPUT_RING];
+_Atomic unsigned long output_tail = 0; // next position to be claimed by a producer
+unsigned long output_sunk = 0; // next position to be handed to the sinks (only used by the dispatcher)
+unsigned long output_head = 0; // next position to be printed, <= output_sunk (only used by the dispatcher)
+sem_t output_ready; // one post per published slot
+_Atomic bool output_stop = false; // set by main when exiting, the dispatcher prints what's left and finishes
+bool output_console = true; // false: nothing is printed (benchmark, simulation), the other sinks still get everything
+struct output_overflow *_Atomic output_overflow_stack = NULL; // pushed by the producers, newest first
+_Atomic long output_overflowing = 0; // messages in the stack and the backlog (producers go there too while > 0)
+struct output_overflow *output_backlog = NULL; // taken from the stack, oldest first (only used by the dispatcher)
+struct output_overflow *output_backlog_last = NULL;
+
+// Sinks besides the console (only used by the dispatcher once opened)
+const char *output_log_path = NULL;
+int output_log_fd = -1;
+long long output_log_size = 0; // bytes in the current file
+int output_socket_fd = -1;
+struct sockaddr_un output_socket_address;
+long output_log_messages = 0, output_log_writes = 0, output_log_rotations = 0, output_log_lost = 0;
+long output_socket_messages = 0, output_socket_calls = 0, output_socket_lost = 0;
+
+// Enqueue latency (time spent by producers in output()), messages dropped and CPU used by the dispatcher
+_Atomic long output_enqueued = 0;
+_Atomic long output_overflowed = 0; // went through the overflow
+_Atomic long output_dropped = 0; // no memory for the overflow
+_Atomic long long output_enqueue_total_ns = 0;
+_Atomic long long output_enqueue_max_ns = 0;
+long long output_dispatcher_cpu_ns = 0; // written by the dispatcher when it finishes
+
+// Wall clock ********************************************************************************************
+// Every thread asks for the real local time through wallclock_ms() instead of time() + localtime() (localtime takes
+// the timezone lock, isn't thread safe and is slow). The local minute being lived is converted with localtime_r()
+// once per minute (tzset() is called then too, so timezone changes are noticed within a minute) and published
+// with a seqlock: [wall_minute_start, wall_minute_start + 60 s) of CLOCK_REALTIME_COARSE is local minute
+// wall_minute_of_day of local day wall_day. Readers just read the coarse clock (vDSO, no system call) and the
+// published minute, retrying if it was being updated at the same time; the first one to see the minute is over
+// converts the new one. local_day() reads the same snapshot, so a day and a time of day never disagree at midnight.
+_Atomic unsigned wall_seq = 0; // odd while the minute is being updated
+_Atomic long long wall_minute_start = 0; // CLOCK_REALTIME_COARSE (ms) at the start of the published minute
+_Atomic int wall_minute_of_day = -1; // local minute of the day that started then (-1: nothing published yet)
+_Atomic uint32_t wall_day = 0; // local day (days since 1970) of that minute
+
+// Internal (accelerated) clock *************************************************************************
+// The internal clock is not produced by a thread anymore: it is derived from CLOCK_MONOTONIC. At start-up
+// the local time of day is captured together with a monotonic timestamp, and from then on
+// internal time = local time at start-up + (monotonic time elapsed) * speed_num / speed_den.
+// Internal times are kept in milliseconds since the local midnight of the day the agenda was started,
+// so the night activity (which ends the next morning) simply has a deadline bigger than 24h.
+// The speed factor is a fraction (eg. 3/2), from x1 to x10000 or more, or "max" (as fast as possible): in that
+// case the clock doesn't follow the real time at all and the scheduler makes it jump to the next deadline.
+// All of this is written once before the threads start, except clock_jumps which is atomic, so any thread
+// reads the internal clock without locking anything.
+// Since the scheduler computes the exact real time of every deadline and expires everything it passed when it
+// wakes up, any speed works without skipping outputs (they're just late when printing can't keep up).
+long long speed_num = 3; // speed factor for internal clock, speed_num / speed_den
+long long speed_den = 1; // (ie. 3/1: 60 real seconds (1 minute) = 3 internal minutes)
+bool speed_max = false; // true: as fast as possible, the internal clock only moves with clock_jumps
+_Atomic long long clock_jumps = 0; // internal ms added by the scheduler when running as fast as possible
+struct timespec clock_origin; // CLOCK_MONOTONIC when the agenda started
+long long internal_origin; // internal time (ms since midnight) at clock_origin
+uint32_t internal_first_day; // local day (days since 1970) of internal time 0, the day the agenda was started
+
+// Schedule file ****************************************************************************************
+// A schedule can be loaded at start-up with --schedule FILE instead of the predesigned one. Each line of the file
+// is one activity: start time, end time and name separated by commas, eg. "21:10,06:45,Read book and sleep"
+// (times as H:MM or HH:MM, names up to 100 characters). Empty lines and lines starting with '#' are ignored.
+// The file is mapped in memory and parsed in a single pass straight into the arrays of the schedule, which grow by
+// doubling, so there's no allocation per line; this way hundreds of thousands of activities load in milliseconds.
+// Lines are parsed in batches of LOAD_BATCH: the hash table entries their names will be interned in are prefetched
+// while the rest of the batch is parsed (with 1M different names the table doesn't fit in the cache).
+// A line can start with the days the activity occurs on between brackets (see below), otherwise it's every day.
+#define LOAD_BATCH 16
+
+struct pending_activity { // one parsed line, waiting to be added to the schedule
+	int start;
+	int end;
+	const char *name; // inside the mapped file, not null terminated
+	size_t length;
+	uint32_t hash;
+	int rule; // index in the rules of the schedule
+	int start_ms; // ms past the start / end minute
+	int end_ms;
+};
+
+// Recurring activities *********************************************************************************
+// An activity occurs every day unless its line in the schedule file starts with a rule, eg.
+//   [weekdays] 09:00,11:40,Play instrument     (also [weekends], or days like [mon wed fri])
+//   [every 3 days from 2026-10-01] 16:30,17:00,Visit the doctor     (from the day it's loaded if no date is given)
+//   [on 2026-12-24 2026-12-31] 19:30,23:00,Family dinner
+// Rules are never expanded into a calendar: each activity only has the events of its next occurrence in the wheel,
+// and when it ends rule_next() finds the day of the one after (a few operations, a binary search for dates). A night
+// activity belongs to the day it starts. Rules are shared by the activities that use the same one (one table per
+// schedule), so a year-long run keeps the memory it had after the first day.
+#define RULE_DATES_MAX 366 // dates of a single rule
+#define RULE_MEET_DAYS 1461 // how far ahead rule_meets() looks for a day two rules share (4 years)
+
+enum rule_kind { RULE_DAILY, RULE_WEEKDAYS, RULE_EVERY, RULE_DATES };
+
+struct rule {
+	uint8_t kind; // enum rule_kind
+	uint8_t weekdays; // RULE_WEEKDAYS: bit k for the k-th day of the week (0: sunday)
+	uint16_t every; // RULE_EVERY: days between occurrences
+	uint32_t first; // RULE_EVERY: day of an occurrence; RULE_DATES: index of its first day in dates
+	uint32_t count; // RULE_DATES: number of days
+};
+
+// Lookup table *****************************************************************************************
+// Which activity should granny be doing at each minute of the day (-1: none), built once at start-up so the
+// question typed at the prompt is answered with a single read. Activities going past midnight (like sleeping,
+// eg. 23:00 - 6:00 am) are split there when building the table, and both the start and the end minutes belong
+// to the activity. If activities overlapped, the later one in the schedule would win (like the old search loop did).
+int lookup_table[24*60];
+
+// Compiled schedule ************************************************************************************
+// A schedule that never changes between builds doesn't need to be parsed at every start: ./granny --compile OUT
+// (after --schedule FILE, otherwise the predesigned one) writes it as a C header of const arrays, the ones of the
+// schedule itself (times, rules and interned names, with their hash table) and the lookup table, and the agenda
+// built with -DGRANNY_SCHEDULE='"OUT"' uses them when no --schedule is given: they're in .rodata, mapped with the
+// program and paged in when first read, so starting up is allocating the states and copying the lookup table into
+// the first version of the live schedule. The activities were checked (overlaps) when the file was loaded to be
+// compiled. A compiled schedule can still be edited live: schedule_reserve() copies it into its own mappings first.
+// The events aren't compiled: they hold absolute deadlines and the occurrence they're for, and the wheel keeps them
+// in order as they're added, so there's no timeline to sort at start-up.
+#define COMPILED_PER_LINE 16 // values per line of the generated arrays
+
+#ifdef GRANNY_SCHEDULE
+#include GRANNY_SCHEDULE
+#endif
+
+// Interval index ***************************************************************************************
+// The lookup table answers what's going on at one minute; the interval index answers questions about spans of the
+// day: every activity intersecting from - to (intervals_range()), the activities that overlap each other (checked
+// when a schedule file is loaded, see schedule_overlaps()) and the first free slot of some length after a time
+// (intervals_free_slot(), to reschedule an activity). Activities going past midnight are split in two pieces there:
+// the head (start - 23:59) and the tail (0:00 - end, on the day after the occurrence). The pieces are sorted by start
+// with a counting sort (starts are minutes of the day, so that's O(n)) and the sorted arrays are read as an implicit
+// balanced tree: the node of a range of pieces is its middle one, and max_end[node] is the latest end in the range.
+// A search skips the subtrees that end before the span asked about and everything after a node starting past it,
+// O(log n) plus the pieces found. first[] and reach[] let the free slot search jump from one busy block to the next.
+struct interval_piece {
+	uint16_t start;
+	uint16_t end;
+	uint32_t activity; // << 1, | 1 for the tail of a night activity
+};
+
+struct intervals {
+	const struct schedule *sch;
+	long count; // pieces
+	struct interval_piece *pieces; // sorted by start
+	uint16_t *max_end; // latest end of the subtree of each node
+	uint32_t first[24*60 + 1]; // first piece starting at each minute or later (count at the end)
+	int16_t reach[24*60]; // latest end of the pieces starting up to each minute (-1: none)
+};
+
+struct interval_query { // what intervals_search() reports
+	int from; // the span searched (from <= to)
+	int to;
+	int tail_after; // tails are only reported for activities starting after that minute (their head isn't found)
+	int end_before; // other pieces only if they end before that minute (the other half of a span across midnight)
+	int *found; // activities found (up to capacity)
+	long capacity;
+	long count;
+};
+
+// Scheduler ********************************************************************************************
+// Every activity produces up to three events: its start, 10 minutes remaining and its end. The pending events
+// are kept in a hierarchical timer wheel (see the timer wheel section below) and a single scheduler thread waits
+// on a condition variable with an absolute CLOCK_MONOTONIC timeout until the earliest one is due. Between events
+// the thread is blocked, so no CPU is used while the next event is hours away. The events are those of one
+// occurrence of the activity: when its end is fired, they're filled again with the next occurrence.
+enum event_kind { EVENT_START, EVENT_WARNING, EVENT_END };
+
+struct agenda; // see below
+
+struct event {
+	long long deadline; // internal time in ms since midnight of the first day
+	struct agenda *agenda; // whose activity it is
+	int act; // index of the activity in the schedule
+	uint32_t day; // occurrence of the activity, local day (days since 1970) it starts
+	enum event_kind kind;
+	short slot; // slot of the wheel the event is in (only valid while pending)
+	struct event *next; // next event in the same slot
+	struct event **pprev; // pointer to the pointer to this event, NULL if not pending (for O(1) cancel)
+};
+
+// Timer wheel *******************************************************************************************
+// Five levels: 1000 one-millisecond slots, 60 one-second slots, 60 one-minute slots, 24 one-hour slots and 64
+// one-day slots. An event goes to the finest level that covers its distance from the current millisecond; when the
+// wheel reaches a second (minute, hour, day) boundary the slot of that second (...) is cascaded, ie. its events are
+// inserted again and end up in a finer level, so every event expires in the millisecond of its deadline. Events
+// further away than 64 days wait in the last day slot and are cascaded again when it's reached.
+// Insert, cancel and expire are O(1) per event (each event is cascaded at most a few times), and a bitmap of the
+// occupied slots lets the scheduler find the next millisecond it has to wake up at without scanning the slots.
+#define WHEEL_LEVELS 5
+#define WHEEL_SLOTS (1000 + 60 + 60 + 24 + 64)
+
+const int wheel_size[WHEEL_LEVELS] = { 1000, 60, 60, 24, 64 }; // slots of each level
+const int wheel_base[WHEEL_LEVELS] = { 0, 1000, 1060, 1120, 1144 }; // index of its first slot
+const long long wheel_unit[WHEEL_LEVELS] = { 1, 1000, 60000, 3600000, 86400000 }; // ms per slot (size * unit = next unit)
+
+struct wheel {
+	long long now; // next millisecond to be expired (internal ms since midnight of the first day)
+	long count; // number of pending events
+	unsigned long long bits[(WHEEL_SLOTS + 63) / 64]; // bit k set if slot k is not empty
+	struct event *slots[WHEEL_SLOTS];
+};
+
+// A schedule with the events of its activities and their states. The interactive agenda has a single one (granny's),
+// the multi-agenda engine (see below) can run thousands of them.
+struct agenda {
+	struct schedule *sch;
+	struct event *events; // events of the activities (3 per activity), event of kind k of activity i at i*3+k
+	bool quiet; // notifications are only counted, not printed (agendas of the engine)
+	bool recurring; // the next occurrence is armed when an activity ends (otherwise only the day it was built for)
+	_Atomic long notified; // notifications given (starts and 10 minutes remaining)
+};
+
+struct agenda granny = { .sch = &acts, .recurring = true };
+struct wheel agenda_wheel; // pending events of granny's agenda
+bool scheduler_stop = false; // set by main when exiting
+pthread_mutex_t sched_mutex; // protects agenda_wheel and scheduler_stop
+pthread_cond_t sched_cond; // signalled when the wheel changes or the scheduler has to stop
+
+// Lateness of every fired event (real time between its deadline and the moment it was dispatched), so the
+// bound can be measured. Only written by the scheduler thread, read by main once the scheduler has finished.
+long sched_fired = 0;
+long long sched_late_total_ns = 0;
+long long sched_late_max_ns = 0;
+
+// Reactor ***********************************************************************************************
+// With --reactor the agenda runs in a single thread instead of main + dispatcher + scheduler: one epoll loop waits
+// on stdin (non-blocking, read line by line), a timerfd armed for the next deadline of the wheel, another one armed
+// when the next output is due (3 seconds pacing) and a signalfd (SIGINT / SIGTERM to stop, SIGUSR1 to dump the
+// statistics with --stats). Granny's questions and answers and every output are the same as with the threads.
+#define REACTOR_INPUT 4096 // bytes of stdin buffered while a line isn't complete
+
+// Threads (or the reactor) returning from a blocking call, to compare both designs
+_Atomic long wakeups = 0;
+
+// Multi-agenda engine ***********************************************************************************
+// One process serving the agendas of many people: agenda k belongs to shard k % shards, and every shard has one
+// worker thread, one wheel with the events of all its agendas and one queue of pending queries (questions like the
+// ones granny types), both protected by the shard's mutex. A worker sleeps until its next deadline or until a query
+// is queued; when its own queue is empty it steals half of the queue of another shard, so a burst of questions for a
+// few agendas is spread over every thread. States are atomic flags (see the schedule), so answering a stolen query
+// only takes the mutex of its agenda's shard to cancel a warning.
+#define ENGINE_QUEUE 4096 // pending queries per shard, power of two
+#define ENGINE_BATCH 64 // queries taken from a queue at once
+#define ENGINE_STEAL 32 // a sleeping worker is woken up to steal when a queue is longer than this
+
+struct query {
+	int agenda; // index of the agenda in the engine
+	int minute; // minute of the day asked about
+	bool yes; // the answer if the activity is undone (yes: it's marked as done)
+	int activity; // result: activity at that minute, -1 if none
+	bool done; // result: the activity had already been done
+	void (*complete)(struct query *q); // called by the worker that answered it
+	void *context; // for complete()
+};
+
+struct shard {
+	pthread_mutex_t mutex; // protects wheel, queue, head and tail
+	pthread_cond_t cond; // signalled when a query is queued (or to steal / stop)
+	struct wheel wheel;
+	struct query *queue[ENGINE_QUEUE];
+	unsigned head, tail; // queue[head..tail) are pending (positions, wrapped with ENGINE_QUEUE - 1)
+	_Atomic bool sleeping; // the worker is waiting on cond
+	struct engine *engine;
+	int index;
+	pthread_t thread;
+	long fired, answered, stolen; // only written by the worker of this shard
+	_Atomic long cancelled; // warnings cancelled in this shard's wheel (by any worker)
+};
+
+struct engine {
+	struct agenda *agendas;
+	int count;
+	struct shard *shards;
+	int shards_count;
+	_Atomic bool stop;
+	_Atomic long long answered; // queries answered so far
+};
+
+// Histograms ******************************************************************************************
+// Distribution of some measure (ns, ms...) in log-linear buckets (like HDR histograms): values below
+// HISTOGRAM_SUB have a bucket each (values <= 0 go to bucket 0), and every power of two range above is split into
+// HISTOGRAM_SUB equal buckets. Percentiles are given as the upper bound of their bucket, so within 1/HISTOGRAM_SUB
+// (6%) of the value, eg. a 1 ms bound is told apart from 1.05 ms.
+// Every field is atomic (relaxed) so that several threads can add to the same histogram.
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS) // buckets per power of two
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+struct histogram {
+	_Atomic long long count;
+	_Atomic long long sum;
+	_Atomic long long max;
+	_Atomic long long buckets[HISTOGRAM_BUCKETS];
+};
+
+// Runtime statistics ************************************************************************************
+// With --stats the agenda measures where its time goes and publishes it in a shared memory page (/granny.PID, see
+// shm_open) that another process can map and read at any time without stopping it (./granny --stats-read PID).
+// Sending SIGUSR1 to the agenda dumps the same page to stderr (a thread waits for the signal with sigwait(), so
+// nothing is done inside a signal handler). Without --stats the page isn't created and every measuring point is a
+// single test of a NULL pointer.
+#define STATS_MAGIC 0x7374617473796e67LL // to check what's mapped is really a stats page
+#define STATS_VERSION 3
+
+struct stats_page {
+	long long magic;
+	int version;
+	int pid;
+	long long started_ns; // CLOCK_MONOTONIC when the page was created, for rates
+	_Atomic long long scheduler_wakeups; // returns from the scheduler's timed wait (deadline, change or spurious)
+	struct histogram sched_wait_ns; // waiting to lock sched_mutex
+	struct histogram sched_hold_ns; // sched_mutex held (until unlocked or until the scheduler waits on sched_cond)
+	struct histogram output_pacing_ns; // dispatcher sleeping for the 3 seconds between outputs
+	struct histogram lateness_ns; // notifications: real time fired - deadline
+	struct histogram lookup_ns; // granny's question: from her input to the activity found
+	_Atomic long long output_overflowed; // messages that found the output ring full (they went to the overflow)
+	_Atomic long long output_dropped; // messages lost: no memory for the overflow
+};
+
+struct stats_page *stats = NULL; // NULL unless --stats
+long long sched_locked_ns; // when sched_mutex was locked (protected by sched_mutex, only used with stats)
+
+// Simulation *******************************************************************************************
+// With --simulate DAYS the agenda runs a number of days without any real time passing: the internal clock runs as
+// fast as possible (it jumps from one deadline to the next), granny's input comes from a script and outputs are
+// recorded instead of printed. The agenda is started once and runs day after day like it would for real, every
+// activity recurring on the days of its rule. The notifications are checked against what was expected (computed from
+// the schedule, its rules and the script, independently from the wheel) to count missed and duplicate ones: the
+// occurrences of a day are checked once they're all over (two days later), so only the last SIMULATION_DAYS days
+// are kept whatever the length of the run (its memory is printed after the first day and at the end). The lateness of
+// each one (internal time when it was fired - its deadline), the cost of firing it and how long the scheduler
+// mutex is held are measured. Since the clock jumps straight to every deadline, nothing is ever late unless
+// --jitter MS makes each wake-up late by a pseudo-random 0 to MS ms (always the same sequence), like a loaded
+// machine would. The exit status is 1 if anything was missed, duplicated or a minute late, so this
+// can be used as a regression test of the scheduler and the clock.
+// Script lines are "at,question,answer", eg. "10:05,10:00,yes": every day at 10:05 granny asks what she should be
+// doing at 10:00 and answers yes (empty lines and lines starting with '#' are ignored).
+#define SIMULATION_DAYS 4 // occurrences of each activity being checked (a power of two)
+
+struct script_entry {
+	int at; // minute of the day when granny types the question
+	int question; // minute of the day she asks about
+	bool yes; // her answer if the activity is undone
+};
+
+struct simulation {
+	long long fired[3]; // notifications by kind (starts, warnings) and auto-completions (ends)
+	long long expected[2]; // starts and warnings expected
+	long long missed[2];
+	long long duplicates[2];
+	long long acks; // activities marked as done by granny
+	struct histogram lateness_ms; // internal ms between the deadline and the notification
+	struct histogram fire_ns; // real time spent firing one event
+	struct histogram hold_ns; // real time sched_mutex was held for each wheel operation
+	uint8_t *seen; // notifications of occurrence day of activity i (bit 1 << kind) at (day % SIMULATION_DAYS) * count + i
+	long long *acked_at; // internal time granny acknowledged that occurrence (-1: not acked), same index
+};
+
+struct simulation *simulation = NULL; // set while simulating
+bool output_discard = false; // outputs are dropped (not queued): the multi-agenda benchmark
+
+// Query server ******************************************************************************************
+// With --serve PATH a server thread answers questions about granny's agenda on a Unix domain stream socket, for any
+// number of local clients at once (one epoll loop, non-blocking sockets). The protocol is binary with fixed sizes:
+// a client sends 4 byte requests (what's scheduled at some minute, or acknowledge that activity as done) and gets
+// one 8 byte response per request, in order, so it can pipeline as many requests as it wants. Everything received
+// from a client is answered in one batch: the responses are built straight into the connection's send buffer and go
+// out with a single send(). A client that doesn't read its responses stops being read (until they're sent).
+#define SERVER_IN 4096 // bytes received at once per connection (1024 requests)
+#define SERVER_OUT (SERVER_IN * 2) // room for the responses of a full receive buffer
+#define SERVER_EVENTS 256 // epoll events handled per wakeup
+
+enum server_op { OP_LOOKUP = 1, OP_ACK = 2 };
+enum server_status { STATUS_OK, STATUS_NONE, STATUS_ALREADY_DONE, STATUS_BAD_REQUEST };
+
+struct server_request {
+	uint8_t op; // enum server_op
+	uint8_t reserved;
+	uint16_t minute; // minute of the day asked about (0-1439)
+};
+
+struct server_response {
+	uint8_t status; // enum server_status (OP_ACK: STATUS_OK if the activity was marked as done by this request)
+	uint8_t flags; // bit f set if the activity has flag f (enum activity_flag), after the request
+	uint16_t activity; // index in the schedule, 0xffff if none
+	uint16_t start; // minute of the day
+	uint16_t end;
+};
+
+struct connection {
+	int fd;
+	size_t in_length; // bytes of an incomplete request kept from the last receive
+	size_t out_length; // bytes of responses built
+	size_t out_sent; // bytes of them already sent
+	uint32_t watching; // EPOLLIN or EPOLLOUT (while responses are waiting to be sent)
+	_Alignas(8) unsigned char in[SERVER_IN];
+	_Alignas(8) unsigned char out[SERVER_OUT];
+};
+
+int server_listener = -1;
+int server_wakeup = -1; // eventfd written to stop the server thread
+pthread_t thread_server;
+_Atomic long long server_requests = 0;
+_Atomic long server_clients = 0; // accepted so far
+
+// Load generator: clients spread over a few threads, each one keeping a number of requests in flight
+#define LOAD_THREADS 4
+#define LOAD_DEPTH 8 // requests in flight per client
+
+struct load_client {
+	int fd;
+	long long sent_ns[LOAD_DEPTH]; // send time of the requests in flight, oldest at sent_head
+	int sent_head, in_flight;
+	size_t in_length; // bytes of an incomplete response
+	_Alignas(8) unsigned char in[LOAD_DEPTH * sizeof(struct server_response)];
+};
+
+struct load_thread {
+	const char *path;
+	int clients;
+	long long until_ns; // CLOCK_MONOTONIC end of the run
+	unsigned long long seed;
+	long long answered;
+	int errors;
+	struct histogram latency_ns;
+};
+
+// Batch queries ****************************************************************************************
+// With --batch [FILE] the question main() answers for one prompt is answered for every line of a file (or stdin):
+// each line is a time (H:MM / HH:MM) or an epoch in seconds (converted to the local minute of the day), and the
+// same line is written back followed by a tab and the name of the activity ('-' if none, '?' if the line isn't a
+// time). Input and output go through big buffers with read() / write(), and the queries are matched a block at a
+// time against the start / end arrays of the schedule with vector compares (gcc vector extensions: SSE2 by
+// default, AVX2 / AVX-512 with -march=native), BATCH_LANES minutes per compare. That's one compare per activity
+// for a whole vector of queries, so with big schedules (more than BATCH_VECTOR_MAX activities) the lookup table is
+// used instead. Both give the same answer as the prompt (the later activity wins if they overlap).
+#ifdef __AVX2__
+#define BATCH_LANES 16 // minutes per vector: one register, wider vectors would be split by the compiler
+#else
+#define BATCH_LANES 8
+#endif
+#define BATCH_BLOCK 4096 // queries matched at once (multiple of BATCH_LANES)
+#define BATCH_READ (1 << 20) // bytes read at once
+#define BATCH_WRITE (1 << 20) // bytes written at once
+#define BATCH_VECTOR_MAX 64
+
+typedef int16_t batch_vector __attribute__((vector_size(BATCH_LANES * sizeof(int16_t))));
+
+// Journal *********************************************************************************************
+// With --journal FILE every state transition of granny's activities (done, start / 10 minutes remaining notified)
+// is appended to a file, so that a restarted agenda knows what she already did today and doesn't notify her again.
+// schedule_transition() only copies a 16 byte record into the pending batch (under a mutex held for that copy):
+// the journal thread writes the whole batch at once and makes it durable with one fdatasync() (group commit), so
+// nobody acknowledging an activity waits for the disk. What's acknowledged during the last commit is lost in a crash.
+// At start-up the file is mapped and replayed (only the occurrences of today and yesterday count, yesterday's for
+// the night activity), a torn last record is cut off, and the file is compacted (rewritten as one record per flag set
+// in those occurrences, then renamed over the old one) when it's mostly stale: at start-up and, while running, when
+// it has more than twice the records the flags need, so a journal running for a year stays the size of two days.
+#define JOURNAL_MAGIC 0x6a726e6cu // mixed into the check of every record
+#define JOURNAL_SCHEDULE 0xffff // flag of the first record, which describes the schedule the journal is for
+#define JOURNAL_COMPACT_MIN 4096 // records in the file before compacting while running is considered
+#define JOURNAL_CHUNK 4096 // records written at once when compacting
+
+struct journal_record {
+	uint32_t check; // JOURNAL_MAGIC mixed with the rest, to find torn / garbage records
+	uint32_t activity; // JOURNAL_SCHEDULE record: number of activities
+	uint32_t day; // occurrence of the transition (local days since 1970); JOURNAL_SCHEDULE record: fingerprint of the schedule
+	uint16_t flag; // enum activity_flag, or JOURNAL_SCHEDULE
+	uint16_t reserved;
+};
+
+struct journal {
+	const char *path;
+	int fd; // only used by the journal thread once it runs
+	struct schedule *sch;
+	int count; // activities when it was opened (the ones added later by live edits aren't journaled)
+	uint32_t fingerprint; // of the schedule when it was opened
+	uint32_t day; // latest occurrence appended (protected by mutex), the flags of older days than the one before are stale
+	pthread_mutex_t mutex; // protects the pending batch, day and stop
+	pthread_cond_t cond;
+	struct journal_record *pending; // batch being filled
+	size_t pending_count, pending_capacity;
+	struct journal_record *writing; // batch being written by the journal thread
+	size_t writing_capacity;
+	bool stop;
+	pthread_t thread;
+	long long records; // in the file
+	long long commits; // fdatasync() calls
+	long long compactions;
+	long long lost; // records that couldn't be queued (no memory) or written
+	long long replayed; // records of today found at start-up
+	long long recovery_ns; // time to map and replay the file
+};
+
+struct journal granny_journal; // --journal
+
+// Adherence history ***********************************************************************************
+// With --history FILE the outcome of every occurrence of granny's activities is kept, for years: when it's over (its
+// end event), whether she said she did it or the agenda completed it at its end without her (skipped), whether she
+// was told it was finishing in 10 minutes, and how long after its start she answered. The outcomes are buffered and
+// written HISTORY_BLOCK at a time as a block of columns (no fdatasync: a crash loses the block being filled, the
+// journal is what protects today's states):
+//   header   struct history_header
+//   names    the activity names first seen in this block, null terminated (their ids follow those of earlier blocks)
+//   days     occurrence of each outcome - first_day, 1 or 2 bytes (day_bytes)
+//   ids      id of the activity's name in the dictionary, 1, 2 or 4 bytes (id_bytes)
+//   states   2 bits per outcome (HISTORY_GRANNY, HISTORY_WARNED), 4 outcomes per byte
+//   answers  one LEB128 varint per outcome done by granny: ms from the start to her answer + 1 (0: unknown)
+// So an outcome takes 4 to 5 bytes (a journal record takes 16), names are stored once per file, and a block is
+// checked as a whole. ./granny --history-report FILE [DAYS] reads the file once, a block at a time, and prints the
+// completion rate and the response times of each activity (over the last DAYS days): its memory is one block plus
+// a few counters per name, whatever the years in the file. Only the activities of the schedule the agenda started
+// with are recorded (like the journal), and a file is truncated after its last complete block when it's opened.
+#define HISTORY_MAGIC 0x68697374u
+#define HISTORY_BLOCK 4096 // outcomes in a full block
+#define HISTORY_GRANNY 1 // done by granny, otherwise completed by the agenda at its end
+#define HISTORY_WARNED 2 // the 10 minutes remaining were notified
+
+struct history_header {
+	uint32_t magic;
+	uint32_t count; // outcomes
+	uint32_t first_day; // the days column is relative to it
+	uint32_t names; // new names in the dictionary
+	uint32_t names_size; // bytes of them
+	uint32_t answers_size; // bytes of the answers column
+	uint32_t check; // hash of the rest of the block, to find a torn / garbage block
+	uint8_t day_bytes;
+	uint8_t id_bytes;
+	uint16_t span; // last day - first_day, so a block that ends before the days wanted isn't even read
+};
+
+struct history_outcome { // one outcome waiting for its block
+	uint32_t day;
+	uint32_t id;
+	uint32_t answer; // ms from the start to granny's answer + 1 (0: unknown or not done by her)
+	uint8_t state;
+};
+
+struct history_names { // dictionary of the names in a history file (an id is the order a name was first seen in)
+	char *text; // names, each one followed by a null char
+	size_t size, capacity;
+	uint32_t *offset; // offset of name id in text
+	uint32_t count, offset_capacity;
+	uint32_t *slots; // open addressing hash table: id + 1 (0: empty), kept at most half full
+	uint32_t slots_capacity; // power of two
+};
+
+struct history {
+	const char *path;
+	int fd;
+	struct schedule *sch;
+	int count; // activities when it was opened
+	int32_t *ids; // id of the name of activity i (-1: not in the dictionary yet)
+	_Atomic unsigned long long *answered; // when granny last said she did activity i (see history_answer())
+	pthread_mutex_t mutex; // protects what's below (outcomes come from the scheduler thread and the simulation)
+	struct history_names names;
+	uint32_t names_written; // the first ones are in the file already
+	struct history_outcome *pending; // block being filled
+	int pending_count;
+	uint32_t pending_first, pending_last; // days of the pending outcomes
+	long long outcomes, blocks, bytes; // in the file
+	long long lost; // outcomes that couldn't be written
+	bool torn; // a write failed part of the way: the file must be cut back to bytes before the next block
+};
+
+struct history_reader { // reads a history file one block at a time
+	int fd;
+	off_t offset, size; // of the next block, of the file
+	struct history_header header;
+	bool columns; // they were read (otherwise only the names)
+	unsigned char *block; // names and columns of the block read
+	size_t block_capacity;
+	struct history_names *names; // the dictionary grows with the blocks read
+};
+
+struct history_stats { // outcomes of one name, summed by history_aggregate()
+	long long occurrences, granny, warned, answers;
+	long long answer_ms; // sum of the known response times
+	long long answer_max;
+	long long answer_buckets[HISTOGRAM_BUCKETS]; // like those of a histogram, without atomics (the aggregate is done by one thread)
+};
+
+struct history_summary {
+	struct history_names names;
+	struct history_stats *stats; // by id
+	uint32_t stats_capacity;
+	uint32_t first_day, last_day; // of the outcomes counted
+	long long outcomes, blocks, bytes; // read
+	size_t memory; // peak of the buffers and counters
+};
+
+struct history granny_history; // --history
+
+// Live editing ****************************************************************************************
+// With --edits FILE (usually a named pipe) the schedule can be changed while the agenda runs, one edit per line:
+//   add 15:00,15:30,Walk       a new activity (like a line of a schedule file)
+//   move 15:00 16:00,16:30     the activity granny would be told about at 15:00 gets new times
+//   remove 15:00               the activity at 15:00 is removed
+// Granny's questions and the query server never wait for an edit: they read the activity at a minute from an
+// immutable version of the lookup table, published with an atomic pointer swap (RCU style). The editor thread
+// copies the current version (1440 entries whatever the size of the schedule), patches the minutes of the edited
+// activities, publishes it and frees the old one after a grace period: a reader counts itself in readers[epoch % 2]
+// while it reads, and the editor moves to the next epoch and waits for the old counter to drain.
+// The activities are append-only while editing (an added or moved activity gets a new index, a removed one keeps
+// its own) and their arrays are reserved at LIVE_CAPACITY activities, so nothing a reader uses ever moves. The
+// events of an edited activity are built by the editor too and handed to the scheduler through a lock-free list;
+// the scheduler adds / cancels them in its wheel when it wakes up. An edit costs the copy plus its own minutes,
+// except removing an activity that overlapped others in the schedule file (the minutes it had are searched again
+// among every activity). Edits that would overlap another activity are refused (see assumption 7). A moved
+// activity starts undone and keeps its rule, an added one occurs every day, and edits aren't saved: they last until
+// the agenda stops. Neither the journal nor the history know about the activities edits add (or the new index of a
+// moved one), so a restarted agenda has the schedule it was started with and forgets what granny did with them.
+#define LIVE_CAPACITY (1 << 20) // activities, removed ones included
+#define LIVE_NAMES (64 << 20) // bytes of names
+#define LIVE_INPUT 4096 // bytes of the edits file buffered while a line isn't complete
+
+struct version {
+	long number; // edits applied
+	int lookup[24*60]; // activity at each minute (-1: none), like lookup_table
+};
+
+struct timer_change { // an event handed to the scheduler by the editor
+	struct event *ev;
+	bool cancel; // cancel it, otherwise add it
+	struct timer_change *next;
+};
+
+struct live {
+	struct schedule *sch;
+	struct agenda *agenda;
+	bool editable; // --edits (otherwise there's only the first version)
+	bool quiet; // edits aren't announced (benchmark)
+	struct version *_Atomic version; // the current one
+	_Atomic unsigned long epoch;
+	_Atomic long readers[2]; // readers[e % 2]: readers that started in an epoch e
+	struct timer_change *_Atomic timers; // pushed by the editor, taken by the scheduler
+	_Atomic uint64_t *removed; // bit i set: activity i was removed (NULL unless editable)
+	// Only used by the editor
+	int covering[24*60]; // activities covering each minute
+	long edits, refused;
+	long long edit_ns; // total time of the edits, grace periods included
+	long long grace_ns; // total time waiting for grace periods
+};
+
+struct live live; // granny's schedule
+const char *editor_path; // --edits
+pthread_t thread_editor;
+int editor_wakeup = -1; // eventfd to stop the editor
+
+// Function declarations *********************************************************************************
+int ask(char *hour_user, uint32_t *day); // PHASE 1 and 2 for one question of granny, the activity if it needs a yes/no answer
+void reply(int j, uint32_t day, const char *answer); // her yes/no answer about activity j (its occurrence of day)
+bool acknowledge(int j, uint32_t day); // activity j done, true if it wasn't (cancels its warning)
+void output_init(void); // to prepare the output ring
+bool output(const char *format, ...) __attribute__((format(printf, 1, 2))); // queue a message (never blocks), false: dropped (no memory)
+void output_mark(void); // granny just input something: the next output waits 3 seconds from now
+struct output_slot *output_claim(void); // to reserve a slot of the ring (NULL if full)
+struct output_slot *output_reserve(struct output_overflow **node); // a slot of the ring or of a new overflow node
+void output_publish(struct output_slot *slot, struct output_overflow *node); // to hand a reserved slot to the dispatcher
+void output_drop(void); // no memory for a message
+void *dispatcher(); // for the output dispatcher thread (the 3 seconds between outputs)
+long long output_print(long long *last, bool paced); // prints what can be, returns when the next output is due
+long long output_show(struct output_slot *slot, long long *last, bool *paced); // one to the console, -1 or when it's due
+int output_sinks_open(const char *log_path, const char *socket_path); // --log / --log-socket, -1 if they can't be
+void output_sinks(void); // hands the messages published since the last call to the log file and the socket
+void output_sinks_write(struct output_slot *batch[], int n); // one batch to each of them
+bool output_log_write(struct iovec *iov, int count, size_t bytes); // one batch, rotating the file first if needed
+void output_log_rotate(void); // FILE -> FILE.1 ..., then a new FILE
+long long wallclock(uint32_t *day); // real local time, ms since local midnight, and its local day (days since 1970)
+long long wallclock_ms(void); // real local time, ms since local midnight
+uint32_t local_day(void); // local days since 1970
+void clock_init(void); // to capture the reference of the internal clock
+long long internal_now(void); // current internal time (ms since midnight of the first day)
+struct timespec internal_to_monotonic(long long internal_ms); // real (monotonic) time of an internal deadline
+void clock_jump(long long internal_ms); // to move the internal clock forward when running as fast as possible
+bool parse_speed(const char *text); // to read the speed factor of the internal clock from the command line
+void schedule_init(struct schedule *sch); // empty schedule
+void schedule_free(struct schedule *sch); // to release the memory of a schedule
+void *schedule_map(size_t bytes, const void *used, size_t used_bytes); // mapping of a maximum size, for reserve
+bool schedule_reserve(struct schedule *sch, int capacity, size_t names_capacity); // arrays that never move
+uint32_t schedule_hash(const char *name, size_t length); // hash of a name for interning
+bool schedule_intern_grow(struct schedule *sch); // to make the intern hash table bigger
+int64_t schedule_intern(struct schedule *sch, const char *name, size_t length, uint32_t hash); // offset of a name
+bool schedule_add(struct schedule *sch, int start, int end, const char *name, size_t length, uint32_t hash); // append
+bool schedule_precise(struct schedule *sch); // adds the arrays of the times past the minute, false: no memory
+int schedule_start_ms(const struct schedule *sch, int i); // ms past the start minute of activity i
+int schedule_end_ms(const struct schedule *sch, int i); // ms past its end minute
+bool schedule_load_default(struct schedule *sch); // granny's predesigned schedule
+bool schedule_load_compiled(struct schedule *sch); // the one compiled in with -DGRANNY_SCHEDULE, false: none
+int schedule_compile(const char *path, const char *source); // writes acts as a header for -DGRANNY_SCHEDULE
+void compile_values(FILE *file, const char *type, const char *name, const void *values, size_t count); // array
+void compile_string(FILE *file, const char *text, size_t length); // C string literal of length bytes
+const char *schedule_name(const struct schedule *sch, int i); // name of activity i
+bool schedule_state(const struct schedule *sch, int i, uint32_t day, enum activity_flag flag); // a flag of one occurrence
+bool schedule_transition(struct schedule *sch, int i, uint32_t day, enum activity_flag flag); // set it, true if it wasn't
+void schedule_reset(struct schedule *sch); // every activity undone, nothing notified
+uint32_t schedule_occurrence(const struct schedule *sch, int i, long long now); // the one asked about
+int schedule_rule(struct schedule *sch, const struct rule *rule, const uint32_t *dates); // index of a rule, -1: memory
+bool rule_matches(const struct schedule *sch, int r, uint32_t day); // rule r has an occurrence that day
+bool rule_meets(const struct schedule *sch, int a, int b, int shift, uint32_t from); // a on some day, b on day + shift
+uint32_t rule_next(const struct schedule *sch, int r, uint32_t day); // first day >= day it has (UINT32_MAX: none)
+bool rule_word(const char **text, const char *end, const char *expected); // the next word of a rule, if it's that one
+int parse_rule(struct schedule *sch, const char **text, const char *end, uint32_t today); // [...] at the start of a line
+bool parse_date(const char **text, const char *end, uint32_t *day); // YYYY-MM-DD
+uint32_t days_from_civil(int year, int month, int day); // days since 1970-01-01
+void format_date(char text[11], uint32_t day); // YYYY-MM-DD
+void format_rule(char *text, size_t size, const struct schedule *sch, int r); // rule r as written in schedule files
+bool parse_time(const char **text, const char *end, int *minute_of_day); // H:MM or HH:MM
+bool parse_seconds(const char **text, const char *end, int *ms); // :SS or :SS.mmm after a time, if there is one
+void format_time(char text[6], int minute_of_day); // HH:MM
+void format_seconds(char text[8], int ms); // :SS or :SS.mmm past the minute ("" if it's a whole minute)
+int load_schedule(const char *path); // to load the activities from a schedule file
+bool load_precise(struct schedule *loaded, const struct pending_activity *pending); // its times past the minute
+void build_lookup(void); // to fill the lookup table
+int lookup_scan(int hour, int minute); // the old search through all the activities (for the benchmark)
+int intervals_build(struct intervals *x, const struct schedule *sch); // index of a schedule, -1 if no memory
+void intervals_free(struct intervals *x);
+int intervals_augment(struct intervals *x, long low, long high); // max_end of the subtree of low - high, its latest end
+long intervals_range(const struct intervals *x, int from, int to, int *found, long capacity); // activities in a span
+void intervals_search(const struct intervals *x, long low, long high, struct interval_query *q); // pieces of a subtree
+int intervals_free_slot(const struct intervals *x, int length, int after); // start of the first free slot, -1: none
+bool intervals_meet(const struct intervals *x, long p, long q, uint32_t from); // their activities occur the same day
+long intervals_partner(const struct intervals *x, long low, long high, long p, uint32_t from); // what p starts during
+long intervals_overlaps(const struct intervals *x, uint32_t from, int *a, int *b); // activities starting during another
+long schedule_overlaps(const struct schedule *sch, uint32_t from, int *a, int *b); // the same for a whole schedule
+bool agenda_build(struct agenda *a, struct wheel *w, long long now); // adds its events still ahead of now to w
+int agenda_activity(struct agenda *a, int i, long long now, struct event *pending[3]); // next occurrence of activity i
+void agenda_rearm(struct event *ends, struct wheel *w, long long now); // next occurrences of the activities that ended
+int agenda_lookup(struct live *l, int minute_of_day, long long now, uint32_t *day); // activity and occurrence asked about
+void build_events(void); // to fill the wheel with the events of granny's agenda that are still ahead of us
+void wheel_init(struct wheel *w, long long now_ms); // empty wheel starting at some internal time
+void wheel_add(struct wheel *w, struct event *ev); // O(1) insertion
+void wheel_cancel(struct wheel *w, struct event *ev); // O(1) removal of a pending event
+void wheel_clear_bit(struct wheel *w, int slot); // to mark a slot as empty
+int wheel_first(const struct wheel *w, int from, int to); // first occupied slot from - to (excluded), -1: none
+void wheel_cascade(struct wheel *w, int slot); // to move the events of a second / minute / hour / day slot down
+long long wheel_next(struct wheel *w); // next millisecond the wheel has to be advanced to (-1 if empty)
+struct event *wheel_expire(struct wheel *w, long long until_ms); // list of the events due up to some millisecond
+void fire(struct event *ev); // prints / changes states for one due event
+int histogram_bucket(long long value); // bucket of a value
+long long histogram_bucket_max(int bucket); // the biggest value in a bucket
+void histogram_add(struct histogram *h, long long value); // one more value
+long long histogram_percentile(const struct histogram *h, double percent); // eg. 99 for p99 (upper bound)
+int stats_open(void); // creates the shared stats page (--stats), -1 if it can't
+void stats_close(void); // removes it
+void stats_print(FILE *file, const struct stats_page *page); // human readable dump
+int stats_read(const char *pid); // --stats-read: prints the page of a running agenda
+void *stats_signals(void *arg); // for the stats thread (dumps the page on SIGUSR1)
+void sched_lock(void); // sched_mutex, measuring how long it takes / it's held with --stats
+void sched_unlock(void);
+int sched_timedwait(const struct timespec *deadline); // pthread_cond_timedwait on sched_cond, same measures
+void simulation_record(struct event *ev); // a notification was given while simulating
+void simulation_check(struct simulation *sim, uint32_t day, long long end_ms); // the occurrences of a day, once over
+int load_script(const char *path, struct script_entry **entries); // script of a simulation, -1 if it can't be read
+int script_compare(const void *a, const void *b); // to sort the script by time
+int simulate(int days, const char *script_path, long long jitter_ms); // the deterministic simulation
+void fire_due(struct event *ev); // fire() an event that was due, measuring its lateness
+void *scheduler(); // for the scheduler thread (starts, 10 mins remaining and ends of activities)
+bool reactor_token(char *input, size_t *length, bool closed, char *token, size_t width); // next word, like scanf
+long long reactor_schedule(void); // fires what's due, returns the next deadline (CLOCK_MONOTONIC ns, -1: none)
+void reactor_arm(int timer, long long due_ns); // absolute CLOCK_MONOTONIC timer (-1 disarms it)
+int reactor(void); // the single threaded agenda (--reactor)
+void report(void); // lateness, output and resource usage once the agenda stops
+int schedule_find(const struct schedule *sch, int minute_of_day); // activity at some minute, without a lookup table
+int engine_init(struct engine *e, struct agenda *agendas, int count, int shards); // shards and their wheels, -1: memory
+void engine_start(struct engine *e); // one worker thread per shard
+bool engine_submit(struct engine *e, struct query *q); // queues a query, false if its shard's queue is full
+void engine_stop(struct engine *e); // stops and joins the workers (their counters can be read then)
+void engine_free(struct engine *e); // frees the shards once stopped
+void engine_answer(struct engine *e, struct query *q); // answers one query (any worker)
+int engine_steal(struct engine *e, struct shard *thief, struct query **batch); // half of another shard's queue
+void *engine_worker(void *arg); // for the worker thread of a shard
+void server_answer(const struct server_request *request, struct server_response *response); // one request
+bool server_serve(struct connection *c); // answers what a client sent, false if it's gone
+bool server_flush(struct connection *c); // sends the responses built, false if the client is gone
+int server_start(const char *path); // listens on a Unix socket and starts the server thread, -1 if it can't
+void server_stop(const char *path); // stops the thread, removes the socket
+void *server(void *arg); // for the server thread
+int load_connect(const char *path); // one client connection, -1 if it fails
+void histogram_merge(struct histogram *into, const struct histogram *h); // adds the values of h
+void *load_thread(void *arg); // for the threads of the load generator
+int load_generate(const char *path, int clients, int seconds, bool quiet); // runs clients against a server
+void batch_match(const struct schedule *sch, const int16_t *minutes, int16_t *found, size_t n); // vector matching
+int batch_epoch_minute(long long epoch); // local minute of the day of an epoch in seconds
+bool write_all(int fd, const void *buffer, size_t length); // all of it, false (and errno) if it can't
+int batch_run(int in_fd, int out_fd); // --batch: answers every line of in_fd into out_fd
+uint32_t journal_fingerprint(const struct schedule *sch); // hash of the activities, to recognize the schedule
+uint32_t journal_check(const struct journal_record *r); // check of a record
+struct journal_record journal_make(uint32_t activity, uint32_t day, int flag); // a record with its check
+int journal_open(struct journal *j, const char *path, struct schedule *sch, uint32_t day); // replays, starts thread
+void journal_append(struct journal *j, int activity, uint32_t day, enum activity_flag flag); // queues one (never waits)
+int journal_compact(struct journal *j); // rewrites the file with what's set in the last two days, -1 if it can't
+long long journal_live(struct journal *j); // flags set (records the compacted file would have)
+void *journal_writer(void *arg); // for the journal thread (group commits)
+void journal_close(struct journal *j); // commits what's pending and stops the thread
+int history_name(struct history_names *d, const char *name, size_t length, bool add); // id of a name, -1: none / memory
+void history_names_free(struct history_names *d);
+size_t history_size(const struct history_header *header); // bytes of the names and columns after a header
+uint32_t history_check(const struct history_header *header, const unsigned char *block); // check of a block
+unsigned char *history_put(unsigned char *p, uint32_t value, int bytes); // little endian
+uint32_t history_get(const unsigned char *p, int bytes);
+bool history_read(struct history_reader *r, uint32_t from); // the next block (its columns if it has day from or later)
+int history_open(struct history *h, const char *path, struct schedule *sch); // continues a file, or starts one
+void history_answer(struct history *h, int i, uint32_t day, long long now); // granny said she did that occurrence
+void history_record(struct history *h, int i, uint32_t day, bool by_granny); // the occurrence is over
+void history_append(struct history *h, uint32_t id, uint32_t day, int state, uint32_t answer); // queues an outcome
+bool history_flush(struct history *h); // writes the pending outcomes as a block (mutex held)
+void history_close(struct history *h); // flushes and closes
+int history_aggregate(const char *path, uint32_t from, struct history_summary *s); // one pass from day from
+void history_summary_free(struct history_summary *s);
+int history_report(const char *path, int days); // --history-report: completion rates and response times
+int live_init(struct live *l, struct schedule *sch, struct agenda *a, const int *lookup, bool editable); // first version
+void live_free(struct live *l); // once nobody uses it (benchmark)
+unsigned long live_read_lock(struct live *l); // a reader starts (never waits), returns its epoch
+void live_read_unlock(struct live *l, unsigned long epoch);
+int live_lookup(struct live *l, int minute_of_day); // activity at a minute in the current version
+void live_synchronize(struct live *l); // waits until every reader that could see an old version is gone
+void live_cover(struct live *l, struct version *v, int i, int delta); // activity i added to / removed from v
+void live_push(struct live *l, struct event *ev, bool cancel); // hands an event to the scheduler
+int live_edit(struct live *l, const char *line, const char *end); // one edit, -1 if refused
+void live_timers(struct live *l, struct wheel *w); // the scheduler applies what the editor handed it
+void *editor(void *arg); // for the editor thread (--edits)
+unsigned long long bench_random(unsigned long long *state); // cheap pseudo-random numbers for the benchmarks
+long long bench_ns(clockid_t clock); // timestamps for the benchmarks
+#ifdef GRANNY_BENCH
+int bench_wheel(void); // benchmark of the timer wheel, from 10 to 10M events
+int bench_lookup(void); // benchmark of the lookup table against the old search loop
+int bench_load(void); // benchmark of the schedule file loader with 1M activities
+int bench_layout(void); // memory and scan speed of the schedule arrays against the old struct of strings
+void *bench_state_worker(void *arg); // one thread of the state benchmark
+int bench_state(void); // many threads querying / acknowledging states: atomic flags against a mutex and strings
+void *bench_wallclock_worker(void *arg); // one thread of the wall clock benchmark
+int bench_wallclock(void); // wallclock_ms() against time() + localtime()
+void bench_agendas_complete(struct query *q); // completion of the queries of the engine benchmark
+int bench_agendas(void); // 100k agendas on 1 to 8 worker threads
+int bench_server(void); // the query server with 1 to 1000 clients of the load generator
+int bench_batch(void); // batch matching: scalar scan, vectors and lookup table; bulk I/O against scanf / printf
+void *bench_journal_worker(void *arg); // one thread acknowledging activities for the journal benchmark
+long bench_journal_compare(const struct schedule *a, const struct schedule *b); // states that differ
+long long bench_journal_run(struct schedule *sch, uint32_t day, int n_threads); // every flag of a day set, ns taken
+int bench_journal(void); // acknowledgement throughput with the journal, recovery and compaction of millions of records
+void *bench_edits_reader(void *arg); // one thread asking for random minutes during the live edits benchmark
+int bench_edits_step(struct live *l, struct wheel *w, bool occupied[], unsigned long long *seed); // random edit
+int bench_edits(void); // cost of live edits against rebuilding, and query latency while edits run
+bool bench_intervals_contains(int start, int end, int minute); // minute within start - end (maybe across midnight)
+int bench_intervals(void); // interval index against linear scans at 1M activities
+void *bench_output_worker(void *arg); // one thread sending notifications during the output benchmark
+void *bench_output_reader(void *arg); // the process at the other end of the log socket
+int bench_output(void); // notifications per second and lock hold time, mutex + fprintf against the ring and sinks
+int bench_startup_compare(const void *a, const void *b); // to sort the measures for their median
+long long bench_startup_process(char *const args[]); // ns from starting the agenda to its first answer
+int bench_startup(void); // start-up and first question, parsing the schedule against the compiled one
+void bench_lateness_sleeps(struct histogram *h); // lateness of plain sleeps, the reference
+int bench_lateness(void); // lateness of 100k notifications timed to the millisecond, with two timer slacks
+int bench_history(void); // recording and aggregating 10 years of outcomes of 1k activities a day
+#endif
+
+// Main **************************************************************************************************
+
+int main(int argc, char *argv[]){
+
+// Command line options: the speed of the internal clock, or a simulation / benchmarks (built with -DGRANNY_BENCH) run
+// instead of the agenda
+int arg;
+int simulate_days = 0; // > 0: run a simulation of that many days
+const char *script_path = NULL; // granny's input for the simulation
+long long simulate_jitter = 0; // --jitter: the simulated scheduler wakes up late by up to that many internal ms
+bool stats_enabled = false; // --stats: runtime statistics (see the runtime statistics section)
+bool reactor_mode = false; // --reactor: single threaded agenda (see the reactor section)
+const char *server_path = NULL; // --serve: Unix socket of the query server
+const char *batch_path = NULL; // --batch: file of times to answer ("-": stdin)
+const char *journal_path = NULL; // --journal: file of the state transitions
+const char *log_path = NULL; // --log: file getting every notification too
+const char *schedule_path = NULL; // --schedule: file the activities were loaded from
+const char *compile_path = NULL; // --compile: header to write the schedule to, instead of running the agenda
+const char *log_socket_path = NULL; // --log-socket: datagram socket getting every notification too
+const char *history_path = NULL; // --history: file of the outcome of every occurrence
+long timer_slack = 0; // --timer-slack: ns the kernel may add to the wakeups of every thread (0: its default, 50 us)
+int batch_fd;
+for(arg = 1; arg < argc; arg++){
+	if(!strcmp(argv[arg], "--speed") && arg + 1 < argc && parse_speed(argv[arg + 1])){
+		arg++;
+	}
+	else if(!strcmp(argv[arg], "--schedule") && arg + 1 < argc){
+		if(load_schedule(argv[arg + 1]) != 0){
+			return 1;
+		}
+		schedule_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--reactor")){
+		reactor_mode = true;
+	}
+	else if(!strcmp(argv[arg], "--stats")){
+		stats_enabled = true;
+	}
+	else if(!strcmp(argv[arg], "--stats-read") && arg + 1 < argc){
+		return stats_read(argv[arg + 1]);
+	}
+	else if(!strcmp(argv[arg], "--script") && arg + 1 < argc){
+		script_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--simulate") && arg + 1 < argc && atoi(argv[arg + 1]) > 0){
+		simulate_days = atoi(argv[++arg]);
+	}
+	else if(!strcmp(argv[arg], "--jitter") && arg + 1 < argc && atoll(argv[arg + 1]) >= 0){
+		simulate_jitter = atoll(argv[++arg]);
+	}
+	else if(!strcmp(argv[arg], "--journal") && arg + 1 < argc){
+		journal_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--log") && arg + 1 < argc){
+		log_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--log-socket") && arg + 1 < argc){
+		log_socket_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--edits") && arg + 1 < argc){
+		editor_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--history") && arg + 1 < argc){
+		history_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--history-report") && arg + 1 < argc){
+		return history_report(argv[arg + 1], arg + 2 < argc ? atoi(argv[arg + 2]) : 0);
+	}
+	else if(!strcmp(argv[arg], "--timer-slack") && arg + 1 < argc && atol(argv[arg + 1]) > 0){
+		timer_slack = atol(argv[++arg]);
+	}
+	else if(!strcmp(argv[arg], "--compile") && arg + 1 < argc){
+		compile_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--batch")){
+		batch_path = (arg + 1 < argc && (argv[arg + 1][0] != '-' || !strcmp(argv[arg + 1], "-"))) ? argv[++arg] : "-";
+	}
+	else if(!strcmp(argv[arg], "--serve") && arg + 1 < argc){
+		server_path = argv[++arg];
+	}
+	else if(!strcmp(argv[arg], "--load") && arg + 1 < argc){
+		return load_generate(argv[arg + 1], 1000, 5, false);
+	}
+#ifdef GRANNY_BENCH
+	else if(!strcmp(argv[arg], "--bench-wheel")){
+		return bench_wheel();
+	}
+	else if(!strcmp(argv[arg], "--bench-lookup")){
+		return bench_lookup();
+	}
+	else if(!strcmp(argv[arg], "--bench-load")){
+		return bench_load();
+	}
+	else if(!strcmp(argv[arg], "--bench-layout")){
+		return bench_layout();
+	}
+	else if(!strcmp(argv[arg], "--bench-state")){
+		return bench_state();
+	}
+	else if(!strcmp(argv[arg], "--bench-wallclock")){
+		return bench_wallclock();
+	}
+	else if(!strcmp(argv[arg], "--bench-agendas")){
+		return bench_agendas();
+	}
+	else if(!strcmp(argv[arg], "--bench-server")){
+		return bench_server();
+	}
+	else if(!strcmp(argv[arg], "--bench-batch")){
+		return bench_batch();
+	}
+	else if(!strcmp(argv[arg], "--bench-journal")){
+		return bench_journal();
+	}
+	else if(!strcmp(argv[arg], "--bench-edits")){
+		return bench_edits();
+	}
+	else if(!strcmp(argv[arg], "--bench-intervals")){
+		return bench_intervals();
+	}
+	else if(!strcmp(argv[arg], "--bench-output")){
+		return bench_output();
+	}
+	else if(!strcmp(argv[arg], "--bench-startup")){
+		return bench_startup();
+	}
+	else if(!strcmp(argv[arg], "--bench-lateness")){
+		return bench_lateness();
+	}
+	else if(!strcmp(argv[arg], "--bench-history")){
+		return bench_history();
+	}
+#endif
+	else{
+		fprintf(stderr, "Usage: %s [--speed N | N/D | max] [--schedule FILE] [--reactor] [--stats] [--simulate DAYS [--script FILE] [--jitter MS]] [--stats-read PID | --history-report FILE [DAYS]] [--timer-slack NS] [--compile FILE] [--journal FILE] [--history FILE] [--edits FILE] [--log FILE] [--log-socket PATH] [--serve PATH | --load PATH | --batch [FILE]]\n", argv[0]);
+#ifdef GRANNY_BENCH
+		fprintf(stderr, "       %s --bench-wheel | --bench-lookup | --bench-load | --bench-layout | --bench-state | --bench-wallclock | --bench-agendas | --bench-server | --bench-batch | --bench-journal | --bench-edits | --bench-intervals | --bench-output | --bench-startup | --bench-lateness | --bench-history\n", argv[0]);
+#endif
+		return 1;
+	}
+}
+if(acts.count == 0 && !schedule_load_compiled(&acts) && !schedule_load_default(&acts)){ // no schedule file
+	fprintf(stderr, "Not enough memory for the schedule\n");
+	return 1;
+}
+if(compile_path){
+	return schedule_compile(compile_path, schedule_path);
+}
+if(history_path && history_open(&granny_history, history_path, &acts) != 0){ // (also what a simulation does)
+	return 1;
+}
+if(simulate_days > 0){
+	arg = simulate(simulate_days, script_path, simulate_jitter);
+	if(history_path){
+		history_close(&granny_history);
+	}
+	return arg;
+}
+if(batch_path){
+	batch_fd = strcmp(batch_path, "-") ? open(batch_path, O_RDONLY) : STDIN_FILENO;
+	if(batch_fd == -1){
+		fprintf(stderr, "Can't open %s: %s\n", batch_path, strerror(errno));
+		return 1;
+	}
+	return batch_run(batch_fd, STDOUT_FILENO);
+}
+if(server_path && reactor_mode){
+	fprintf(stderr, "--serve needs the threads (the reactor only serves granny)\n");
+	return 1;
+}
+if(editor_path && reactor_mode){
+	fprintf(stderr, "--edits needs the threads\n");
+	return 1;
+}
+if(journal_path && journal_open(&granny_journal, journal_path, &acts, local_day()) != 0){ // what she did today
+	return 1;
+}
+if(output_sinks_open(log_path, log_socket_path) != 0){
+	return 1;
+}
+
+// Variable declarations for the main thread
+int j; // to save the value of the activity to print out on the console
+uint32_t day; // occurrence of activity j she's asked about
+char answer[4]; // to capture answer from the user (yes/no)?
+char hour_user[6]; // to capture user's input in string format ie. 08:25, 6th place for \0
+char start_time[6]; // HH:MM strings for printing
+char end_time[6];
+char start_seconds[8]; // and the seconds past them, if any
+char end_seconds[8];
+char rule[64]; // days of the activities that don't occur every day
+char next_date[11];
+
+// This is the initial schedule, printed when initializing the program  
+printf("-------------------------------------- Granny's schedule --------------------------------------\n");
+for(j=0;j<acts.count;j++){
+	format_time(start_time, acts.start[j]);
+	format_time(end_time, acts.end[j]);
+	format_seconds(start_seconds, schedule_start_ms(&acts, j));
+	format_seconds(end_seconds, schedule_end_ms(&acts, j));
+	if(acts.rule[j] == 0){
+		printf("%s at: %s%s until: %s%s\n", schedule_name(&acts, j), start_time, start_seconds, end_time, end_seconds);
+		continue;
+	}
+	format_rule(rule, sizeof(rule), &acts, acts.rule[j]);
+	day = rule_next(&acts, acts.rule[j], local_day());
+	if(day == UINT32_MAX){
+		strcpy(next_date, "none");
+	}
+	else{
+		format_date(next_date, day);
+	}
+	printf("%s at: %s%s until: %s%s [%s] next: %s\n", schedule_name(&acts, j), start_time, start_seconds, end_time, end_seconds, rule, next_date);
+}
+printf("-----------------------------------------------------------------------------------------------\n");
+
+// Initialize mutexes to coordinate threads / protect global vars (before any thread can use them)
+if(timer_slack && prctl(PR_SET_TIMERSLACK, timer_slack) == -1){ // inherited by the threads created below
+	fprintf(stderr, "Can't set the timer slack: %s\n", strerror(errno));
+}
+pthread_mutex_init(&sched_mutex, NULL);
+pthread_condattr_t cond_attr; // the scheduler waits for absolute CLOCK_MONOTONIC deadlines
+pthread_condattr_init(&cond_attr);
+pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+pthread_cond_init(&sched_cond, &cond_attr);
+pthread_condattr_destroy(&cond_attr);
+
+// Statistics: SIGUSR1 / SIGUSR2 are blocked before creating any thread (they inherit the mask), so only the stats
+// thread receives them (the reactor takes SIGUSR1 with its signalfd instead)
+pthread_t thread_stats;
+sigset_t stats_signals_set;
+if(stats_enabled){
+	if(stats_open() != 0){
+		return 1;
+	}
+	if(!reactor_mode){
+		sigemptyset(&stats_signals_set);
+		sigaddset(&stats_signals_set, SIGUSR1);
+		sigaddset(&stats_signals_set, SIGUSR2);
+		pthread_sigmask(SIG_BLOCK, &stats_signals_set, NULL);
+		pthread_create(&thread_stats, NULL, stats_signals, &stats_signals_set);
+	}
+}
+
+// Prepare the output ring, the internal clock and the events, then start the output dispatcher and the scheduler
+// thread (or do everything in this thread with --reactor)
+output_init();
+fflush(stdout); // the schedule above has to be on the console before anything printed by the dispatcher
+clock_init();
+build_lookup();
+if(live_init(&live, &acts, &granny, lookup_table, editor_path != NULL) != 0){ // before the events (see live_init())
+	fprintf(stderr, "Not enough memory for the live schedule\n");
+	return 1;
+}
+build_events();
+if(reactor_mode){ // (the journal keeps its thread, so the disk never stalls the loop)
+	arg = reactor();
+	if(journal_path){
+		journal_close(&granny_journal);
+	}
+	if(history_path){
+		history_close(&granny_history);
+	}
+	report();
+	return arg;
+}
+pthread_t thread_output;
+pthread_create(&thread_output, NULL, dispatcher, NULL); // for printing outputs 3 seconds apart
+pthread_t thread_sched;
+pthread_create(&thread_sched, NULL, scheduler, NULL); // for activities starting / about to end / ending
+if(server_path && server_start(server_path) != 0){ // for questions from other processes
+	return 1;
+}
+if(editor_path){ // for changes of the schedule
+	if(journal_path){ // (granny's answers survive a restart, the schedule she answered about doesn't)
+		fprintf(stderr, "Edits aren't saved: a restarted agenda goes back to the schedule it was started with, and what's done with activities added or moved by edits isn't journaled\n");
+	}
+	editor_wakeup = eventfd(0, EFD_CLOEXEC);
+	pthread_create(&thread_editor, NULL, editor, (void *)editor_path);
+}
+
+while(1) {
+// Store information from the user (Granny) (note: assume she will input the time correctly, either for eg. 8:25 or 08:25)
+output("Please input some time: \n"); 
+
+if(scanf("%5s", hour_user) != 1){ // end of input: stop the agenda
+	break;
+}
+
+output_mark(); // so that granny can observe 3 seconds from her input
+atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed); // scanf() blocked until she typed it
+
+// PHASE 1 and PHASE 2 (see ask()), then her answer if the activity is undone
+j = ask(hour_user, &day);
+if(j >= 0){
+	if(scanf("%3s", answer) != 1){
+		break;
+	}
+
+	output_mark();
+	atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+	reply(j, day, answer);
+	strcpy(answer, ""); // reset string
+}
+}
+
+// Input was closed: stop the editor and the scheduler and report how late the notifications were
+if(editor_path){
+	eventfd_write(editor_wakeup, 1);
+	pthread_join(thread_editor, NULL);
+}
+sched_lock();
+scheduler_stop = true;
+pthread_cond_signal(&sched_cond);
+sched_unlock();
+pthread_join(thread_sched, NULL);
+atomic_store(&output_stop, true); // the dispatcher prints what's still queued and finishes
+sem_post(&output_ready);
+pthread_join(thread_output, NULL);
+if(server_path){
+	server_stop(server_path);
+}
+if(stats){
+	pthread_kill(thread_stats, SIGUSR2);
+	pthread_join(thread_stats, NULL);
+}
+if(journal_path){
+	journal_close(&granny_journal);
+}
+if(history_path){
+	history_close(&granny_history);
+}
+report();
+return 0;
+}
+
+// Function bodies ****************************************************************************************************
+int ask(char *hour_user, uint32_t *day) {
+// Granny asked what she should be doing at some time (or "now"): prints the activity and its state. Returns the
+// activity if it's undone (she's asked whether she's doing it, see reply()) and the day of its occurrence, -1 otherwise
+	int input_hour = -1; // for user input
+	int input_minute = -1; // for user input
+	int j = -1; // to save the value of the activity to print out on the console
+	bool flag = false; // flag used when searching for the right activity
+	char hour_in[3]; // to capture the user's hour input (substring)
+	char min_in[3]; // to capture the user's minute input (substring)
+	char start_time[6]; // HH:MM strings for printing
 	char end_time[6];
-	char name[101]; // max 100 characters + null; name of the activity
-	char state[7]; // store state, with extra position for the null char
-	int counted; // 0: not counted by thread1, 1: counted by thread1
-	int counted2; // 0 : not counted by thread2, 1: countd by thread2
-};
-
-// Create a global array to store all the activities, from earliest to latest 
-struct activity acts[8] = {
-{7,0,8,30,"07:00","08:30","Breakfast", "Undone",0,0}, 
-{9,0,11,40,"09:00","11:40","Play instrument", "Undone",0,0},
-{12,0,13,30,"12:00","13:30","Lunch", "Undone",0,0},
-{14,0,16,15,"14:00","16:15","Knitting", "Undone",0,0},
-{16,30,17,0,"16:30","17:00","Tea time", "Undone",0,0},
-{17,15,19,15,"17:15","19:15","Play cards","Undone",0,0},
-{19,30,21,0,"19:30","21:00","Dinner", "Undone",0,0},
-{21,10,6,45,"21:10","06:45","Read book and sleep", "Undone",0,0}};
+	long long local_ms; // to capture the local time
+	long long input_ns = stats ? bench_ns(CLOCK_MONOTONIC) : 0; // only measured with --stats
+
+	// Now extract useful information (substrings)
+	if( strcmp(hour_user, "now")  ) { // for strings with numbers
+		if((hour_user[0] == '0') || (hour_user[0]!='0' && hour_user[1] != ':')){ // for cases like 08:25 or 15:00
+			hour_in[0] = hour_user[0];
+			hour_in[1] = hour_user[1];
+			min_in[0] = hour_user[3];
+			min_in[1] = hour_user[4];
+				
+		}
+		else{ // if the first character is not '0', for example 8:25
+			hour_in[0] = '0';
+			hour_in[1] = hour_user[0];
+			min_in[0] = hour_user[2];
+			min_in[1] = hour_user[3];
+		}
+		strcpy(hour_user, "");
+		hour_in[2] = '\0';
+		min_in[2] = '\0';
+		input_hour = atoi(hour_in); // transforming to int to work with this info internally
+		input_minute = atoi(min_in);
+	}
+	else { // other possible input option: "now"
+		local_ms = wallclock_ms();
+		input_hour = local_ms / 3600000;
+		input_minute = local_ms / 60000 % 60;
+		output("Time captured, hour: %d and minute: %d\n", input_hour, input_minute);
+	}
+
+	// PHASE 1: Look up the activity that matches the input data (-1 if there's none)
+	if(input_hour >= 0 && input_hour < 24 && input_minute >= 0 && input_minute < 60){
+		j = agenda_lookup(&live, input_hour*60 + input_minute, internal_now(), day);
+		flag = (j >= 0);
+	}
+	if(stats){
+		histogram_add(&stats->lookup_ns, bench_ns(CLOCK_MONOTONIC) - input_ns);
+	}
+
+	// PHASE 2: After searching, print the right outputs and ensure latency between agenda printed outputs
+	if(flag == false){ // No activity found for the input data
+		output("No activity scheduled for this time.\n");
+		return -1;
+	}
+	format_time(start_time, acts.start[j]);
+	format_time(end_time, acts.end[j]);
+	output("Activity scheduled for this time: %s, with start time: %s and end time: %s\n", schedule_name(&acts, j), start_time, end_time);
+
+	// Check here if the activity is undone / done
+	if(schedule_state(&acts, j, *day, FLAG_DONE)){
+		output("Chill out! You already completed the activity: %s\n", schedule_name(&acts, j));
+		return -1;
+	}
+	// so if the result is 0 (meaning the activity is undone)
+	output("Are you doing the activity: %s (yes/no)?\n", schedule_name(&acts, j));
+	return j;
+}
+
+void reply(int j, uint32_t day, const char *answer) {
+	// The following printf is just to verify it worked (can be commented out) 
+	//printf("Answer received: %s\n", answer); // this is for checking only (should be removed)
+
+	if((strcmp(answer, "no"))){ //0 if both identical -> "if" activates if result is '1' (answer is yes)
+		acknowledge(j, day);
+	}
+	// This part below is also to check, it can be commented out
+	//printf("State of activity: %d and contents of string answer: %s\n", schedule_state(&acts, j, day, FLAG_DONE), answer);
+}
+
+bool acknowledge(int j, uint32_t day) {
+// Mark the occurrence as done. No need to remind her that the activity finishes in 10 minutes anymore, unless the
+// events in the wheel are already those of another occurrence
+	struct event *warning = &granny.events[j*3 + EVENT_WARNING];
+	if (!schedule_transition(&acts, j, day, FLAG_DONE)) {
+		return false;
+	}
+	if (acts.history) {
+		history_answer(acts.history, j, day, internal_now());
+	}
+	sched_lock();
+	if (warning->day == day) {
+		wheel_cancel(&agenda_wheel, warning);
+	}
+	sched_unlock();
+	return true;
+}
+
+void output_init(void) {
+	unsigned long k;
+	atomic_init(&output_tail, 0);
+	output_sunk = 0;
+	output_head = 0;
+	for (k = 0; k < OUTPUT_RING; k++) {
+		atomic_init(&output_ring[k].sequence, k);
+	}
+	atomic_init(&output_overflow_stack, NULL);
+	atomic_init(&output_overflowing, 0);
+	output_backlog = output_backlog_last = NULL;
+	sem_init(&output_ready, 0, 0);
+}
+
+struct output_slot *output_claim(void) {
+// Claim the slot at the tail of the ring with a compare-and-swap (retried only if another producer won the race)
+	unsigned long position = atomic_load_explicit(&output_tail, memory_order_relaxed);
+	struct output_slot *slot;
+	long diff;
+	while (1) {
+		slot = &output_ring[position & (OUTPUT_RING - 1)];
+		diff = (long)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&output_tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+				return slot;
+			}
+		}
+		else if (diff < 0) { // the dispatcher hasn't printed this slot yet: the ring is full
+			return NULL;
+		}
+		else { // another producer took it, try the new tail
+			position = atomic_load_explicit(&output_tail, memory_order_relaxed);
+		}
+	}
+}
+
+struct output_slot *output_reserve(struct output_overflow **node) {
+// The ring, unless it's full or messages are still waiting in the overflow (NULL: no memory for a node either)
+	struct output_slot *slot = NULL;
+	*node = NULL;
+	if (atomic_load_explicit(&output_overflowing, memory_order_acquire) == 0) {
+		slot = output_claim();
+	}
+	if (slot) {
+		return slot;
+	}
+	*node = malloc(sizeof(**node));
+	if (*node == NULL) {
+		return NULL;
+	}
+	atomic_fetch_add_explicit(&output_overflowing, 1, memory_order_acq_rel);
+	return &(*node)->slot;
+}
+
+void output_publish(struct output_slot *slot, struct output_overflow *node) {
+// A slot of the ring was claimed at position 'sequence', so sequence + 1 tells the dispatcher it's ready; a node is
+// pushed on the overflow stack
+	if (node) {
+		node->next = atomic_load_explicit(&output_overflow_stack, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak_explicit(&output_overflow_stack, &node->next, node, memory_order_release, memory_order_relaxed)) {
+		}
+		atomic_fetch_add_explicit(&output_overflowed, 1, memory_order_relaxed);
+		if (stats) {
+			atomic_fetch_add_explicit(&stats->output_overflowed, 1, memory_order_relaxed);
+		}
+	}
+	else {
+		atomic_store_explicit(&slot->sequence, atomic_load_explicit(&slot->sequence, memory_order_relaxed) + 1, memory_order_release);
+	}
+	sem_post(&output_ready);
+}
+
+void output_drop(void) {
+	if (atomic_fetch_add(&output_dropped, 1) == 0) {
+		fprintf(stderr, "Output: no memory left for the messages, they're being dropped\n");
+	}
+	if (stats) {
+		atomic_fetch_add_explicit(&stats->output_dropped, 1, memory_order_relaxed);
+	}
+}
+
+bool output(const char *format, ...) {
+// Format the message directly into a slot of the ring; the time spent here is the enqueue latency
+	long long start = bench_ns(CLOCK_MONOTONIC);
+	long long latency;
+	long long max;
+	struct output_overflow *node;
+	struct output_slot *slot;
+	va_list args;
+	if (output_discard) { // nobody reads the console (benchmark)
+		return true;
+	}
+	slot = output_reserve(&node);
+	if (slot == NULL) {
+		output_drop();
+		return false;
+	}
+	slot->mark_ns = 0;
+	slot->queued_ms = internal_now();
+	va_start(args, format);
+	vsnprintf(slot->text, OUTPUT_TEXT, format, args);
+	va_end(args);
+	output_publish(slot, node);
+
+	latency = bench_ns(CLOCK_MONOTONIC) - start;
+	atomic_fetch_add(&output_enqueued, 1);
+	atomic_fetch_add(&output_enqueue_total_ns, latency);
+	max = atomic_load(&output_enqueue_max_ns);
+	while (latency > max && !atomic_compare_exchange_weak(&output_enqueue_max_ns, &max, latency)) {
+	}
+	return true;
+}
+
+void output_mark(void) {
+// Goes through the ring too, so that it's ordered with the messages queued before it
+	struct output_overflow *node;
+	struct output_slot *slot = output_reserve(&node);
+	if (slot == NULL) {
+		output_drop();
+		return;
+	}
+	slot->mark_ns = bench_ns(CLOCK_MONOTONIC);
+	output_publish(slot, node);
+}
+
+void *dispatcher(){
+// Hand the queued messages to the sinks as soon as they're published and print them in order, each one at least 3
+// seconds after the previous output / input. The thread is always blocked (on the semaphore, with a timeout when a
+// message is waiting for its turn on the console) unless it's actually writing.
+	long long last = -OUTPUT_SPACING_NS; // last output or input (CLOCK_MONOTONIC), the first output isn't delayed
+	long long due = -1; // when the next message can be printed, -1: nothing waiting
+	struct timespec wake, linger = { 0, OUTPUT_LINGER_NS };
+
+	while (1) {
+		if (due == -1) {
+			while (sem_wait(&output_ready) == -1 && errno == EINTR) {
+			}
+		}
+		else {
+			wake.tv_sec = due / 1000000000LL;
+			wake.tv_nsec = due % 1000000000LL;
+			while (sem_clockwait(&output_ready, CLOCK_MONOTONIC, &wake) == -1 && errno == EINTR) {
+			}
+		}
+		atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+		if ((output_log_fd != -1 || output_socket_fd != -1) && !atomic_load(&output_stop)
+			&& atomic_load_explicit(&output_tail, memory_order_relaxed) - output_sunk < OUTPUT_BATCH) {
+			// Not a full batch yet: let the rest of a burst arrive (the producers don't wake this thread meanwhile)
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &linger, NULL);
+		}
+		output_sinks();
+		due = output_print(&last, due != -1);
+		if (due == -1 && atomic_load(&output_stop)) { // woken up by main and nothing left
+			break;
+		}
+	}
+	output_dispatcher_cpu_ns = bench_ns(CLOCK_THREAD_CPUTIME_ID);
+	return 0;
+}
+
+long long output_print(long long *last, bool paced) {
+// The console sink: prints the messages the other sinks already have while they're due and returns when the next
+// one is (-1: nothing queued), without waiting, for the dispatcher and the reactor. The slots are freed here, the
+// ring's first and then the overflow's (it only has messages that came after those in the ring).
+// paced: the previous call already asked to wait for the first message (it's only measured once).
+	struct output_overflow *node;
+	long long due;
+	while (output_head != output_sunk) {
+		if ((due = output_show(&output_ring[output_head & (OUTPUT_RING - 1)], last, &paced)) != -1) {
+			return due;
+		}
+		atomic_store_explicit(&output_ring[output_head & (OUTPUT_RING - 1)].sequence, output_head + OUTPUT_RING, memory_order_release); // free for producers
+		output_head++;
+	}
+	while ((node = output_backlog)) {
+		if ((due = output_show(&node->slot, last, &paced)) != -1) {
+			return due;
+		}
+		output_backlog = node->next;
+		if (output_backlog == NULL) {
+			output_backlog_last = NULL;
+		}
+		free(node);
+		atomic_fetch_sub_explicit(&output_overflowing, 1, memory_order_acq_rel);
+	}
+	return -1;
+}
+
+long long output_show(struct output_slot *slot, long long *last, bool *paced) {
+	long long now, due;
+	if (slot->mark_ns > 0) { // granny input something
+		if (slot->mark_ns > *last) {
+			*last = slot->mark_ns;
+		}
+	}
+	else if (output_console) {
+		now = bench_ns(CLOCK_MONOTONIC);
+		due = *last + OUTPUT_SPACING_NS;
+		if (now < due) {
+			if (stats && !*paced) {
+				histogram_add(&stats->output_pacing_ns, due - now);
+			}
+			return due;
+		}
+		if (stats && !*paced) {
+			histogram_add(&stats->output_pacing_ns, 0);
+		}
+		*paced = false;
+		fputs(slot->text, stdout);
+		fflush(stdout);
+		*last = bench_ns(CLOCK_MONOTONIC);
+	}
+	return -1;
+}
+
+int output_sinks_open(const char *log_path, const char *socket_path) {
+	if (log_path) {
+		output_log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (output_log_fd == -1) {
+			fprintf(stderr, "Can't open %s: %s\n", log_path, strerror(errno));
+			return -1;
+		}
+		output_log_path = log_path;
+		output_log_size = lseek(output_log_fd, 0, SEEK_END);
+	}
+	if (socket_path) {
+		if (strlen(socket_path) >= sizeof(output_socket_address.sun_path)) {
+			fprintf(stderr, "Socket path too long: %s\n", socket_path);
+			return -1;
+		}
+		output_socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (output_socket_fd == -1) {
+			fprintf(stderr, "socket: %s\n", strerror(errno));
+			return -1;
+		}
+		memset(&output_socket_address, 0, sizeof(output_socket_address));
+		output_socket_address.sun_family = AF_UNIX;
+		strcpy(output_socket_address.sun_path, socket_path);
+	}
+	return 0;
+}
+
+void output_sinks(void) {
+// Everything published since the last call, in batches: the ring's, then what's new in the overflow (taken from its
+// stack in one exchange and appended to the backlog in order). The slots stay until the console had them.
+	struct output_slot *batch[OUTPUT_BATCH];
+	struct output_slot *slot;
+	struct output_overflow *taken, *node, *first = NULL, *next;
+	int count;
+	bool more = true;
+
+	while (sem_trywait(&output_ready) == 0) { // the posts of everything that's handled below
+	}
+	while (more) {
+		count = 0;
+		while (count < OUTPUT_BATCH) {
+			slot = &output_ring[output_sunk & (OUTPUT_RING - 1)];
+			// A slot claimed but still being written stops the batch: its producer posts once it's published
+			if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != output_sunk + 1) {
+				more = false;
+				break;
+			}
+			output_sunk++;
+			batch[count++] = slot;
+		}
+		output_sinks_write(batch, count);
+	}
+
+	taken = atomic_exchange_explicit(&output_overflow_stack, NULL, memory_order_acquire);
+	for (node = taken; node; node = next) { // newest first: reversed
+		next = node->next;
+		node->next = first;
+		first = node;
+	}
+	if (first == NULL) {
+		return;
+	}
+	if (output_backlog_last) {
+		output_backlog_last->next = first;
+	}
+	else {
+		output_backlog = first;
+	}
+	for (count = 0, node = first; node; node = node->next) {
+		batch[count++] = &node->slot;
+		output_backlog_last = node;
+		if (count == OUTPUT_BATCH || node->next == NULL) {
+			output_sinks_write(batch, count);
+			count = 0;
+		}
+	}
+}
+
+void output_sinks_write(struct output_slot *batch[], int n) {
+// One writev() for the log file and one sendmmsg() for the socket (a datagram per message, writev() would make them
+// a single one); the iovecs point straight at the text of the slots
+	struct iovec iov[2 * OUTPUT_BATCH]; // "HH:MM:SS " then the message
+	struct mmsghdr datagrams[OUTPUT_BATCH];
+	char stamps[OUTPUT_BATCH][16];
+	long long seconds;
+	size_t bytes = 0;
+	int count = 0, sent, k;
+
+	if (output_log_fd == -1 && output_socket_fd == -1) {
+		return;
+	}
+	for (k = 0; k < n; k++) {
+		if (batch[k]->mark_ns > 0) {
+			continue;
+		}
+		seconds = batch[k]->queued_ms / 1000 % (24 * 60 * 60);
+		iov[2 * count].iov_base = stamps[count];
+		iov[2 * count].iov_len = snprintf(stamps[count], sizeof(stamps[count]), "%02lld:%02lld:%02lld ",
+			seconds / 3600, seconds / 60 % 60, seconds % 60);
+		iov[2 * count + 1].iov_base = batch[k]->text;
+		iov[2 * count + 1].iov_len = strlen(batch[k]->text);
+		bytes += iov[2 * count].iov_len + iov[2 * count + 1].iov_len;
+		count++;
+	}
+	if (count == 0) {
+		return;
+	}
+	if (output_socket_fd != -1) { // before the log: writev() may move the iovecs along
+		memset(datagrams, 0, count * sizeof(datagrams[0]));
+		for (k = 0; k < count; k++) {
+			datagrams[k].msg_hdr.msg_name = &output_socket_address;
+			datagrams[k].msg_hdr.msg_namelen = sizeof(output_socket_address);
+			datagrams[k].msg_hdr.msg_iov = &iov[2 * k];
+			datagrams[k].msg_hdr.msg_iovlen = 2;
+		}
+		for (k = 0; k < count; k += sent) { // nobody reading (or not fast enough): the rest is lost
+			output_socket_calls++;
+			sent = sendmmsg(output_socket_fd, &datagrams[k], count - k, MSG_DONTWAIT);
+			if (sent <= 0) {
+				output_socket_lost += count - k;
+				break;
+			}
+			output_socket_messages += sent;
+		}
+	}
+	if (output_log_fd != -1 && output_log_write(iov, 2 * count, bytes)) {
+		output_log_messages += count;
+	}
+	else if (output_log_path) {
+		output_log_lost += count;
+	}
+}
+
+bool output_log_write(struct iovec *iov, int count, size_t bytes) {
+// The whole batch goes into the same file: it's rotated first if the batch would make it too big
+	ssize_t written;
+	if (output_log_size > 0 && output_log_size + (long long)bytes > OUTPUT_LOG_MAX) {
+		output_log_rotate();
+		if (output_log_fd == -1) {
+			return false;
+		}
+	}
+	output_log_size += bytes;
+	while (count > 0) {
+		output_log_writes++;
+		written = writev(output_log_fd, iov, count); // 2 * OUTPUT_BATCH is well under IOV_MAX
+		if (written == -1 && errno == EINTR) {
+			continue;
+		}
+		if (written == -1) {
+			fprintf(stderr, "Can't write %s: %s\n", output_log_path, strerror(errno));
+			return false;
+		}
+		while (count > 0 && (size_t)written >= iov->iov_len) { // partial write: skip what's done
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+void output_log_rotate(void) {
+	char from[PATH_MAX], to[PATH_MAX];
+	int k;
+	close(output_log_fd);
+	for (k = OUTPUT_LOG_KEEP - 1; k >= 1; k--) { // the oldest one is overwritten
+		snprintf(from, sizeof(from), "%s.%d", output_log_path, k);
+		snprintf(to, sizeof(to), "%s.%d", output_log_path, k + 1);
+		rename(from, to);
+	}
+	snprintf(to, sizeof(to), "%s.1", output_log_path);
+	rename(output_log_path, to);
+	output_log_fd = open(output_log_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if (output_log_fd == -1) {
+		fprintf(stderr, "Can't open %s: %s\n", output_log_path, strerror(errno));
+	}
+	output_log_size = 0;
+	output_log_rotations++;
+}
+
+long long wallclock(uint32_t *day) {
+	struct timespec now;
+	struct tm local;
+	time_t seconds;
+	long long now_ms, start, minute_start;
+	int minute_of_day;
+	uint32_t today;
+	unsigned seq;
+
+	clock_gettime(CLOCK_REALTIME_COARSE, &now);
+	now_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+	do {
+		seq = atomic_load_explicit(&wall_seq, memory_order_acquire);
+		start = atomic_load_explicit(&wall_minute_start, memory_order_relaxed);
+		minute_of_day = atomic_load_explicit(&wall_minute_of_day, memory_order_relaxed);
+		today = atomic_load_explicit(&wall_day, memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) || atomic_load_explicit(&wall_seq, memory_order_relaxed) != seq);
+	if (minute_of_day >= 0 && now_ms >= start && now_ms - start < 60000) { // the usual case
+		*day = today;
+		return minute_of_day * 60000LL + (now_ms - start);
+	}
+
+	// A new minute (or the first call): convert it and publish it, unless another thread is already doing it
+	seconds = now.tv_sec;
+	tzset();
+	localtime_r(&seconds, &local);
+	minute_of_day = local.tm_hour*60 + local.tm_min;
+	minute_start = now_ms - (local.tm_sec*1000LL + now_ms % 1000);
+	today = (uint32_t)((seconds + local.tm_gmtoff) / 86400);
+	if (atomic_compare_exchange_strong(&wall_seq, &seq, seq + 1)) {
+		atomic_thread_fence(memory_order_release);
+		atomic_store_explicit(&wall_minute_start, minute_start, memory_order_relaxed);
+		atomic_store_explicit(&wall_minute_of_day, minute_of_day, memory_order_relaxed);
+		atomic_store_explicit(&wall_day, today, memory_order_relaxed);
+		atomic_store_explicit(&wall_seq, seq + 2, memory_order_release);
+	}
+	*day = today;
+	return minute_of_day * 60000LL + (now_ms - minute_start);
+}
+
+long long wallclock_ms(void) {
+	uint32_t day;
+	return wallclock(&day);
+}
+
+uint32_t local_day(void) {
+	uint32_t day;
+	wallclock(&day);
+	return day;
+}
+
+void clock_init(void) {
+// Capture the real local time together with a monotonic timestamp: this is the origin of the internal clock (the
+// time of day and the day from the same conversion, so starting at midnight can't pair today's time with yesterday)
+	internal_origin = wallclock(&internal_first_day);
+	clock_gettime(CLOCK_MONOTONIC, &clock_origin);
+}
+
+long long internal_now(void) {
+// Internal time = internal origin + real time elapsed since the origin, accelerated by the speed factor
+// (128 bits since years at x10000 in ns don't fit in 64 bits)
+	struct timespec now;
+	long long elapsed_ns;
+	if (speed_max) {
+		return internal_origin + atomic_load(&clock_jumps);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_ns = (now.tv_sec - clock_origin.tv_sec) * 1000000000LL + (now.tv_nsec - clock_origin.tv_nsec);
+	return internal_origin + (long long)((__int128)elapsed_ns * speed_num / speed_den / 1000000);
+}
+
+struct timespec internal_to_monotonic(long long internal_ms) {
+// Inverse of internal_now(): the monotonic time at which the internal clock reaches internal_ms (rounded up, so
+// that internal_now() has reached it when waking up at that time). Meaningless when running as fast as possible.
+	struct timespec result;
+	__int128 scaled = (__int128)(internal_ms - internal_origin) * 1000000 * speed_den;
+	long long offset_ns = (long long)(scaled >= 0 ? (scaled + speed_num - 1) / speed_num : scaled / speed_num);
+	long long ns = clock_origin.tv_nsec + offset_ns;
+	result.tv_sec = clock_origin.tv_sec + ns / 1000000000LL;
+	result.tv_nsec = ns % 1000000000LL;
+	if (result.tv_nsec < 0) { // deadlines in the past
+		result.tv_nsec += 1000000000LL;
+		result.tv_sec--;
+	}
+	return result;
+}
+
+void clock_jump(long long internal_ms) {
+// Only when running as fast as possible: move the internal clock forward to internal_ms
+	long long jumps = internal_ms - internal_origin;
+	if (jumps > atomic_load(&clock_jumps)) {
+		atomic_store(&clock_jumps, jumps);
+	}
+}
+
+bool parse_speed(const char *text) {
+// Speed factor from the command line: "max", an integer ("10") or a fraction ("3/2")
+	long long num, den = 1;
+	char *end;
+	if (!strcmp(text, "max")) {
+		speed_max = true;
+		return true;
+	}
+	num = strtoll(text, &end, 10);
+	if (*end == '/') {
+		den = strtoll(end + 1, &end, 10);
+	}
+	if (*end != '\0' || num <= 0 || den <= 0 || num > 1000000000 || den > 1000000000) {
+		return false;
+	}
+	speed_num = num;
+	speed_den = den;
+	return true;
+}
+
+void schedule_init(struct schedule *sch) {
+	memset(sch, 0, sizeof(*sch));
+}
+
+void schedule_free(struct schedule *sch) {
+	if (sch->compiled) { // (only the states aren't in .rodata)
+		free(sch->state);
+		schedule_init(sch);
+		return;
+	}
+	if (sch->reserved) {
+		munmap(sch->start, sch->capacity * sizeof(*sch->start));
+		munmap(sch->end, sch->capacity * sizeof(*sch->end));
+		if (sch->start_ms) {
+			munmap(sch->start_ms, sch->capacity * sizeof(*sch->start_ms));
+			munmap(sch->end_ms, sch->capacity * sizeof(*sch->end_ms));
+		}
+		munmap(sch->name, sch->capacity * sizeof(*sch->name));
+		munmap(sch->rule, sch->capacity * sizeof(*sch->rule));
+		munmap(sch->state, sch->capacity * sizeof(*sch->state));
+		munmap(sch->names, sch->names_capacity);
+	}
+	else {
+		free(sch->start);
+		free(sch->end);
+		free(sch->start_ms);
+		free(sch->end_ms);
+		free(sch->name);
+		free(sch->rule);
+		free(sch->state);
+		free(sch->names);
+	}
+	free(sch->intern);
+	free(sch->rules);
+	free(sch->dates);
+	schedule_init(sch);
+}
+
+void *schedule_map(size_t bytes, const void *used, size_t used_bytes) {
+// Anonymous mapping of some maximum size with what's used so far copied in (MAP_FAILED if it can't be mapped)
+	void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (map != MAP_FAILED && used_bytes) {
+		memcpy(map, used, used_bytes);
+	}
+	return map;
+}
+
+bool schedule_reserve(struct schedule *sch, int capacity, size_t names_capacity) {
+// Move the arrays to mappings of their maximum size (only the pages touched take memory), so that activities can be
+// appended while other threads read the ones before them: nothing is ever reallocated again. Only once, before
+// anything else uses the schedule.
+	void *start, *end, *name, *rule, *state, *names, *start_ms = NULL, *end_ms = NULL;
+	struct intern_entry *intern = sch->intern;
+	struct rule *rules = sch->rules;
+	uint32_t *dates = sch->dates;
+	if (sch->compiled) { // what's still appended to outside the arrays below moves out of .rodata too
+		intern = malloc(sch->intern_capacity * sizeof(*intern));
+		rules = malloc((sch->rules_count + 1) * sizeof(*rules));
+		dates = malloc((sch->dates_count + 1) * sizeof(*dates));
+		if (intern == NULL || rules == NULL || dates == NULL) {
+			return false;
+		}
+		memcpy(intern, sch->intern, sch->intern_capacity * sizeof(*intern));
+		memcpy(rules, sch->rules, sch->rules_count * sizeof(*rules));
+		memcpy(dates, sch->dates, sch->dates_count * sizeof(*dates));
+		sch->rules_capacity = sch->rules_count + 1;
+		sch->dates_capacity = sch->dates_count + 1;
+	}
+	start = schedule_map(capacity * sizeof(*sch->start), sch->start, sch->count * sizeof(*sch->start));
+	end = schedule_map(capacity * sizeof(*sch->end), sch->end, sch->count * sizeof(*sch->end));
+	name = schedule_map(capacity * sizeof(*sch->name), sch->name, sch->count * sizeof(*sch->name));
+	rule = schedule_map(capacity * sizeof(*sch->rule), sch->rule, sch->count * sizeof(*sch->rule));
+	state = schedule_map(capacity * sizeof(*sch->state), sch->state, sch->count * sizeof(*sch->state));
+	names = schedule_map(names_capacity, sch->names, sch->names_size);
+	if (sch->start_ms) {
+		start_ms = schedule_map(capacity * sizeof(*sch->start_ms), sch->start_ms, sch->count * sizeof(*sch->start_ms));
+		end_ms = schedule_map(capacity * sizeof(*sch->end_ms), sch->end_ms, sch->count * sizeof(*sch->end_ms));
+	}
+	if (start == MAP_FAILED || end == MAP_FAILED || name == MAP_FAILED || rule == MAP_FAILED || state == MAP_FAILED ||
+	    names == MAP_FAILED || start_ms == MAP_FAILED || end_ms == MAP_FAILED) { // (the process is about to give up, the mappings that worked aren't worth unmapping)
+		return false;
+	}
+	if (!sch->compiled) {
+		free(sch->start);
+		free(sch->end);
+		free(sch->start_ms);
+		free(sch->end_ms);
+		free(sch->name);
+		free(sch->rule);
+		free(sch->names);
+	}
+	free(sch->state);
+	sch->intern = intern;
+	sch->rules = rules;
+	sch->dates = dates;
+	sch->compiled = false;
+	sch->start = start;
+	sch->end = end;
+	sch->start_ms = start_ms;
+	sch->end_ms = end_ms;
+	sch->name = name;
+	sch->rule = rule;
+	sch->state = state;
+	sch->names = names;
+	sch->capacity = capacity;
+	sch->names_capacity = names_capacity;
+	sch->reserved = true;
+	return true;
+}
+
+uint32_t schedule_hash(const char *name, size_t length) {
+// FNV-1a
+	uint32_t hash = 2166136261u;
+	size_t k;
+	for (k = 0; k < length; k++) {
+		hash = (hash ^ (unsigned char)name[k]) * 16777619u;
+	}
+	return hash;
+}
+
+bool schedule_intern_grow(struct schedule *sch) {
+// Double the hash table (kept at most half full) and insert the offsets again
+	uint32_t capacity = sch->intern_capacity ? sch->intern_capacity * 2 : 16;
+	struct intern_entry *table = calloc(capacity, sizeof(*table));
+	uint32_t k, index;
+	if (table == NULL) {
+		return false;
+	}
+	for (k = 0; k < sch->intern_capacity; k++) {
+		if (sch->intern[k].offset) {
+			index = sch->intern[k].hash & (capacity - 1);
+			while (table[index].offset) {
+				index = (index + 1) & (capacity - 1);
+			}
+			table[index] = sch->intern[k];
+		}
+	}
+	free(sch->intern);
+	sch->intern = table;
+	sch->intern_capacity = capacity;
+	return true;
+}
+
+int64_t schedule_intern(struct schedule *sch, const char *name, size_t length, uint32_t hash) {
+// Offset of the name (whose hash is given) in the arena, adding it if it's not there yet (-1 if there's no memory)
+	uint32_t index;
+	const char *stored;
+	char *bigger;
+	size_t capacity;
+	if (2 * (sch->intern_count + 1) > sch->intern_capacity && !schedule_intern_grow(sch)) {
+		return -1;
+	}
+	index = hash & (sch->intern_capacity - 1);
+	while (sch->intern[index].offset) {
+		stored = sch->names + sch->intern[index].offset - 1;
+		if (sch->intern[index].hash == hash && !memcmp(stored, name, length) && stored[length] == '\0') {
+			return sch->intern[index].offset - 1;
+		}
+		index = (index + 1) & (sch->intern_capacity - 1);
+	}
+	if (sch->names_size + length + 1 > sch->names_capacity) {
+		capacity = sch->names_capacity ? sch->names_capacity : 256;
+		while (sch->names_size + length + 1 > capacity) {
+			capacity *= 2;
+		}
+		if (capacity > UINT32_MAX || (bigger = realloc(sch->names, capacity)) == NULL) {
+			return -1;
+		}
+		sch->names = bigger;
+		sch->names_capacity = capacity;
+	}
+	memcpy(sch->names + sch->names_size, name, length);
+	sch->names[sch->names_size + length] = '\0';
+	sch->intern[index].offset = sch->names_size + 1;
+	sch->intern[index].hash = hash;
+	sch->intern_count++;
+	sch->names_size += length + 1;
+	return sch->intern[index].offset - 1;
+}
+
+bool schedule_add(struct schedule *sch, int start, int end, const char *name, size_t length, uint32_t hash) {
+// Append one undone activity (times as minutes of the day, hash of the name given by the caller, see
+// schedule_hash()); false if there's no memory left
+	int capacity;
+	int64_t offset;
+	void *start_array, *end_array, *name_array, *rule_array, *state_array;
+	if (sch->count == sch->capacity) { // arrays grow by doubling
+		capacity = sch->capacity ? sch->capacity * 2 : 64; // small: the engine keeps thousands of schedules
+		start_array = realloc(sch->start, capacity * sizeof(*sch->start));
+		if (start_array) sch->start = start_array;
+		end_array = realloc(sch->end, capacity * sizeof(*sch->end));
+		if (end_array) sch->end = end_array;
+		name_array = realloc(sch->name, capacity * sizeof(*sch->name));
+		if (name_array) sch->name = name_array;
+		rule_array = realloc(sch->rule, capacity * sizeof(*sch->rule));
+		if (rule_array) sch->rule = rule_array;
+		state_array = realloc(sch->state, capacity * sizeof(*sch->state));
+		if (state_array) sch->state = state_array;
+		if (!start_array || !end_array || !name_array || !rule_array || !state_array) {
+			return false;
+		}
+		if (sch->start_ms) {
+			start_array = realloc(sch->start_ms, capacity * sizeof(*sch->start_ms));
+			if (start_array) sch->start_ms = start_array;
+			end_array = realloc(sch->end_ms, capacity * sizeof(*sch->end_ms));
+			if (end_array) sch->end_ms = end_array;
+			if (!start_array || !end_array) {
+				return false;
+			}
+		}
+		sch->capacity = capacity;
+	}
+	offset = schedule_intern(sch, name, length, hash);
+	if (offset < 0) {
+		return false;
+	}
+	sch->start[sch->count] = start;
+	sch->end[sch->count] = end;
+	sch->name[sch->count] = offset;
+	sch->rule[sch->count] = 0; // every day, see schedule_rule()
+	if (sch->start_ms) { // whole minutes, see schedule_precise()
+		sch->start_ms[sch->count] = 0;
+		sch->end_ms[sch->count] = 0;
+	}
+	atomic_init(&sch->state[sch->count], 0);
+	sch->count++;
+	return true;
+}
+
+bool schedule_precise(struct schedule *sch) {
+// The first activity timed past the minute: every one so far is at 0 ms
+	if (sch->start_ms) {
+		return true;
+	}
+	if (sch->reserved) {
+		sch->start_ms = schedule_map(sch->capacity * sizeof(*sch->start_ms), NULL, 0);
+		sch->end_ms = schedule_map(sch->capacity * sizeof(*sch->end_ms), NULL, 0);
+		if (sch->start_ms == MAP_FAILED || sch->end_ms == MAP_FAILED) {
+			sch->start_ms = sch->end_ms = NULL;
+			return false;
+		}
+		return true;
+	}
+	sch->start_ms = calloc(sch->capacity ? sch->capacity : 1, sizeof(*sch->start_ms));
+	sch->end_ms = calloc(sch->capacity ? sch->capacity : 1, sizeof(*sch->end_ms));
+	if (sch->start_ms == NULL || sch->end_ms == NULL) {
+		free(sch->start_ms);
+		free(sch->end_ms);
+		sch->start_ms = sch->end_ms = NULL;
+		return false;
+	}
+	return true;
+}
+
+int schedule_start_ms(const struct schedule *sch, int i) {
+	return sch->start_ms ? sch->start_ms[i] : 0;
+}
+
+int schedule_end_ms(const struct schedule *sch, int i) {
+	return sch->end_ms ? sch->end_ms[i] : 0;
+}
+
+bool schedule_load_default(struct schedule *sch) {
+	int i;
+	schedule_init(sch);
+	for (i = 0; i < (int)(sizeof(default_acts) / sizeof(default_acts[0])); i++) {
+		if (!schedule_add(sch, default_acts[i].start_hour*60 + default_acts[i].start_minute,
+		    default_acts[i].end_hour*60 + default_acts[i].end_minute, default_acts[i].name, strlen(default_acts[i].name),
+		    schedule_hash(default_acts[i].name, strlen(default_acts[i].name)))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool schedule_load_compiled(struct schedule *sch) {
+// Points the schedule at the arrays of the compiled header; they're never written while sch->compiled is set
+#ifdef GRANNY_SCHEDULE
+	schedule_init(sch);
+	sch->state = calloc(COMPILED_COUNT, sizeof(*sch->state));
+	if (sch->state == NULL) {
+		return false;
+	}
+	sch->count = sch->capacity = COMPILED_COUNT;
+	sch->start = (uint16_t *)compiled_start;
+	sch->end = (uint16_t *)compiled_end;
+	sch->name = (uint32_t *)compiled_name;
+	sch->rule = (uint16_t *)compiled_rule;
+	sch->names = (char *)compiled_names;
+	sch->names_size = sch->names_capacity = COMPILED_NAMES_SIZE;
+	sch->intern = (struct intern_entry *)compiled_intern;
+	sch->intern_capacity = COMPILED_INTERN_CAPACITY;
+	sch->intern_count = COMPILED_INTERN_COUNT;
+	sch->rules = COMPILED_RULES ? (struct rule *)compiled_rules : NULL;
+	sch->rules_count = sch->rules_capacity = COMPILED_RULES;
+	sch->dates = COMPILED_DATES ? (uint32_t *)compiled_dates : NULL;
+	sch->dates_count = sch->dates_capacity = COMPILED_DATES;
+	if (COMPILED_PRECISE) {
+		sch->start_ms = (uint16_t *)compiled_start_ms;
+		sch->end_ms = (uint16_t *)compiled_end_ms;
+	}
+	sch->compiled = true;
+	return true;
+#else
+	(void)sch;
+	return false;
+#endif
+}
+
+int schedule_compile(const char *path, const char *source) {
+// The schedule in use as a header for -DGRANNY_SCHEDULE (see the compiled schedule section)
+	char absolute[PATH_MAX];
+	size_t offset, length;
+	uint32_t k;
+	int minute;
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+#ifdef GRANNY_SCHEDULE
+	if (acts.compiled) { // compiled again
+		source = COMPILED_SOURCE;
+	}
+#endif
+	if (source && realpath(source, absolute)) { // --bench-startup parses it again from anywhere
+		source = absolute;
+	}
+	build_lookup();
+	fprintf(file, "// Generated by granny --compile from %s: %d activities, see the compiled schedule section of granny.c\n",
+		source ? source : "the predesigned schedule", acts.count);
+	fprintf(file, "#define COMPILED_SOURCE ");
+	if (source) {
+		compile_string(file, source, strlen(source));
+		fprintf(file, " // parsed by --bench-startup to compare\n");
+	}
+	else {
+		fprintf(file, "NULL // the predesigned schedule\n");
+	}
+	fprintf(file, "#define COMPILED_COUNT %d\n#define COMPILED_NAMES_SIZE %zu\n#define COMPILED_INTERN_CAPACITY %u\n"
+		"#define COMPILED_INTERN_COUNT %u\n#define COMPILED_RULES %d\n#define COMPILED_DATES %u\n#define COMPILED_PRECISE %d\n\n",
+		acts.count, acts.names_size, acts.intern_capacity, acts.intern_count, acts.rules_count, acts.dates_count,
+		acts.start_ms != NULL);
+	compile_values(file, "uint16_t", "compiled_start", acts.start, acts.count);
+	compile_values(file, "uint16_t", "compiled_end", acts.end, acts.count);
+	compile_values(file, "uint16_t", "compiled_start_ms", acts.start_ms, acts.start_ms ? acts.count : 0);
+	compile_values(file, "uint16_t", "compiled_end_ms", acts.end_ms, acts.end_ms ? acts.count : 0);
+	compile_values(file, "uint32_t", "compiled_name", acts.name, acts.count);
+	compile_values(file, "uint16_t", "compiled_rule", acts.rule, acts.count);
+	compile_values(file, "uint32_t", "compiled_dates", acts.dates, acts.dates_count);
+
+	fprintf(file, "static const char compiled_names[COMPILED_NAMES_SIZE + 1] =");
+	for (offset = 0; offset < acts.names_size; offset += length + 1) {
+		length = strlen(acts.names + offset);
+		fprintf(file, "\n\t");
+		compile_string(file, acts.names + offset, length + 1);
+	}
+	fprintf(file, "%s;\n\n", acts.names_size ? "" : " \"\"");
+
+	fprintf(file, "static const struct intern_entry compiled_intern[%u] = {", acts.intern_capacity ? acts.intern_capacity : 1);
+	for (k = 0; k < acts.intern_capacity; k++) {
+		fprintf(file, "%s{%u, %uu},", k % (COMPILED_PER_LINE / 2) ? " " : "\n\t", acts.intern[k].offset, acts.intern[k].hash);
+	}
+	fprintf(file, acts.intern_capacity ? "\n};\n\n" : " {0, 0u} };\n\n");
+
+	fprintf(file, "static const struct rule compiled_rules[%d] = {", acts.rules_count ? acts.rules_count : 1);
+	for (k = 0; k < (uint32_t)acts.rules_count; k++) {
+		fprintf(file, "\n\t{%u, %u, %u, %u, %u},", acts.rules[k].kind, acts.rules[k].weekdays, acts.rules[k].every,
+			acts.rules[k].first, acts.rules[k].count);
+	}
+	fprintf(file, acts.rules_count ? "\n};\n\n" : " {0, 0, 0, 0, 0} };\n\n");
+
+	fprintf(file, "static const int compiled_lookup[24*60] = {");
+	for (minute = 0; minute < 24*60; minute++) {
+		fprintf(file, "%s%d,", minute % COMPILED_PER_LINE ? " " : "\n\t", lookup_table[minute]);
+	}
+	fprintf(file, "\n};\n");
+	if (ferror(file) | fclose(file)) {
+		fprintf(stderr, "Can't write %s\n", path);
+		return 1;
+	}
+	printf("%d activities compiled into %s, build the agenda with -DGRANNY_SCHEDULE='\"%s\"' to use them\n", acts.count, path, path);
+	return 0;
+}
+
+void compile_values(FILE *file, const char *type, const char *name, const void *values, size_t count) {
+// One const array of uint16_t or uint32_t (at least one element, C has no empty arrays)
+	size_t k;
+	bool wide = !strcmp(type, "uint32_t");
+	fprintf(file, "static const %s %s[%zu] = {", type, name, count ? count : 1);
+	for (k = 0; k < count; k++) {
+		fprintf(file, "%s%u,", k % COMPILED_PER_LINE ? " " : "\n\t", wide ? ((const uint32_t *)values)[k] : ((const uint16_t *)values)[k]);
+	}
+	fprintf(file, count ? "\n};\n\n" : " 0 };\n\n");
+}
+
+void compile_string(FILE *file, const char *text, size_t length) {
+// Quotes, backslashes and anything that isn't printable ASCII (the null chars between names) as octal escapes
+	size_t k;
+	unsigned char c;
+	fputc('"', file);
+	for (k = 0; k < length; k++) {
+		c = text[k];
+		if (c < ' ' || c > '~' || c == '"' || c == '\\' || c == '?') { // (? so no trigraph can appear)
+			fprintf(file, "\\%03o", c);
+		}
+		else {
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+const char *schedule_name(const struct schedule *sch, int i) {
+	return sch->names + sch->name[i];
+}
+
+bool schedule_state(const struct schedule *sch, int i, uint32_t day, enum activity_flag flag) {
+// The flags of another occurrence than the one of day don't count
+	uint32_t word = atomic_load_explicit(&sch->state[i], memory_order_acquire);
+	return (word >> STATE_FLAGS) == day && ((word >> flag) & 1);
+}
+
+bool schedule_transition(struct schedule *sch, int i, uint32_t day, enum activity_flag flag) {
+// One compare-and-swap: true if this call set the flag of that occurrence (then it's journaled, only once), false if
+// it was already set or the activity is already in a later occurrence. An earlier occurrence is simply replaced.
+	uint32_t word = atomic_load_explicit(&sch->state[i], memory_order_relaxed);
+	uint32_t next;
+	do {
+		if ((word >> STATE_FLAGS) > day || ((word >> STATE_FLAGS) == day && ((word >> flag) & 1))) {
+			return false;
+		}
+		next = ((word >> STATE_FLAGS) == day ? word : day << STATE_FLAGS) | 1u << flag;
+	} while (!atomic_compare_exchange_weak_explicit(&sch->state[i], &word, next, memory_order_acq_rel, memory_order_relaxed));
+	if (sch->journal && i < sch->journal->count) {
+		journal_append(sch->journal, i, day, flag);
+	}
+	return true;
+}
+
+void schedule_reset(struct schedule *sch) {
+// Every state back to nothing (benchmarks running the same day again), when no other thread is using them
+	memset(sch->state, 0, sch->count * sizeof(*sch->state));
+}
+
+uint32_t schedule_occurrence(const struct schedule *sch, int i, long long now) {
+// The occurrence of activity i a question is about, at internal time now: today's, except for a
+// night activity while last night's one isn't over (its states hold a single occurrence, the one going on is kept)
+	uint32_t day = internal_first_day + now / 86400000;
+	int now_minute = now / 60000 % (24*60);
+	if (sch->end[i] < sch->start[i] && now_minute <= sch->end[i] && day > 0) {
+		day--;
+	}
+	return day;
+}
+
+int schedule_rule(struct schedule *sch, const struct rule *rule, const uint32_t *dates) {
+// Index of the rule in sch->rules, added if no activity uses it yet (rules are few, a linear search is enough);
+// the days of a RULE_DATES rule are given in dates (sorted). -1 if there's no memory or already 65536 rules
+	struct rule *bigger_rules;
+	uint32_t *bigger_dates;
+	uint32_t capacity;
+	int r;
+	if (rule->kind == RULE_DAILY) {
+		return 0;
+	}
+	for (r = 1; r < sch->rules_count; r++) {
+		if (sch->rules[r].kind == rule->kind && sch->rules[r].weekdays == rule->weekdays && sch->rules[r].every == rule->every &&
+		    (rule->kind == RULE_DATES ? sch->rules[r].count == rule->count &&
+		    !memcmp(sch->dates + sch->rules[r].first, dates, rule->count * sizeof(*dates)) : sch->rules[r].first == rule->first)) {
+			return r;
+		}
+	}
+	if (sch->rules_count == 65536) {
+		return -1;
+	}
+	if (sch->rules_count + 1 >= sch->rules_capacity) {
+		capacity = sch->rules_capacity ? sch->rules_capacity * 2 : 8;
+		bigger_rules = realloc(sch->rules, capacity * sizeof(*bigger_rules));
+		if (bigger_rules == NULL) {
+			return -1;
+		}
+		sch->rules = bigger_rules;
+		sch->rules_capacity = capacity;
+	}
+	if (rule->kind == RULE_DATES && sch->dates_count + rule->count > sch->dates_capacity) {
+		capacity = sch->dates_capacity ? sch->dates_capacity : 64;
+		while (sch->dates_count + rule->count > capacity) {
+			capacity *= 2;
+		}
+		bigger_dates = realloc(sch->dates, capacity * sizeof(*bigger_dates));
+		if (bigger_dates == NULL) {
+			return -1;
+		}
+		sch->dates = bigger_dates;
+		sch->dates_capacity = capacity;
+	}
+	if (sch->rules_count == 0) {
+		sch->rules[sch->rules_count++] = (struct rule){ .kind = RULE_DAILY };
+	}
+	sch->rules[sch->rules_count] = *rule;
+	if (rule->kind == RULE_DATES) {
+		sch->rules[sch->rules_count].first = sch->dates_count;
+		memcpy(sch->dates + sch->dates_count, dates, rule->count * sizeof(*dates));
+		sch->dates_count += rule->count;
+	}
+	return sch->rules_count++;
+}
+
+bool rule_matches(const struct schedule *sch, int r, uint32_t day) {
+	return rule_next(sch, r, day) == day;
+}
+
+bool rule_meets(const struct schedule *sch, int a, int b, int shift, uint32_t from) {
+// Some day d from from on has an occurrence of rule a and one of rule b on d + shift (-1 to 1, for the pieces of
+// night activities), looking RULE_MEET_DAYS ahead: each step goes to the next occurrence of one of them
+	uint32_t day = from, next_a, next_b;
+	if ((a == 0 && b == 0) || (a == b && shift == 0)) {
+		return true;
+	}
+	while (day < from + RULE_MEET_DAYS) {
+		next_a = rule_next(sch, a, day);
+		if (next_a == UINT32_MAX) {
+			return false;
+		}
+		next_b = rule_next(sch, b, next_a + shift);
+		if (next_b == UINT32_MAX) {
+			return false;
+		}
+		if (next_b == next_a + shift) {
+			return true;
+		}
+		day = next_b - shift;
+	}
+	return false;
+}
+
+uint32_t rule_next(const struct schedule *sch, int r, uint32_t day) {
+// Computed from the rule alone, nothing is expanded: the days of the week are 7 bits, every N days a division and the
+// dates a binary search
+	const struct rule *rule;
+	const uint32_t *dates;
+	uint32_t low, high, middle;
+	int k;
+	if (r == 0) {
+		return day;
+	}
+	rule = &sch->rules[r];
+	switch (rule->kind) {
+	case RULE_WEEKDAYS:
+		for (k = 0; k < 7; k++) {
+			if ((rule->weekdays >> (day + k + 4) % 7) & 1) { // 1970-01-01 was a thursday
+				return day + k;
+			}
+		}
+		return UINT32_MAX;
+	case RULE_EVERY:
+		if (day <= rule->first) {
+			return rule->first;
+		}
+		return rule->first + (day - rule->first + rule->every - 1) / rule->every * rule->every;
+	case RULE_DATES:
+		dates = sch->dates + rule->first;
+		low = 0;
+		high = rule->count;
+		while (low < high) {
+			middle = (low + high) / 2;
+			if (dates[middle] < day) {
+				low = middle + 1;
+			}
+			else {
+				high = middle;
+			}
+		}
+		return low < rule->count ? dates[low] : UINT32_MAX;
+	default:
+		return day;
+	}
+}
+
+bool parse_time(const char **text, const char *end, int *minute_of_day) {
+// Read H:MM or HH:MM at *text and move *text after it
+	const char *p = *text;
+	int h = 0, m = 0, digits = 0;
+	while (p < end && *p >= '0' && *p <= '9' && digits < 2) {
+		h = h*10 + (*p++ - '0');
+		digits++;
+	}
+	if (digits == 0 || p >= end || *p++ != ':') {
+		return false;
+	}
+	if (end - p < 2 || p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9') {
+		return false;
+	}
+	m = (p[0] - '0')*10 + (p[1] - '0');
+	if (h > 23 || m > 59) {
+		return false;
+	}
+	*minute_of_day = h*60 + m;
+	*text = p + 2;
+	return true;
+}
+
+bool parse_seconds(const char **text, const char *end, int *ms) {
+// After H:MM: nothing (0), :SS or :SS.mmm (1 to 3 digits); moves *text after it
+	const char *p = *text;
+	int digits, scale;
+	*ms = 0;
+	if (p >= end || *p != ':') {
+		return true;
+	}
+	if (end - p < 3 || p[1] < '0' || p[1] > '5' || p[2] < '0' || p[2] > '9') {
+		return false;
+	}
+	*ms = ((p[1] - '0')*10 + (p[2] - '0')) * 1000;
+	p += 3;
+	if (p < end && *p == '.') {
+		p++;
+		for (digits = 0, scale = 100; p < end && *p >= '0' && *p <= '9' && digits < 3; digits++, scale /= 10) {
+			*ms += (*p++ - '0') * scale;
+		}
+		if (digits == 0) {
+			return false;
+		}
+	}
+	*text = p;
+	return true;
+}
+
+void format_seconds(char text[8], int ms) {
+// Like format_time(): ":SS.mmm", ":SS" for a whole second, nothing for a whole minute
+	text[0] = '\0';
+	if (ms == 0) {
+		return;
+	}
+	text[0] = ':';
+	text[1] = '0' + ms / 10000;
+	text[2] = '0' + ms / 1000 % 10;
+	text[3] = '\0';
+	if (ms % 1000 != 0) {
+		text[3] = '.';
+		text[4] = '0' + ms / 100 % 10;
+		text[5] = '0' + ms / 10 % 10;
+		text[6] = '0' + ms % 10;
+		text[7] = '\0';
+	}
+}
+
+void format_time(char text[6], int minute_of_day) {
+// HH:MM, without going through snprintf (it's called for every activity printed)
+	text[0] = '0' + minute_of_day / 600;
+	text[1] = '0' + minute_of_day / 60 % 10;
+	text[2] = ':';
+	text[3] = '0' + minute_of_day % 60 / 10;
+	text[4] = '0' + minute_of_day % 10;
+	text[5] = '\0';
+}
+
+bool rule_word(const char **text, const char *end, const char *expected) {
+// Skip the spaces at *text, then move *text after the next word if it's the one expected
+	const char *p = *text;
+	size_t length = strlen(expected);
+	while (p < end && *p == ' ') {
+		p++;
+	}
+	if ((size_t)(end - p) < length || memcmp(p, expected, length) || (p + length < end && p[length] != ' ')) {
+		return false;
+	}
+	*text = p + length;
+	return true;
+}
+
+int parse_rule(struct schedule *sch, const char **text, const char *end, uint32_t today) {
+// The optional rule between brackets at *text, followed by a space: moves *text after it and returns its index in
+// sch->rules (0 if there's none: every day), -1 if it isn't a rule (or there's no memory for it)
+	static const char *weekday_names[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+	uint32_t dates[RULE_DATES_MAX];
+	struct rule rule = { .kind = RULE_DAILY };
+	const char *p = *text, *close;
+	uint32_t day;
+	int every = 0, k;
+	if (p == end || *p != '[') {
+		return 0;
+	}
+	close = memchr(p, ']', end - p);
+	if (close == NULL || close + 1 == end || close[1] != ' ') {
+		return -1;
+	}
+	p++;
+	if (rule_word(&p, close, "daily")) { // (the same as no rule)
+	}
+	else if (rule_word(&p, close, "weekdays")) {
+		rule.kind = RULE_WEEKDAYS;
+		rule.weekdays = 0x3e; // monday to friday
+	}
+	else if (rule_word(&p, close, "weekends")) {
+		rule.kind = RULE_WEEKDAYS;
+		rule.weekdays = 0x41; // saturday and sunday
+	}
+	else if (rule_word(&p, close, "every")) {
+		rule.kind = RULE_EVERY;
+		while (p < close && *p == ' ') {
+			p++;
+		}
+		while (p < close && *p >= '0' && *p <= '9' && every < 65536) {
+			every = every*10 + (*p++ - '0');
+		}
+		if (every < 1 || every > 65535 || !(rule_word(&p, close, "days") || rule_word(&p, close, "day"))) {
+			return -1;
+		}
+		rule.every = every;
+		rule.first = today;
+		if (rule_word(&p, close, "from")) {
+			while (p < close && *p == ' ') {
+				p++;
+			}
+			if (!parse_date(&p, close, &rule.first)) {
+				return -1;
+			}
+		}
+	}
+	else if (rule_word(&p, close, "on")) {
+		rule.kind = RULE_DATES;
+		while (1) {
+			while (p < close && *p == ' ') {
+				p++;
+			}
+			if (p == close) {
+				break;
+			}
+			if (rule.count == RULE_DATES_MAX || !parse_date(&p, close, &day)) {
+				return -1;
+			}
+			for (k = rule.count; k > 0 && dates[k - 1] > day; k--) { // kept sorted, without repeated days
+			}
+			if (k == 0 || dates[k - 1] != day) {
+				memmove(dates + k + 1, dates + k, (rule.count - k) * sizeof(*dates));
+				dates[k] = day;
+				rule.count++;
+			}
+		}
+		if (rule.count == 0) {
+			return -1;
+		}
+	}
+	else { // days of the week
+		rule.kind = RULE_WEEKDAYS;
+		while (p < close) {
+			for (k = 0; k < 7 && !rule_word(&p, close, weekday_names[k]); k++) {
+			}
+			if (k == 7) {
+				break;
+			}
+			rule.weekdays |= 1 << k;
+		}
+	}
+	while (p < close && *p == ' ') {
+		p++;
+	}
+	if (p != close || (rule.kind == RULE_WEEKDAYS && rule.weekdays == 0)) {
+		return -1;
+	}
+	*text = close + 2;
+	return schedule_rule(sch, &rule, dates);
+}
+
+bool parse_date(const char **text, const char *end, uint32_t *day) {
+// Read YYYY-MM-DD (from 1970) at *text and move *text after it
+	static const int month_days[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	const char *p = *text;
+	int year = 0, month, month_day, k;
+	if (end - p < 10 || p[4] != '-' || p[7] != '-') {
+		return false;
+	}
+	for (k = 0; k < 10; k++) {
+		if (k != 4 && k != 7 && (p[k] < '0' || p[k] > '9')) {
+			return false;
+		}
+	}
+	for (k = 0; k < 4; k++) {
+		year = year*10 + (p[k] - '0');
+	}
+	month = (p[5] - '0')*10 + (p[6] - '0');
+	month_day = (p[8] - '0')*10 + (p[9] - '0');
+	if (year < 1970 || month < 1 || month > 12 || month_day < 1 || month_day > month_days[month - 1] ||
+	    (month == 2 && month_day == 29 && (year % 4 || (year % 100 == 0 && year % 400)))) {
+		return false;
+	}
+	*day = days_from_civil(year, month, month_day);
+	*text = p + 10;
+	return true;
+}
+
+uint32_t days_from_civil(int year, int month, int day) {
+// Years counted from march, so that the leap day is the last day of the year (Howard Hinnant's algorithm)
+	int era, year_of_era, day_of_year;
+	year -= (month <= 2);
+	era = year / 400;
+	year_of_era = year - era*400;
+	day_of_year = (153*(month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	return era*146097 + year_of_era*365 + year_of_era/4 - year_of_era/100 + day_of_year - 719468;
+}
+
+void format_date(char text[11], uint32_t day) {
+// The inverse of days_from_civil(), without going through snprintf like format_time()
+	uint32_t z = day + 719468;
+	uint32_t era = z / 146097;
+	uint32_t day_of_era = z - era*146097;
+	uint32_t year_of_era = (day_of_era - day_of_era/1460 + day_of_era/36524 - day_of_era/146096) / 365;
+	uint32_t day_of_year = day_of_era - (365*year_of_era + year_of_era/4 - year_of_era/100);
+	uint32_t shifted = (5*day_of_year + 2) / 153; // month, from march
+	uint32_t month_day = day_of_year - (153*shifted + 2)/5 + 1;
+	uint32_t month = shifted < 10 ? shifted + 3 : shifted - 9;
+	uint32_t year = (year_of_era + era*400 + (month <= 2)) % 10000;
+	text[0] = '0' + year / 1000;
+	text[1] = '0' + year / 100 % 10;
+	text[2] = '0' + year / 10 % 10;
+	text[3] = '0' + year % 10;
+	text[4] = '-';
+	text[5] = '0' + month / 10;
+	text[6] = '0' + month % 10;
+	text[7] = '-';
+	text[8] = '0' + month_day / 10;
+	text[9] = '0' + month_day % 10;
+	text[10] = '\0';
+}
+
+void format_rule(char *text, size_t size, const struct schedule *sch, int r) {
+	static const char *weekday_names[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+	const struct rule *rule = r ? &sch->rules[r] : NULL;
+	char date[11];
+	size_t used = 0;
+	int k;
+	if (rule == NULL) {
+		snprintf(text, size, "daily");
+	}
+	else if (rule->kind == RULE_WEEKDAYS && (rule->weekdays == 0x3e || rule->weekdays == 0x41)) {
+		snprintf(text, size, rule->weekdays == 0x3e ? "weekdays" : "weekends");
+	}
+	else if (rule->kind == RULE_WEEKDAYS) {
+		text[0] = '\0';
+		for (k = 0; k < 7; k++) {
+			if (((rule->weekdays >> (k + 1) % 7) & 1) && used < size) { // from monday
+				used += snprintf(text + used, size - used, used ? " %s" : "%s", weekday_names[(k + 1) % 7]);
+			}
+		}
+	}
+	else if (rule->kind == RULE_EVERY) {
+		format_date(date, rule->first);
+		snprintf(text, size, "every %d days from %s", rule->every, date);
+	}
+	else {
+		format_date(date, sch->dates[rule->first]);
+		if (rule->count == 1) {
+			snprintf(text, size, "on %s", date);
+		}
+		else {
+			snprintf(text, size, "on %s and %u more dates", date, rule->count - 1);
+		}
+	}
+}
+
+bool load_precise(struct schedule *loaded, const struct pending_activity *pending) {
+// The times past the minute of the activity just added
+	if (!schedule_precise(loaded)) {
+		fprintf(stderr, "Not enough memory for %d activities\n", loaded->count);
+		return false;
+	}
+	loaded->start_ms[loaded->count - 1] = pending->start_ms;
+	loaded->end_ms[loaded->count - 1] = pending->end_ms;
+	return true;
+}
+
+int load_schedule(const char *path) {
+// Parse the whole file in one pass over the mapped buffer. Returns 0 if the schedule was loaded, otherwise prints
+// the problem (with the line number) and returns 1, leaving the current schedule as it was.
+	struct stat info;
+	struct schedule loaded;
+	struct pending_activity batch[LOAD_BATCH];
+	struct pending_activity *pending;
+	char times[4][6];
+	long overlaps;
+	int batched = 0, k;
+	int line = 0;
+	int start, end_minute, rule, a, b, start_ms, end_ms;
+	uint32_t today = local_day();
+	const char *data, *p, *end, *line_end, *name;
+	size_t name_length;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &info) == -1) {
+		fprintf(stderr, "Can't open schedule file %s: %s\n", path, strerror(errno));
+		if (fd != -1) {
+			close(fd);
+		}
+		return 1;
+	}
+	if (info.st_size == 0) {
+		fprintf(stderr, "Schedule file %s has no activities\n", path);
+		close(fd);
+		return 1;
+	}
+	data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Can't map schedule file %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	madvise((void *)data, info.st_size, MADV_SEQUENTIAL);
+
+	schedule_init(&loaded);
+	end = data + info.st_size;
+	for (p = data; p < end; p = line_end + 1) {
+		line++;
+		line_end = memchr(p, '\n', end - p);
+		if (line_end == NULL) { // last line without '\n'
+			line_end = end;
+		}
+		if (p == line_end || *p == '#' || (*p == '\r' && p + 1 == line_end)) { // empty line / comment
+			continue;
+		}
+		if ((rule = parse_rule(&loaded, &p, line_end, today)) < 0) {
+			fprintf(stderr, "Schedule file %s, line %d: expected days like [weekdays], [mon wed fri], [every 2 days from 2026-10-01] or [on 2026-12-24]\n", path, line);
+			goto error;
+		}
+		if (!parse_time(&p, line_end, &start) || !parse_seconds(&p, line_end, &start_ms) || p >= line_end || *p++ != ',' ||
+		    !parse_time(&p, line_end, &end_minute) || !parse_seconds(&p, line_end, &end_ms) || p >= line_end || *p++ != ',') {
+			fprintf(stderr, "Schedule file %s, line %d: expected start time, end time and name, eg. 07:00,08:30,Breakfast or 08:00:30,08:01,Pills\n", path, line);
+			goto error;
+		}
+		name = p;
+		name_length = line_end - p;
+		if (name_length > 0 && name[name_length - 1] == '\r') { // files written on Windows
+			name_length--;
+		}
+		if (name_length == 0 || name_length > 100) {
+			fprintf(stderr, "Schedule file %s, line %d: the name must have between 1 and 100 characters\n", path, line);
+			goto error;
+		}
+		pending = &batch[batched++];
+		*pending = (struct pending_activity){ start, end_minute, name, name_length, schedule_hash(name, name_length), rule, start_ms, end_ms };
+		if (loaded.intern_capacity > 0) {
+			__builtin_prefetch(&loaded.intern[pending->hash & (loaded.intern_capacity - 1)]);
+		}
+		if (batched == LOAD_BATCH) {
+			for (k = 0; k < batched; k++) {
+				if (!schedule_add(&loaded, batch[k].start, batch[k].end, batch[k].name, batch[k].length, batch[k].hash)) {
+					fprintf(stderr, "Not enough memory for %d activities\n", loaded.count + 1);
+					goto error;
+				}
+				loaded.rule[loaded.count - 1] = batch[k].rule;
+				if ((batch[k].start_ms || batch[k].end_ms) && !load_precise(&loaded, &batch[k])) {
+					goto error;
+				}
+			}
+			batched = 0;
+		}
+	}
+	for (k = 0; k < batched; k++) { // last batch
+		if (!schedule_add(&loaded, batch[k].start, batch[k].end, batch[k].name, batch[k].length, batch[k].hash)) {
+			fprintf(stderr, "Not enough memory for %d activities\n", loaded.count + 1);
+			goto error;
+		}
+		loaded.rule[loaded.count - 1] = batch[k].rule;
+		if ((batch[k].start_ms || batch[k].end_ms) && !load_precise(&loaded, &batch[k])) {
+			goto error;
+		}
+	}
+	munmap((void *)data, info.st_size);
+	if (loaded.count == 0) {
+		fprintf(stderr, "Schedule file %s has no activities\n", path);
+		schedule_free(&loaded);
+		return 1;
+	}
+	if ((overlaps = schedule_overlaps(&loaded, today, &a, &b)) > 0) { // assumption 7 (not checked without memory)
+		format_time(times[0], loaded.start[b]);
+		format_time(times[1], loaded.end[b]);
+		format_time(times[2], loaded.start[a]);
+		format_time(times[3], loaded.end[a]);
+		fprintf(stderr, "Schedule file %s: %s (%s - %s) overlaps %s (%s - %s)", path, schedule_name(&loaded, b),
+			times[0], times[1], schedule_name(&loaded, a), times[2], times[3]);
+		if (overlaps > 1) {
+			fprintf(stderr, " (%ld activities in all start during another one)", overlaps);
+		}
+		fprintf(stderr, "; where they overlap granny is asked about the later one in the file\n");
+	}
+	schedule_free(&acts);
+	acts = loaded;
+	return 0;
+
+error:
+	munmap((void *)data, info.st_size);
+	schedule_free(&loaded);
+	return 1;
+}
+
+void build_lookup(void) {
+// Mark the minutes of every activity in the table, splitting the ones that go past midnight
+	int i, minute, start, end;
+#ifdef GRANNY_SCHEDULE
+	if (acts.compiled) { // done by --compile
+		memcpy(lookup_table, compiled_lookup, sizeof(lookup_table));
+		return;
+	}
+#endif
+	for(minute=0;minute<24*60;minute++){
+		lookup_table[minute] = -1;
+	}
+	for(i=0;i<acts.count;i++){
+		start = acts.start[i];
+		end = acts.end[i];
+		if (end < start) { // eg. 23:00 - 6:00 am becomes 23:00 - 23:59 and 0:00 - 6:00 am
+			for(minute=start;minute<24*60;minute++){
+				lookup_table[minute] = i;
+			}
+			start = 0;
+		}
+		for(minute=start;minute<=end;minute++){
+			lookup_table[minute] = i;
+		}
+	}
+}
+
+int lookup_scan(int hour, int minute) {
+// This is the search main() used to do for every question, kept as the baseline of the lookup benchmark
+	int i;
+	int j = -1;
+	int start_hour, start_minute, end_hour, end_minute;
+	for(i=0;i<acts.count;i++){
+		start_hour = acts.start[i] / 60;
+		start_minute = acts.start[i] % 60;
+		end_hour = acts.end[i] / 60;
+		end_minute = acts.end[i] % 60;
+		if((start_hour == hour) && (end_hour == hour) ){ // in the same hour
+			// Check minutes for next decision
+			if((minute >= start_minute) && (minute <= end_minute)){
+				j = i; // save the right activity
+			}
+		}
+		else if((start_hour <= hour) && (hour <= end_hour)){ // some range, different hours
+			// check subcases now
+			if( ( (minute >= start_minute) && (start_hour == hour)) || ( (minute <= end_minute) && (hour == end_hour) )) { // It's in the range of the activity (limit hours) 
+				j = i;
+			}
+			if((start_hour < hour) && (hour < end_hour)) { // within the range (not edges)
+				j = i;
+			}
+		}
+
+		else if ((start_hour > end_hour)) { // for activities like sleeping where we have, for instance, 23:00 - 6:00 am
+			if( (hour == end_hour) && (minute <= end_minute) ){
+				j = i;
+			}
+
+			if ( (hour == start_hour) && (minute >= start_minute) ) {
+				j = i;
+
+			}
+
+			if ( ((hour > start_hour) || (hour < end_hour) ) ) { // within the range
+				j = i;
+			}
+
+		}
+
+	}
+	return j;
+}
+
+int intervals_build(struct intervals *x, const struct schedule *sch) {
+// Split the night activities, counting sort the pieces by start, then the subtree maxima and reach[]
+	uint32_t next[24*60];
+	long pieces = sch->count, k;
+	int i, minute, latest;
+	for (i = 0; i < sch->count; i++) {
+		pieces += (sch->end[i] < sch->start[i]);
+	}
+	memset(x, 0, sizeof(*x));
+	x->sch = sch;
+	x->count = pieces;
+	x->pieces = malloc(pieces * sizeof(*x->pieces) + 1);
+	x->max_end = malloc(pieces * sizeof(*x->max_end) + 1);
+	if (!x->pieces || !x->max_end) {
+		intervals_free(x);
+		return -1;
+	}
+	for (i = 0; i < sch->count; i++) {
+		x->first[sch->start[i] + 1]++;
+		if (sch->end[i] < sch->start[i]) {
+			x->first[1]++; // its tail starts at 0:00
+		}
+	}
+	for (minute = 0; minute < 24*60; minute++) {
+		x->first[minute + 1] += x->first[minute];
+		next[minute] = x->first[minute];
+	}
+	for (i = 0; i < sch->count; i++) { // in schedule order within a minute
+		if (sch->end[i] < sch->start[i]) {
+			x->pieces[next[sch->start[i]]++] = (struct interval_piece){ sch->start[i], 24*60 - 1, (uint32_t)i << 1 };
+			x->pieces[next[0]++] = (struct interval_piece){ 0, sch->end[i], (uint32_t)i << 1 | 1 };
+		}
+		else {
+			x->pieces[next[sch->start[i]]++] = (struct interval_piece){ sch->start[i], sch->end[i], (uint32_t)i << 1 };
+		}
+	}
+	intervals_augment(x, 0, pieces);
+	latest = -1;
+	for (minute = 0; minute < 24*60; minute++) {
+		for (k = x->first[minute]; k < x->first[minute + 1]; k++) {
+			if (x->pieces[k].end > latest) {
+				latest = x->pieces[k].end;
+			}
+		}
+		x->reach[minute] = latest;
+	}
+	return 0;
+}
+
+void intervals_free(struct intervals *x) {
+	free(x->pieces);
+	free(x->max_end);
+	x->pieces = NULL;
+	x->max_end = NULL;
+	x->count = 0;
+}
+
+int intervals_augment(struct intervals *x, long low, long high) {
+	long middle = low + (high - low) / 2;
+	int latest, other;
+	if (high - low <= 1) { // a leaf (or nothing)
+		if (low < high) {
+			x->max_end[low] = x->pieces[low].end;
+			return x->pieces[low].end;
+		}
+		return -1;
+	}
+	latest = x->pieces[middle].end;
+	other = intervals_augment(x, low, middle);
+	if (other > latest) {
+		latest = other;
+	}
+	other = intervals_augment(x, middle + 1, high);
+	if (other > latest) {
+		latest = other;
+	}
+	x->max_end[middle] = latest;
+	return latest;
+}
+
+long intervals_range(const struct intervals *x, int from, int to, int *found, long capacity) {
+// Every activity with a minute in from - to (to < from: across midnight) once, even if both of its pieces are in
+// it. Returns how many there are, the first capacity of them are written in found.
+	struct interval_query q = { from, to, to, 24*60, found, capacity, 0 };
+	if (from <= to) {
+		intervals_search(x, 0, x->count, &q);
+		return q.count;
+	}
+	q.to = 24*60 - 1; // from - 23:59: no tail can be there, a head there always is
+	q.tail_after = -1;
+	intervals_search(x, 0, x->count, &q);
+	q.from = 0; // 0:00 - to: the heads of those tails were found, and so were the pieces that reach from
+	q.to = to;
+	q.tail_after = 24*60;
+	q.end_before = from;
+	intervals_search(x, 0, x->count, &q);
+	return q.count;
+}
+
+void intervals_search(const struct intervals *x, long low, long high, struct interval_query *q) {
+	long middle = low + (high - low) / 2;
+	uint32_t piece;
+	if (low >= high || x->max_end[middle] < q->from) { // everything there ends before the span
+		return;
+	}
+	intervals_search(x, low, middle, q);
+	if (x->pieces[middle].start > q->to) { // and everything after starts after it
+		return;
+	}
+	piece = x->pieces[middle].activity;
+	if (x->pieces[middle].end >= q->from &&
+	    ((piece & 1) ? x->sch->start[piece >> 1] > q->tail_after : x->pieces[middle].end < q->end_before)) {
+		if (q->count < q->capacity) {
+			q->found[q->count] = piece >> 1;
+		}
+		q->count++;
+	}
+	intervals_search(x, middle + 1, high, q);
+}
+
+int intervals_free_slot(const struct intervals *x, int length, int after) {
+// First minute from after on (going round the day once) where an activity of length minutes (1 to 23:59, from its
+// start to its end minute like in the schedule) touches nothing, -1 if there's none. The candidate moves past a busy
+// block at once (reach[]) or to the next start (first[]), so it's at most two steps per block of the day.
+	long candidate = after, next;
+	int minute;
+	while (candidate < after + 24*60) {
+		minute = candidate % (24*60);
+		if (x->reach[minute] >= minute) { // busy until reach[minute]
+			candidate += x->reach[minute] - minute + 1;
+			continue;
+		}
+		if (x->first[minute] < x->count) {
+			next = x->pieces[x->first[minute]].start; // first piece starting from there
+		}
+		else {
+			next = x->count > 0 ? x->pieces[0].start + 24*60 : 3*24*60; // tomorrow's first one
+		}
+		if (next - minute > length) {
+			return minute;
+		}
+		candidate += next - minute;
+	}
+	return -1;
+}
+
+bool intervals_meet(const struct intervals *x, long p, long q, uint32_t from) {
+// The activities of pieces p and q occur the same day: a tail is on the day after the occurrence of its activity
+	const struct schedule *sch = x->sch;
+	uint32_t a = x->pieces[p].activity, b = x->pieces[q].activity;
+	if (sch->rules_count <= 1) { // every activity is daily
+		return true;
+	}
+	return rule_meets(sch, sch->rule[a >> 1], sch->rule[b >> 1], (int)(a & 1) - (int)(b & 1), from);
+}
+
+long intervals_partner(const struct intervals *x, long low, long high, long p, uint32_t from) {
+// A piece of the subtree low - high (other than p) going on when p starts, whose activity occurs the same day, -1: none
+	long middle = low + (high - low) / 2, q;
+	if (low >= high || x->max_end[middle] < x->pieces[p].start) {
+		return -1;
+	}
+	if ((q = intervals_partner(x, low, middle, p, from)) >= 0) {
+		return q;
+	}
+	if (x->pieces[middle].start > x->pieces[p].start) {
+		return -1;
+	}
+	if (middle != p && x->pieces[middle].end >= x->pieces[p].start && intervals_meet(x, middle, p, from)) {
+		return middle;
+	}
+	return intervals_partner(x, middle + 1, high, p, from);
+}
+
+long intervals_overlaps(const struct intervals *x, uint32_t from, int *a, int *b) {
+// Two activities overlap if one starts during the other: one sweep in start order, keeping the piece that ends the
+// latest so far. Activities of different days (eg. [weekdays] and [sun] at the same time) don't count; only when
+// that latest piece isn't on the same day is the tree searched for another one. Returns how many pieces start
+// during another one, the first of them (*b) and the activity it starts during (*a).
+	long p, q, latest = -1, count = 0;
+	for (p = 0; p < x->count; p++) {
+		if (latest >= 0 && x->pieces[latest].end >= x->pieces[p].start) {
+			q = intervals_meet(x, latest, p, from) ? latest : intervals_partner(x, 0, x->count, p, from);
+			if (q >= 0 && count++ == 0) {
+				*a = x->pieces[q].activity >> 1;
+				*b = x->pieces[p].activity >> 1;
+			}
+		}
+		if (latest < 0 || x->pieces[p].end > x->pieces[latest].end) {
+			latest = p;
+		}
+	}
+	return count;
+}
+
+long schedule_overlaps(const struct schedule *sch, uint32_t from, int *a, int *b) {
+// The check of a schedule file: like intervals_overlaps(), but when every activity is daily the pieces don't need
+// sorting, how many start at each minute and the latest end among them are enough (the pair reported is found with
+// one more pass). -1 if there's no memory for the index a schedule with rules needs.
+	struct intervals x;
+	uint32_t starts[24*60];
+	int16_t latest[24*60];
+	long count = 0;
+	int i, minute, reach = -1, first = -1;
+	bool covered = false, night, there;
+	if (sch->rules_count > 1) {
+		if (intervals_build(&x, sch) != 0) {
+			return -1;
+		}
+		count = intervals_overlaps(&x, from, a, b);
+		intervals_free(&x);
+		return count;
+	}
+	memset(starts, 0, sizeof(starts));
+	memset(latest, -1, sizeof(latest));
+	for (i = 0; i < sch->count; i++) {
+		night = (sch->end[i] < sch->start[i]);
+		starts[sch->start[i]]++;
+		if ((night ? 24*60 - 1 : sch->end[i]) > latest[sch->start[i]]) {
+			latest[sch->start[i]] = night ? 24*60 - 1 : sch->end[i];
+		}
+		if (night) { // its tail
+			starts[0]++;
+			if (sch->end[i] > latest[0]) {
+				latest[0] = sch->end[i];
+			}
+		}
+	}
+	for (minute = 0; minute < 24*60; minute++) {
+		if (starts[minute] > 0) {
+			count += starts[minute] - 1 + (reach >= minute); // all but the first start during another one
+			if (first < 0 && (starts[minute] > 1 || reach >= minute)) {
+				first = minute;
+				covered = (reach >= minute);
+			}
+			if (latest[minute] > reach) {
+				reach = latest[minute];
+			}
+		}
+	}
+	// The first pair: a piece going on at that minute that started before, or the first two starting then
+	for (*a = *b = -1, i = 0; first >= 0 && i < sch->count && *b < 0; i++) {
+		night = (sch->end[i] < sch->start[i]);
+		there = (sch->start[i] == first || (night && first == 0));
+		if (covered && *a < 0 && ((sch->start[i] < first && (night || sch->end[i] >= first)) ||
+		    (night && first > 0 && sch->end[i] >= first))) {
+			*a = i;
+		}
+		else if (there && (covered || *a >= 0)) {
+			*b = i;
+		}
+		else if (there) {
+			*a = i;
+		}
+	}
+	return count;
+}
+
+void build_events(void) {
+	long long now = internal_now();
+	wheel_init(&agenda_wheel, now);
+	if (!agenda_build(&granny, &agenda_wheel, now)) {
+		fprintf(stderr, "Not enough memory for the events of %d activities\n", acts.count);
+		exit(1);
+	}
+}
+
+bool agenda_build(struct agenda *a, struct wheel *w, long long now) {
+// Fill the wheel with the events of each activity that are still ahead of the internal clock. Activities that already
+// ended today are marked as done (like the old thread 1 used to do), and the night activity is taken from yesterday
+// if we are still in its morning part (eg. the agenda is started at 3 am).
+	struct event *pending[3];
+	int i, k, n;
+	if (a->events == NULL) { // the first day
+		a->events = calloc((size_t)a->sch->count * 3, sizeof(*a->events));
+	}
+	if (a->events == NULL) {
+		return false;
+	}
+	for(i=0;i<a->sch->count;i++){
+		n = agenda_activity(a, i, now, pending);
+		for (k = 0; k < n; k++) {
+			wheel_add(w, pending[k]);
+		}
+	}
+	return true;
+}
+
+int agenda_activity(struct agenda *a, int i, long long now, struct event *pending[3]) {
+// The events of the first occurrence of activity i that isn't over at internal time now, in a->events: last night's,
+// today's or (recurring agendas only) the next day its rule has one; the ones still ahead are returned in pending.
+// Occurrences that ended today are marked as done on the way.
+	struct schedule *sch = a->sch;
+	struct event *events = a->events + (size_t)i * 3;
+	long long midnight = now / 86400000 * 86400000; // simulations run more than one day
+	uint32_t today = internal_first_day + now / 86400000;
+	uint32_t day = today ? today - 1 : 0;
+	long long start, end;
+	int n = 0;
+	while (1) {
+		day = rule_next(sch, sch->rule[i], day);
+		if (day == UINT32_MAX || (day > today && !a->recurring)) {
+			return 0;
+		}
+		start = midnight + ((long long)day - today) * 86400000 + sch->start[i] * 60000LL + schedule_start_ms(sch, i);
+		end = midnight + ((long long)day - today) * 86400000 + sch->end[i] * 60000LL + schedule_end_ms(sch, i);
+		if (end < start) { // activities like sleeping, eg. 23:00 - 6:00 am
+			end += 86400000;
+		}
+		if (end > now) {
+			break;
+		}
+		if (end >= midnight) { // already finished today
+			schedule_transition(sch, i, day, FLAG_DONE);
+		}
+		day++;
+	}
+	events[EVENT_START] = (struct event){ .deadline = start, .agenda = a, .act = i, .day = day, .kind = EVENT_START };
+	events[EVENT_WARNING] = (struct event){ .deadline = end - 10*60000, .agenda = a, .act = i, .day = day, .kind = EVENT_WARNING };
+	// The activity is finished once its end minute has passed (or its end, when it's given to the second)
+	events[EVENT_END] = (struct event){ .deadline = end + (schedule_end_ms(sch, i) ? 0 : 60000), .agenda = a, .act = i, .day = day, .kind = EVENT_END };
+	// The start minute itself still counts as "starting now"
+	if (start + 60000 > now) {
+		pending[n++] = &events[EVENT_START];
+	}
+	// Activities of 10 minutes or less get no warning: it would come before (or with) their start
+	if (end - 10*60000 > start && end - 10*60000 > now) {
+		pending[n++] = &events[EVENT_WARNING];
+	}
+	pending[n++] = &events[EVENT_END];
+	return n;
+}
+
+void agenda_rearm(struct event *ends, struct wheel *w, long long now) {
+// The END events just fired (linked through next), holding the lock of w: their activities get the events of their
+// next occurrence. The START and WARNING events of the occurrence that ended were due before, so none is pending.
+	struct event *pending[3];
+	struct event *next;
+	int k, n;
+	for (; ends; ends = next) {
+		next = ends->next;
+		n = agenda_activity(ends->agenda, ends->act, now, pending);
+		for (k = 0; k < n; k++) {
+			wheel_add(w, pending[k]);
+		}
+	}
+}
+
+int agenda_lookup(struct live *l, int minute_of_day, long long now, uint32_t *day) {
+// The activity scheduled at some minute (-1: none) and its occurrence (see schedule_occurrence()). The lookup table
+// has the latest activity at that minute whatever the day: if it doesn't occur that day, the activities before it
+// are searched for one that does (only when activities of different days overlap, eg. piano on weekdays and church
+// on sundays at the same time; live edits never overlap, so the activities searched are never being added).
+	struct schedule *sch = l->sch;
+	int j = live_lookup(l, minute_of_day);
+	if (j < 0) {
+		return -1;
+	}
+	*day = schedule_occurrence(sch, j, now);
+	if (rule_matches(sch, sch->rule[j], *day)) {
+		return j;
+	}
+	for (j--; j >= 0; j--) {
+		if ((sch->start[j] <= sch->end[j] ? (minute_of_day >= sch->start[j] && minute_of_day <= sch->end[j])
+		    : (minute_of_day >= sch->start[j] || minute_of_day <= sch->end[j])) &&
+		    !(l->removed && ((l->removed[j / 64] >> (j % 64)) & 1))) {
+			*day = schedule_occurrence(sch, j, now);
+			if (rule_matches(sch, sch->rule[j], *day)) {
+				return j;
+			}
+		}
+	}
+	return -1;
+}
+
+void wheel_init(struct wheel *w, long long now_ms) {
+	memset(w, 0, sizeof(*w));
+	w->now = now_ms;
+}
+
+void wheel_add(struct wheel *w, struct event *ev) {
+// Choose the level from the distance to the current millisecond; overdue events go to the current millisecond slot
+	long long expires = ev->deadline;
+	long long delta;
+	int level, slot;
+	if (expires < w->now) {
+		expires = w->now;
+	}
+	delta = expires - w->now;
+	for (level = 0; level < WHEEL_LEVELS - 1 && delta >= wheel_size[level] * wheel_unit[level]; level++) {
+	}
+	if (delta < wheel_size[level] * wheel_unit[level]) {
+		slot = (expires / wheel_unit[level]) % wheel_size[level];
+	}
+	else { // too far away: wait in the last day slot, it will be cascaded again when it's reached
+		slot = (w->now / wheel_unit[level] + wheel_size[level] - 1) % wheel_size[level];
+	}
+	slot += wheel_base[level];
+	w->bits[slot / 64] |= 1ULL << (slot % 64);
+	ev->slot = slot;
+	ev->next = w->slots[slot];
+	if (ev->next) {
+		ev->next->pprev = &ev->next;
+	}
+	w->slots[slot] = ev;
+	ev->pprev = &w->slots[slot];
+	w->count++;
+}
+
+void wheel_clear_bit(struct wheel *w, int slot) {
+// The slot just became empty
+	w->bits[slot / 64] &= ~(1ULL << (slot % 64));
+}
+
+void wheel_cancel(struct wheel *w, struct event *ev) {
+	if (ev->pprev == NULL) { // not pending (never added, already expired or already cancelled)
+		return;
+	}
+	*ev->pprev = ev->next;
+	if (ev->next) {
+		ev->next->pprev = ev->pprev;
+	}
+	if (w->slots[ev->slot] == NULL) {
+		wheel_clear_bit(w, ev->slot);
+	}
+	ev->pprev = NULL;
+	w->count--;
+}
+
+int wheel_first(const struct wheel *w, int from, int to) {
+	unsigned long long word;
+	int k;
+	for (k = from; k < to; k = (k / 64 + 1) * 64) {
+		word = w->bits[k / 64] >> (k % 64);
+		if (word) {
+			k += __builtin_ctzll(word);
+			return k < to ? k : -1;
+		}
+	}
+	return -1;
+}
+
+long long wheel_next(struct wheel *w) {
+// The next millisecond at which something has to be done: the earliest, over the levels, of the next time an
+// occupied slot is reached (expired for milliseconds, cascaded for the others). The slots of a level are in order
+// from the current one, those before it come after a full turn; a boundary that's exactly now counts if it hasn't
+// been processed yet.
+	long long turn, result = -1, at;
+	int level, current, slot;
+	if (w->count == 0) {
+		return -1;
+	}
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		turn = (w->now + wheel_unit[level] - 1) / wheel_unit[level]; // the next boundary of the level, in its units
+		current = wheel_base[level] + turn % wheel_size[level];
+		if ((slot = wheel_first(w, current, wheel_base[level] + wheel_size[level])) == -1 &&
+		    (slot = wheel_first(w, wheel_base[level], current)) == -1) {
+			continue;
+		}
+		at = (turn + (slot - current + wheel_size[level]) % wheel_size[level]) * wheel_unit[level];
+		if (result == -1 || at < result) {
+			result = at;
+		}
+		if (level == 0 && slot >= current) { // before any boundary of the other levels
+			return result;
+		}
+	}
+	return result;
+}
+
+void wheel_cascade(struct wheel *w, int slot) {
+// Insert again the events of a second / minute / hour / day slot whose time has come
+	struct event *ev = w->slots[slot];
+	struct event *next;
+	w->slots[slot] = NULL;
+	wheel_clear_bit(w, slot);
+	while (ev) {
+		next = ev->next;
+		w->count--;
+		wheel_add(w, ev);
+		ev = next;
+	}
+}
+
+struct event *wheel_expire(struct wheel *w, long long until_ms) {
+// Advance the wheel up to (and including) until_ms, jumping directly between the milliseconds that have work to do.
+// The due events are returned in a list linked by 'next', in order of deadline; they're no longer pending.
+	struct event *head = NULL;
+	struct event **tail = &head;
+	struct event *ev;
+	long long ms;
+	int level, slot;
+	while ((ms = wheel_next(w)) != -1 && ms <= until_ms) {
+		w->now = ms;
+		for (level = WHEEL_LEVELS - 1; level > 0; level--) { // coarsest first: its events may go to the next level
+			if (ms % wheel_unit[level] == 0) {
+				wheel_cascade(w, wheel_base[level] + (ms / wheel_unit[level]) % wheel_size[level]);
+			}
+		}
+		slot = ms % wheel_size[0];
+		for (ev = w->slots[slot]; ev; ev = ev->next) {
+			ev->pprev = NULL;
+			w->count--;
+			*tail = ev;
+			tail = &ev->next;
+		}
+		*tail = NULL;
+		w->slots[slot] = NULL;
+		wheel_clear_bit(w, slot);
+		w->now = ms + 1;
+	}
+	if (w->now <= until_ms) { // nothing left to do until then
+		w->now = until_ms + 1;
+	}
+	return head;
+}
+
+void fire(struct event *ev) {
+// Execute one due event (outputs are only queued, the dispatcher prints them 3 seconds apart)
+	struct agenda *a = ev->agenda;
+	struct schedule *sch = a->sch;
+	int minute_of_day = (int)((ev->deadline / 60000) % 1440);
+	bool completed, published = true; // (a simulation only counts the notifications that reached the dispatcher)
+
+	if (ev->kind == EVENT_START) {
+		if (schedule_transition(sch, ev->act, ev->day, FLAG_STARTED)) { // notified only once
+			atomic_fetch_add_explicit(&a->notified, 1, memory_order_relaxed);
+			if (!a->quiet) {
+				if (ev->deadline % 60000 == 0) {
+					published = output("Activity: %s is starting now, hour: %d and minute: %d\n", schedule_name(sch, ev->act), minute_of_day / 60, minute_of_day % 60);
+				}
+				else {
+					published = output("Activity: %s is starting now, hour: %d, minute: %d and second: %d\n", schedule_name(sch, ev->act), minute_of_day / 60, minute_of_day % 60, (int)(ev->deadline % 60000 / 1000));
+				}
+			}
+			if (simulation && published) {
+				simulation_record(ev);
+			}
+		}
+	}
+	else if (ev->kind == EVENT_WARNING) {
+		if (!schedule_state(sch, ev->act, ev->day, FLAG_DONE) && schedule_transition(sch, ev->act, ev->day, FLAG_WARNED)) {
+			atomic_fetch_add_explicit(&a->notified, 1, memory_order_relaxed);
+			if (!a->quiet) {
+				published = output("Activity: %s will be finishing in 10 minutes.\n", schedule_name(sch, ev->act));
+			}
+			if (simulation && published) {
+				simulation_record(ev);
+			}
+		}
+	}
+	else { // EVENT_END: the activity finished, so it's marked as done (by the agenda, unless granny already said so)
+		completed = schedule_transition(sch, ev->act, ev->day, FLAG_DONE);
+		if (completed && simulation) {
+			simulation->fired[EVENT_END]++;
+		}
+		if (sch->history && schedule_state(sch, ev->act, ev->day, FLAG_DONE)) { // (not if it's in a later occurrence)
+			history_record(sch->history, ev->act, ev->day, !completed);
+		}
+	}
+}
+
+void *scheduler(){
+// The scheduler sleeps until the wheel has something due (or until it's woken up because something changed),
+// fires the due events, arms the next occurrence of the activities that ended and goes back to sleep. If there's
+// nothing left (no activity occurs again) the thread exits, unless the schedule can be edited: then it waits for
+// the events of the edits.
+	struct timespec deadline;
+	struct event *ev;
+	struct event *next;
+	struct event *ends;
+	long long next_ms;
+
+	sched_lock();
+	while (!scheduler_stop) {
+		live_timers(&live, &agenda_wheel); // events of the activities edited since the last time
+		if ((next_ms = wheel_next(&agenda_wheel)) == -1) {
+			if (!live.editable) {
+				break;
+			}
+			sched_timedwait(NULL); // live edits can add events later
+			atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+			continue;
+		}
+		if (internal_now() < next_ms && speed_max) {
+			// Nothing to do until then, so the internal clock goes straight there
+			clock_jump(next_ms);
+		}
+		if (internal_now() < next_ms) {
+			// Not due yet: sleep until the absolute deadline, then check again (spurious wakeups / changes).
+			// When woken up late, wheel_expire() catches up with every millisecond that was passed.
+			deadline = internal_to_monotonic(next_ms);
+			sched_timedwait(&deadline);
+			atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+			continue;
+		}
+		ev = wheel_expire(&agenda_wheel, internal_now());
+		sched_unlock();
+
+		for (ends = NULL; ev; ev = next) {
+			next = ev->next;
+			fire_due(ev); // without holding sched_mutex
+			if (ev->kind == EVENT_END && ev->agenda->recurring) {
+				ev->next = ends;
+				ends = ev;
+			}
+		}
+
+		sched_lock();
+		agenda_rearm(ends, &agenda_wheel, internal_now());
+	}
+	sched_unlock();
+	return 0;
+}
+
+void fire_due(struct event *ev) {
+	struct timespec now;
+	struct timespec deadline = internal_to_monotonic(ev->deadline);
+	long long late_ns;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	late_ns = (now.tv_sec - deadline.tv_sec) * 1000000000LL + (now.tv_nsec - deadline.tv_nsec);
+	if (late_ns < 0 || speed_max) { // inside the current minute (eg. started mid-minute) / no real deadline
+		late_ns = 0;
+	}
+	sched_fired++;
+	sched_late_total_ns += late_ns;
+	if (late_ns > sched_late_max_ns) {
+		sched_late_max_ns = late_ns;
+	}
+	if (stats) {
+		histogram_add(&stats->lateness_ns, late_ns);
+	}
+	fire(ev);
+}
+
+bool reactor_token(char *input, size_t *length, bool closed, char *token, size_t width) {
+// Like scanf("%<width>s"): skips blanks and takes up to width characters of the next word, which is only complete
+// once it's followed by a blank, has width characters or stdin is closed. Consumed bytes are removed from input.
+	size_t start = 0, end;
+	while (start < *length && (input[start] == ' ' || input[start] == '\t' || input[start] == '\n' || input[start] == '\r')) {
+		start++;
+	}
+	end = start;
+	while (end < *length && end - start < width && input[end] != ' ' && input[end] != '\t' && input[end] != '\n' && input[end] != '\r') {
+		end++;
+	}
+	if (end == start || (end == *length && end - start < width && !closed)) {
+		memmove(input, input + start, *length - start); // keep the blanks out, the word may still be incomplete
+		*length -= start;
+		return false;
+	}
+	memcpy(token, input + start, end - start);
+	token[end - start] = '\0';
+	memmove(input, input + end, *length - end);
+	*length -= end;
+	return true;
+}
+
+long long reactor_schedule(void) {
+// Same as one pass of the scheduler thread, without waiting
+	long long next_ms;
+	struct timespec deadline;
+	struct event *ev;
+	struct event *next;
+	struct event *ends;
+	while (!scheduler_stop && (next_ms = wheel_next(&agenda_wheel)) != -1) {
+		if (internal_now() < next_ms && speed_max) {
+			clock_jump(next_ms);
+		}
+		if (internal_now() < next_ms) {
+			deadline = internal_to_monotonic(next_ms);
+			return deadline.tv_sec * 1000000000LL + deadline.tv_nsec;
+		}
+		sched_lock();
+		ev = wheel_expire(&agenda_wheel, internal_now());
+		sched_unlock();
+		for (ends = NULL; ev; ev = next) {
+			next = ev->next;
+			fire_due(ev);
+			if (ev->kind == EVENT_END && ev->agenda->recurring) {
+				ev->next = ends;
+				ends = ev;
+			}
+		}
+		sched_lock();
+		agenda_rearm(ends, &agenda_wheel, internal_now());
+		sched_unlock();
+	}
+	return -1;
+}
+
+void reactor_arm(int timer, long long due_ns) {
+	struct itimerspec when;
+	memset(&when, 0, sizeof(when)); // 0: disarmed
+	if (due_ns >= 0) {
+		when.it_value.tv_sec = due_ns / 1000000000LL;
+		when.it_value.tv_nsec = due_ns % 1000000000LL;
+		if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0) {
+			when.it_value.tv_nsec = 1;
+		}
+	}
+	timerfd_settime(timer, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+void report(void) {
+// Printed to stderr when the agenda stops, to compare runs (eg. threads against --reactor)
+	struct rusage usage;
+	if (sched_fired > 0) {
+		fprintf(stderr, "Scheduler: %ld events fired, mean lateness: %lld us, max lateness: %lld us\n",
+			sched_fired, sched_late_total_ns / sched_fired / 1000, sched_late_max_ns / 1000);
+	}
+	if (output_enqueued + output_dropped > 0) {
+		fprintf(stderr, "Output: %ld messages queued (%ld through the overflow, %ld dropped), mean enqueue latency: %lld ns, max: %lld ns, dispatcher CPU: %lld us\n",
+			(long)output_enqueued, (long)output_overflowed, (long)output_dropped, output_enqueued ? output_enqueue_total_ns / output_enqueued : 0,
+			(long long)output_enqueue_max_ns, output_dispatcher_cpu_ns / 1000);
+	}
+	if (output_log_path || output_socket_fd != -1) {
+		fprintf(stderr, "Sinks: log %ld messages in %ld writes (%ld rotations, %ld lost), socket %ld messages in %ld calls (%ld lost)\n",
+			output_log_messages, output_log_writes, output_log_rotations, output_log_lost,
+			output_socket_messages, output_socket_calls, output_socket_lost);
+	}
+	if (server_requests > 0) {
+		fprintf(stderr, "Server: %lld requests answered for %ld clients\n", (long long)server_requests, (long)server_clients);
+	}
+	if (live.edits + live.refused > 0) {
+		fprintf(stderr, "Edits: %ld applied (%ld refused), mean edit: %lld us, mean grace period: %lld us\n",
+			live.edits, live.refused, live.edits ? live.edit_ns / live.edits / 1000 : 0, live.edits ? live.grace_ns / live.edits / 1000 : 0);
+	}
+	if (granny_journal.path) {
+		fprintf(stderr, "Journal: %lld records replayed in %lld us, %lld records in the file, %lld commits, %lld compactions, %lld lost\n",
+			granny_journal.replayed, granny_journal.recovery_ns / 1000, granny_journal.records, granny_journal.commits,
+			granny_journal.compactions, granny_journal.lost);
+	}
+	if (granny_history.path) {
+		fprintf(stderr, "History: %lld outcomes in %lld blocks (%lld bytes), %lld lost\n", granny_history.outcomes,
+			granny_history.blocks, granny_history.bytes, granny_history.lost);
+	}
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(stderr, "Resources: %ld wakeups, %ld voluntary and %ld involuntary context switches, max RSS: %ld kB, CPU: %ld us\n",
+		(long)wakeups, usage.ru_nvcsw, usage.ru_nivcsw, usage.ru_maxrss,
+		(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+	if (stats) {
+		stats_print(stderr, stats);
+		stats_close();
+	}
+}
+
+int reactor(void) {
+	char input[REACTOR_INPUT];
+	size_t length = 0;
+	char hour_user[6]; // to capture user's input in string format ie. 08:25, 6th place for \0
+	char answer[4]; // to capture answer from the user (yes/no)?
+	int j = -1; // activity waiting for a yes/no answer, -1: waiting for a time
+	uint32_t day = 0; // its occurrence
+	bool closed = false; // stdin closed
+	bool stop = false; // signal received
+	bool stdin_polled; // false for regular files (epoll refuses them, but reading them never blocks)
+	bool paced = false;
+	long long last = -OUTPUT_SPACING_NS; // last output or input, like in the dispatcher
+	long long due_output;
+	struct epoll_event event, ready[5]; // 4 descriptors + stdin when it's a regular file
+	struct signalfd_siginfo info;
+	uint64_t expirations;
+	sigset_t signals;
+	ssize_t bytes;
+	int epoll, timer_events, timer_output, signal_fd, stdin_flags;
+	int n, k;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	if (stats) {
+		sigaddset(&signals, SIGUSR1);
+	}
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+	epoll = epoll_create1(EPOLL_CLOEXEC);
+	timer_events = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	timer_output = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (epoll == -1 || timer_events == -1 || timer_output == -1 || signal_fd == -1) {
+		fprintf(stderr, "Can't start the reactor: %s\n", strerror(errno));
+		return 1;
+	}
+	event.events = EPOLLIN;
+	event.data.fd = timer_events;
+	epoll_ctl(epoll, EPOLL_CTL_ADD, timer_events, &event);
+	event.data.fd = timer_output;
+	epoll_ctl(epoll, EPOLL_CTL_ADD, timer_output, &event);
+	event.data.fd = signal_fd;
+	epoll_ctl(epoll, EPOLL_CTL_ADD, signal_fd, &event);
+	stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
+	fcntl(STDIN_FILENO, F_SETFL, stdin_flags | O_NONBLOCK);
+	event.data.fd = STDIN_FILENO;
+	stdin_polled = (epoll_ctl(epoll, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0);
+
+	output("Please input some time: \n");
+	reactor_arm(timer_events, reactor_schedule());
+	while (1) {
+		// Granny's questions and answers, as many as there are complete words
+		while (!stop && (j >= 0 ? reactor_token(input, &length, closed, answer, 3) : reactor_token(input, &length, closed, hour_user, 5))) {
+			output_mark(); // so that granny can observe 3 seconds from her input
+			if (j >= 0) {
+				reply(j, day, answer);
+				j = -1;
+			}
+			else if ((j = ask(hour_user, &day)) >= 0) {
+				continue; // waiting for her answer
+			}
+			output("Please input some time: \n");
+		}
+		if (closed && !scheduler_stop) { // end of input: stop the agenda, like main does
+			scheduler_stop = true;
+			reactor_arm(timer_events, -1);
+		}
+		output_sinks();
+		due_output = output_print(&last, paced);
+		if (stop) { // signal: what's still queued is printed right away
+			while (due_output != -1) {
+				last = -OUTPUT_SPACING_NS;
+				due_output = output_print(&last, true);
+			}
+			break;
+		}
+		paced = (due_output != -1);
+		reactor_arm(timer_output, due_output);
+		if (closed && due_output == -1) { // everything was printed
+			break;
+		}
+
+		n = epoll_wait(epoll, ready, 4, (!stdin_polled && !closed) ? 0 : -1);
+		atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+		if (n == -1 && errno != EINTR) {
+			fprintf(stderr, "epoll_wait: %s\n", strerror(errno));
+			break;
+		}
+		if (n == -1) {
+			n = 0;
+		}
+		if (!stdin_polled && !closed) { // regular file: read it as if epoll said so
+			ready[n++].data.fd = STDIN_FILENO;
+		}
+		for (k = 0; k < n; k++) {
+			if (ready[k].data.fd == STDIN_FILENO) {
+				bytes = read(STDIN_FILENO, input + length, sizeof(input) - length);
+				if (bytes > 0) {
+					length += bytes;
+				}
+				else if (bytes == 0 || (errno != EAGAIN && errno != EINTR)) {
+					closed = true;
+					if (stdin_polled) {
+						epoll_ctl(epoll, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+					}
+				}
+			}
+			else if (ready[k].data.fd == timer_events) {
+				while (read(timer_events, &expirations, sizeof(expirations)) > 0) {
+				}
+				reactor_arm(timer_events, reactor_schedule());
+			}
+			else if (ready[k].data.fd == timer_output) {
+				while (read(timer_output, &expirations, sizeof(expirations)) > 0) {
+				}
+			}
+			else if (ready[k].data.fd == signal_fd) {
+				while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+					if (info.ssi_signo == SIGUSR1) {
+						stats_print(stderr, stats);
+					}
+					else {
+						stop = true;
+					}
+				}
+			}
+		}
+	}
+	fcntl(STDIN_FILENO, F_SETFL, stdin_flags);
+	close(signal_fd);
+	close(timer_output);
+	close(timer_events);
+	close(epoll);
+	sigprocmask(SIG_UNBLOCK, &signals, NULL);
+	return 0;
+}
+
+int schedule_find(const struct schedule *sch, int minute_of_day) {
+// Same answer as the lookup table (the later activity wins if they overlap), for schedules without one
+	int i, found = -1;
+	for (i = 0; i < sch->count; i++) {
+		if (sch->start[i] <= sch->end[i] ? (minute_of_day >= sch->start[i] && minute_of_day <= sch->end[i])
+		    : (minute_of_day >= sch->start[i] || minute_of_day <= sch->end[i])) {
+			found = i;
+		}
+	}
+	return found;
+}
+
+int engine_init(struct engine *e, struct agenda *agendas, int count, int shards) {
+	pthread_condattr_t cond_attr;
+	long long now = internal_now();
+	int k;
+	memset(e, 0, sizeof(*e));
+	e->agendas = agendas;
+	e->count = count;
+	e->shards_count = shards;
+	e->shards = calloc(shards, sizeof(*e->shards));
+	if (e->shards == NULL) {
+		return -1;
+	}
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	for (k = 0; k < shards; k++) {
+		pthread_mutex_init(&e->shards[k].mutex, NULL);
+		pthread_cond_init(&e->shards[k].cond, &cond_attr);
+		wheel_init(&e->shards[k].wheel, now);
+		e->shards[k].engine = e;
+		e->shards[k].index = k;
+	}
+	pthread_condattr_destroy(&cond_attr);
+	for (k = 0; k < count; k++) {
+		if (!agenda_build(&agendas[k], &e->shards[k % shards].wheel, now)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void engine_start(struct engine *e) {
+	int k;
+	for (k = 0; k < e->shards_count; k++) {
+		pthread_create(&e->shards[k].thread, NULL, engine_worker, &e->shards[k]);
+	}
+}
+
+bool engine_submit(struct engine *e, struct query *q) {
+	struct shard *home = &e->shards[q->agenda % e->shards_count];
+	struct shard *idle;
+	unsigned pending;
+	int k;
+	pthread_mutex_lock(&home->mutex);
+	pending = home->tail - home->head;
+	if (pending == ENGINE_QUEUE) {
+		pthread_mutex_unlock(&home->mutex);
+		return false;
+	}
+	home->queue[home->tail++ & (ENGINE_QUEUE - 1)] = q;
+	pthread_cond_signal(&home->cond);
+	pthread_mutex_unlock(&home->mutex);
+	if (pending + 1 > ENGINE_STEAL) { // a burst: wake up one sleeping worker to help
+		for (k = 1; k < e->shards_count; k++) {
+			idle = &e->shards[(home->index + k) % e->shards_count];
+			if (atomic_load_explicit(&idle->sleeping, memory_order_relaxed)) {
+				pthread_mutex_lock(&idle->mutex);
+				pthread_cond_signal(&idle->cond);
+				pthread_mutex_unlock(&idle->mutex);
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+void engine_stop(struct engine *e) {
+	int k;
+	atomic_store(&e->stop, true);
+	for (k = 0; k < e->shards_count; k++) {
+		pthread_mutex_lock(&e->shards[k].mutex);
+		pthread_cond_signal(&e->shards[k].cond);
+		pthread_mutex_unlock(&e->shards[k].mutex);
+	}
+	for (k = 0; k < e->shards_count; k++) {
+		pthread_join(e->shards[k].thread, NULL);
+	}
+}
+
+void engine_free(struct engine *e) {
+	int k;
+	for (k = 0; k < e->shards_count; k++) {
+		pthread_mutex_destroy(&e->shards[k].mutex);
+		pthread_cond_destroy(&e->shards[k].cond);
+	}
+	free(e->shards);
+	e->shards = NULL;
+}
+
+void engine_answer(struct engine *e, struct query *q) {
+// Like ask() + reply() for one agenda of the engine
+	struct agenda *a = &e->agendas[q->agenda];
+	struct shard *home = &e->shards[q->agenda % e->shards_count];
+	struct event *warning;
+	uint32_t day = 0;
+	q->activity = schedule_find(a->sch, q->minute);
+	if (q->activity >= 0) {
+		day = schedule_occurrence(a->sch, q->activity, internal_now());
+	}
+	q->done = (q->activity >= 0 && schedule_state(a->sch, q->activity, day, FLAG_DONE));
+	if (q->activity >= 0 && !q->done && q->yes && schedule_transition(a->sch, q->activity, day, FLAG_DONE)) {
+		warning = &a->events[q->activity*3 + EVENT_WARNING];
+		pthread_mutex_lock(&home->mutex);
+		if (warning->pprev && warning->day == day) { // still pending
+			wheel_cancel(&home->wheel, warning);
+			atomic_fetch_add_explicit(&home->cancelled, 1, memory_order_relaxed);
+		}
+		pthread_mutex_unlock(&home->mutex);
+	}
+	q->complete(q);
+}
+
+int engine_steal(struct engine *e, struct shard *thief, struct query **batch) {
+// Takes (the newest) half of the first queue with something in it, at most ENGINE_BATCH queries
+	struct shard *victim;
+	unsigned pending;
+	int k, m, n = 0;
+	for (k = 1; k < e->shards_count && n == 0; k++) {
+		victim = &e->shards[(thief->index + k) % e->shards_count];
+		// A queue whose lock is taken is skipped rather than waited for: its worker (or a submitter) is at it
+		if (pthread_mutex_trylock(&victim->mutex) != 0) {
+			continue;
+		}
+		pending = victim->tail - victim->head;
+		n = (pending + 1) / 2;
+		if (n > ENGINE_BATCH) {
+			n = ENGINE_BATCH;
+		}
+		for (m = 0; m < n; m++) {
+			batch[m] = victim->queue[--victim->tail & (ENGINE_QUEUE - 1)];
+		}
+		pthread_mutex_unlock(&victim->mutex);
+	}
+	return n;
+}
+
+void *engine_worker(void *arg) {
+// Same loop as the scheduler thread, plus the queries of its shard (or stolen from another one)
+	struct shard *s = arg;
+	struct engine *e = s->engine;
+	struct query *batch[ENGINE_BATCH];
+	struct timespec deadline;
+	struct event *ev;
+	struct event *next;
+	long long next_ms;
+	int n, k;
+
+	pthread_mutex_lock(&s->mutex);
+	while (!atomic_load(&e->stop)) {
+		next_ms = wheel_next(&s->wheel);
+		if (next_ms != -1 && internal_now() < next_ms && speed_max && s->head == s->tail) {
+			clock_jump(next_ms);
+		}
+		if (next_ms != -1 && internal_now() >= next_ms) { // due events first
+			ev = wheel_expire(&s->wheel, internal_now());
+			pthread_mutex_unlock(&s->mutex);
+			for (; ev; ev = next) {
+				next = ev->next;
+				fire(ev);
+				s->fired++;
+			}
+			pthread_mutex_lock(&s->mutex);
+			continue;
+		}
+		if (s->head != s->tail) { // then its own queries, oldest first
+			for (n = 0; n < ENGINE_BATCH && s->head != s->tail; n++) {
+				batch[n] = s->queue[s->head++ & (ENGINE_QUEUE - 1)];
+			}
+		}
+		else { // or someone else's
+			pthread_mutex_unlock(&s->mutex);
+			n = engine_steal(e, s, batch);
+			s->stolen += n;
+			pthread_mutex_lock(&s->mutex);
+			if (n == 0) {
+				if (s->head != s->tail || atomic_load(&e->stop)) { // queued while it was stealing
+					continue;
+				}
+				atomic_store_explicit(&s->sleeping, true, memory_order_relaxed);
+				if (next_ms == -1) {
+					pthread_cond_wait(&s->cond, &s->mutex);
+				}
+				else {
+					deadline = internal_to_monotonic(next_ms);
+					pthread_cond_timedwait(&s->cond, &s->mutex, &deadline);
+				}
+				atomic_store_explicit(&s->sleeping, false, memory_order_relaxed);
+				continue;
+			}
+		}
+		pthread_mutex_unlock(&s->mutex);
+		for (k = 0; k < n; k++) {
+			engine_answer(e, batch[k]);
+		}
+		s->answered += n;
+		atomic_fetch_add_explicit(&e->answered, n, memory_order_relaxed);
+		pthread_mutex_lock(&s->mutex);
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return 0;
+}
+
+void server_answer(const struct server_request *request, struct server_response *response) {
+// PHASE 1 with the lookup table, then the acknowledgement like reply() does for a "yes"
+	uint32_t day = 0;
+	int j = (request->minute < 24*60) ? agenda_lookup(&live, request->minute, internal_now(), &day) : -1;
+	int f;
+	response->status = STATUS_OK;
+	response->flags = 0;
+	response->activity = 0xffff;
+	response->start = response->end = 0;
+	if ((request->op != OP_LOOKUP && request->op != OP_ACK) || request->minute >= 24*60) {
+		response->status = STATUS_BAD_REQUEST;
+		return;
+	}
+	if (j < 0) {
+		response->status = STATUS_NONE;
+		return;
+	}
+	if (request->op == OP_ACK) {
+		if (!acknowledge(j, day)) {
+			response->status = STATUS_ALREADY_DONE;
+		}
+	}
+	response->activity = j;
+	response->start = acts.start[j];
+	response->end = acts.end[j];
+	for (f = 0; f < ACTIVITY_FLAGS; f++) {
+		response->flags |= schedule_state(&acts, j, day, f) << f;
+	}
+}
+
+bool server_flush(struct connection *c) {
+	ssize_t bytes;
+	while (c->out_sent < c->out_length) {
+		bytes = send(c->fd, c->out + c->out_sent, c->out_length - c->out_sent, MSG_NOSIGNAL);
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK; // socket buffer full: the rest goes with EPOLLOUT
+		}
+		c->out_sent += bytes;
+	}
+	c->out_length = c->out_sent = 0;
+	return true;
+}
+
+bool server_serve(struct connection *c) {
+// One receive, every complete request answered into the send buffer, one send. Only called when everything
+// answered before has been sent, so there's always room for the responses.
+	ssize_t bytes = recv(c->fd, c->in + c->in_length, SERVER_IN - c->in_length, 0);
+	size_t n, k;
+	if (bytes <= 0) {
+		return bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+	}
+	c->in_length += bytes;
+	n = c->in_length / sizeof(struct server_request);
+	for (k = 0; k < n; k++) {
+		server_answer((const struct server_request *)c->in + k, (struct server_response *)c->out + k);
+	}
+	c->out_length = n * sizeof(struct server_response);
+	c->in_length -= n * sizeof(struct server_request);
+	memmove(c->in, c->in + n * sizeof(struct server_request), c->in_length); // at most 3 bytes
+	atomic_fetch_add_explicit(&server_requests, n, memory_order_relaxed);
+	return server_flush(c);
+}
+
+int server_start(const char *path) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(address.sun_path, path);
+	unlink(path); // left by a previous run
+	server_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	server_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (server_listener == -1 || server_wakeup == -1 || bind(server_listener, (struct sockaddr *)&address, sizeof(address)) == -1
+	    || listen(server_listener, SOMAXCONN) == -1) {
+		fprintf(stderr, "Can't serve on %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	pthread_create(&thread_server, NULL, server, NULL);
+	return 0;
+}
+
+void server_stop(const char *path) {
+	uint64_t one = 1;
+	if (write(server_wakeup, &one, sizeof(one)) == sizeof(one)) {
+		pthread_join(thread_server, NULL);
+	}
+	close(server_listener);
+	close(server_wakeup);
+	unlink(path);
+}
+
+void *server(void *arg) {
+// Level triggered: a connection is watched for EPOLLIN while its responses are sent, EPOLLOUT while they aren't
+	struct epoll_event event, ready[SERVER_EVENTS];
+	struct connection *c;
+	int epoll = epoll_create1(EPOLL_CLOEXEC);
+	int n, k, fd;
+	bool alive;
+	(void)arg;
+	event.events = EPOLLIN;
+	event.data.ptr = NULL; // the listener
+	epoll_ctl(epoll, EPOLL_CTL_ADD, server_listener, &event);
+	event.data.ptr = &server_wakeup;
+	epoll_ctl(epoll, EPOLL_CTL_ADD, server_wakeup, &event);
+	while (1) {
+		n = epoll_wait(epoll, ready, SERVER_EVENTS, -1);
+		for (k = 0; k < n; k++) {
+			if (ready[k].data.ptr == &server_wakeup) {
+				close(epoll); // the connections still open are closed when the process exits
+				return 0;
+			}
+			if (ready[k].data.ptr == NULL) { // new clients
+				while ((fd = accept(server_listener, NULL, NULL)) != -1) {
+					fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+					c = malloc(sizeof(*c));
+					if (c == NULL) {
+						close(fd);
+						continue;
+					}
+					c->fd = fd;
+					c->in_length = c->out_length = c->out_sent = 0;
+					c->watching = event.events = EPOLLIN;
+					event.data.ptr = c;
+					epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+					atomic_fetch_add_explicit(&server_clients, 1, memory_order_relaxed);
+				}
+				continue;
+			}
+			c = ready[k].data.ptr;
+			if (c->out_length) { // EPOLLOUT: the rest of the responses
+				alive = server_flush(c);
+			}
+			else {
+				alive = server_serve(c);
+			}
+			if (!alive || (ready[k].events & (EPOLLERR | EPOLLHUP) && !(ready[k].events & (EPOLLIN | EPOLLOUT)))) {
+				close(c->fd); // also removes it from epoll
+				free(c);
+				continue;
+			}
+			if ((c->out_length ? EPOLLOUT : EPOLLIN) != c->watching) {
+				c->watching = event.events = c->out_length ? EPOLLOUT : EPOLLIN;
+				event.data.ptr = c;
+				epoll_ctl(epoll, EPOLL_CTL_MOD, c->fd, &event);
+			}
+		}
+	}
+}
+
+int load_connect(const char *path) {
+	struct sockaddr_un address;
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	if (fd == -1 || connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+		if (fd != -1) {
+			close(fd);
+		}
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+void histogram_merge(struct histogram *into, const struct histogram *h) {
+	int k;
+	for (k = 0; k < HISTOGRAM_BUCKETS; k++) {
+		into->buckets[k] += h->buckets[k];
+	}
+	into->count += h->count;
+	into->sum += h->sum;
+	if (h->max > into->max) {
+		into->max = h->max;
+	}
+}
+
+void *load_thread(void *arg) {
+// Every client sends LOAD_DEPTH requests, then one more each time a response comes back (all of them in one send),
+// until the end of the run; the latency of a request goes from its send to its response
+	struct load_thread *t = arg;
+	struct load_client *clients = calloc(t->clients, sizeof(*clients));
+	struct server_request requests[LOAD_DEPTH];
+	struct epoll_event event, ready[SERVER_EVENTS];
+	struct load_client *c;
+	int epoll = epoll_create1(EPOLL_CLOEXEC);
+	int i, k, n, m, r;
+	ssize_t bytes;
+	long long now;
+	bool running = true;
+	if (clients == NULL) {
+		t->errors++;
+		return 0;
+	}
+	for (i = 0; i < t->clients; i++) {
+		clients[i].fd = load_connect(t->path);
+		if (clients[i].fd == -1) {
+			t->errors++;
+			continue;
+		}
+		event.events = EPOLLIN;
+		event.data.ptr = &clients[i];
+		epoll_ctl(epoll, EPOLL_CTL_ADD, clients[i].fd, &event);
+	}
+	for (i = 0; i < t->clients; i++) { // fill the pipelines
+		c = &clients[i];
+		if (c->fd == -1) {
+			continue;
+		}
+		for (k = 0; k < LOAD_DEPTH; k++) {
+			requests[k] = (struct server_request){ (bench_random(&t->seed) % 10) ? OP_LOOKUP : OP_ACK, 0, bench_random(&t->seed) % 1440 };
+			c->sent_ns[k] = bench_ns(CLOCK_MONOTONIC);
+		}
+		if (send(c->fd, requests, sizeof(requests), MSG_NOSIGNAL) != sizeof(requests)) {
+			t->errors++;
+			continue;
+		}
+		c->in_flight = LOAD_DEPTH;
+	}
+	while (1) {
+		n = epoll_wait(epoll, ready, SERVER_EVENTS, 100);
+		now = bench_ns(CLOCK_MONOTONIC);
+		running = running && now < t->until_ns;
+		for (k = 0; k < n; k++) {
+			c = ready[k].data.ptr;
+			bytes = recv(c->fd, c->in + c->in_length, sizeof(c->in) - c->in_length, 0);
+			if (bytes <= 0) {
+				if (bytes == 0 || (errno != EAGAIN && errno != EINTR)) {
+					t->errors++;
+					epoll_ctl(epoll, EPOLL_CTL_DEL, c->fd, NULL);
+					c->in_flight = 0;
+				}
+				continue;
+			}
+			c->in_length += bytes;
+			m = c->in_length / sizeof(struct server_response);
+			for (r = 0; r < m; r++) {
+				histogram_add(&t->latency_ns, now - c->sent_ns[c->sent_head]);
+				c->sent_head = (c->sent_head + 1) % LOAD_DEPTH;
+				if (running) { // replaced by a new request, in the slot that was just freed
+					requests[r] = (struct server_request){ (bench_random(&t->seed) % 10) ? OP_LOOKUP : OP_ACK, 0, bench_random(&t->seed) % 1440 };
+					c->sent_ns[(c->sent_head + LOAD_DEPTH - 1) % LOAD_DEPTH] = now;
+				}
+			}
+			t->answered += m;
+			c->in_length -= m * sizeof(struct server_response);
+			memmove(c->in, c->in + m * sizeof(struct server_response), c->in_length);
+			if (!running) {
+				c->in_flight -= m;
+			}
+			else if (m && send(c->fd, requests, m * sizeof(struct server_request), MSG_NOSIGNAL) != (ssize_t)(m * sizeof(struct server_request))) {
+				t->errors++; // never happens with LOAD_DEPTH requests of 4 bytes in flight
+			}
+		}
+		if (!running) { // wait for the responses still in flight
+			for (i = 0; i < t->clients && clients[i].in_flight == 0; i++) {
+			}
+			if (i == t->clients || now > t->until_ns + 5000000000LL) {
+				break;
+			}
+		}
+	}
+	for (i = 0; i < t->clients; i++) {
+		if (clients[i].fd != -1) {
+			close(clients[i].fd);
+		}
+	}
+	close(epoll);
+	free(clients);
+	return 0;
+}
+
+int load_generate(const char *path, int clients, int seconds, bool quiet) {
+// Returns 0 if every client got all its answers
+	struct load_thread threads[LOAD_THREADS];
+	pthread_t ids[LOAD_THREADS];
+	struct histogram latency;
+	long long answered = 0, t0, t1;
+	int k, errors = 0;
+	memset(&latency, 0, sizeof(latency));
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (k = 0; k < LOAD_THREADS; k++) {
+		memset(&threads[k], 0, sizeof(threads[k]));
+		threads[k].path = path;
+		threads[k].clients = clients / LOAD_THREADS + (k < clients % LOAD_THREADS);
+		threads[k].until_ns = t0 + seconds * 1000000000LL;
+		threads[k].seed = 88172645463325252ULL + k * 7919;
+		pthread_create(&ids[k], NULL, load_thread, &threads[k]);
+	}
+	for (k = 0; k < LOAD_THREADS; k++) {
+		pthread_join(ids[k], NULL);
+		histogram_merge(&latency, &threads[k].latency_ns);
+		answered += threads[k].answered;
+		errors += threads[k].errors;
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	if (!quiet) {
+		printf("%d clients, %d requests in flight each: %.0f queries/s\n", clients, LOAD_DEPTH, answered / ((t1 - t0) / 1e9));
+		printf("latency (us): p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f (%d errors)\n", histogram_percentile(&latency, 50) / 1e3,
+			histogram_percentile(&latency, 99) / 1e3, histogram_percentile(&latency, 99.9) / 1e3, latency.max / 1e3, errors);
+	}
+	else {
+		printf("%8d %14.0f %12.1f %12.1f %12.1f %12.1f %8d\n", clients, answered / ((t1 - t0) / 1e9), histogram_percentile(&latency, 50) / 1e3,
+			histogram_percentile(&latency, 99) / 1e3, histogram_percentile(&latency, 99.9) / 1e3, latency.max / 1e3, errors);
+	}
+	return errors ? 1 : 0;
+}
+
+void batch_match(const struct schedule *sch, const int16_t *minutes, int16_t *found, size_t n) {
+// found[k]: activity at minutes[k] (-1: none), n a multiple of BATCH_LANES. Minutes are below 1440 so signed 16 bit
+// compares are enough (SSE2 has no unsigned ones); out of range minutes (eg. -1) never match.
+	batch_vector m, in, result, start, end;
+	batch_vector zero = {0};
+	batch_vector day = zero + 24*60;
+	size_t k;
+	int i;
+	for (k = 0; k < n; k += BATCH_LANES) {
+		memcpy(&m, minutes + k, sizeof(m));
+		result = zero - 1;
+		for (i = 0; i < sch->count; i++) {
+			start = zero + sch->start[i];
+			end = zero + sch->end[i];
+			if (sch->start[i] <= sch->end[i]) {
+				in = (m >= start) & (m <= end);
+			}
+			else { // past midnight, eg. 23:00 - 6:00 am
+				in = ((m >= start) & (m < day)) | ((m >= zero) & (m <= end));
+			}
+			result = (result & ~in) | (in & (zero + (int16_t)i)); // the later activity wins
+		}
+		memcpy(found + k, &result, sizeof(result));
+	}
+}
+
+int batch_epoch_minute(long long epoch) {
+// localtime_r() once per hour of input (DST changes happen on hour boundaries), the rest is arithmetic
+	static long long hour_start = -1;
+	static int hour_minute;
+	time_t raw = epoch;
+	struct tm local;
+	if (hour_start < 0 || epoch < hour_start || epoch >= hour_start + 3600) {
+		localtime_r(&raw, &local);
+		hour_start = epoch - local.tm_min*60 - local.tm_sec;
+		hour_minute = local.tm_hour*60;
+	}
+	return hour_minute + (int)((epoch - hour_start) / 60);
+}
+
+bool write_all(int fd, const void *buffer, size_t length) {
+	const char *p = buffer;
+	ssize_t bytes;
+	while (length > 0) {
+		bytes = write(fd, p, length);
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += bytes;
+		length -= bytes;
+	}
+	return true;
+}
+
+int batch_run(int in_fd, int out_fd) {
+// Read a big chunk, answer its complete lines a block at a time (their text is still in the input buffer when the
+// answers are written), keep the incomplete last line for the next chunk
+	char *in = malloc(BATCH_READ);
+	char *out = malloc(BATCH_WRITE);
+	int16_t *minutes = malloc(BATCH_BLOCK * sizeof(*minutes));
+	int16_t *matched = malloc(BATCH_BLOCK * sizeof(*matched)); // by the vectors (up to BATCH_VECTOR_MAX activities)
+	int32_t *found = malloc(BATCH_BLOCK * sizeof(*found)); // (the lookup table has any index)
+	const char **lines = malloc(BATCH_BLOCK * sizeof(*lines));
+	int *lengths = malloc(BATCH_BLOCK * sizeof(*lengths));
+	size_t *name_lengths = malloc(acts.count * sizeof(*name_lengths));
+	bool vectors = (acts.count <= BATCH_VECTOR_MAX);
+	size_t length = 0, out_length = 0, name_max = 1, name_length, done, k, n;
+	ssize_t bytes = 1;
+	const char *p, *line, *line_end, *chunk_end;
+	const char *name;
+	long long epoch;
+	int i, minute, result = 0;
+	if (!in || !out || !minutes || !matched || !found || !lines || !lengths || !name_lengths) {
+		fprintf(stderr, "Not enough memory for the batch buffers\n");
+		result = 1;
+		goto done;
+	}
+	for (i = 0; i < acts.count; i++) {
+		name_lengths[i] = strlen(schedule_name(&acts, i));
+		if (name_lengths[i] > name_max) {
+			name_max = name_lengths[i];
+		}
+	}
+	if (!vectors) {
+		build_lookup();
+	}
+	while (bytes > 0) {
+		bytes = read(in_fd, in + length, BATCH_READ - length);
+		if (bytes == -1) {
+			if (errno == EINTR) {
+				bytes = 1;
+				continue;
+			}
+			fprintf(stderr, "Can't read the times: %s\n", strerror(errno));
+			result = 1;
+			break;
+		}
+		length += bytes;
+		if (bytes == 0 && length > 0 && in[length - 1] != '\n') { // last line without a newline
+			if (length < BATCH_READ) {
+				in[length++] = '\n';
+			}
+			else { // no room for it: the complete lines first, then read the end of the file again
+				bytes = 1;
+			}
+		}
+		chunk_end = in + length;
+		while (chunk_end > in && chunk_end[-1] != '\n') {
+			chunk_end--;
+		}
+		if (chunk_end == in && length == BATCH_READ) { // a line longer than the buffer: cut it
+			fprintf(stderr, "Line longer than %d bytes, cut: the rest is read as another line\n", BATCH_READ - 1);
+			in[length - 1] = '\n';
+			chunk_end = in + length;
+		}
+		p = in;
+		while (p < chunk_end) {
+			// Parse up to a block of lines
+			for (n = 0; n < BATCH_BLOCK && p < chunk_end; p = line_end + 1) {
+				line = p;
+				line_end = memchr(p, '\n', chunk_end - p);
+				lengths[n] = (int)(line_end - line) - (line_end > line && line_end[-1] == '\r');
+				if (lengths[n] == 0) {
+					continue;
+				}
+				lines[n] = line;
+				minute = -2; // not a time
+				if (memchr(line, ':', lengths[n])) {
+					if (!parse_time(&line, line + lengths[n], &minute) || line != lines[n] + lengths[n]) {
+						minute = -2;
+					}
+				}
+				else {
+					for (epoch = 0, k = 0; k < (size_t)lengths[n] && line[k] >= '0' && line[k] <= '9' && k < 18; k++) {
+						epoch = epoch*10 + (line[k] - '0');
+					}
+					if (k == (size_t)lengths[n]) {
+						minute = batch_epoch_minute(epoch);
+					}
+				}
+				minutes[n++] = minute;
+			}
+			// Match them
+			if (vectors) {
+				for (k = n; k % BATCH_LANES; k++) {
+					minutes[k] = -2;
+				}
+				batch_match(&acts, minutes, matched, k);
+				for (k = 0; k < n; k++) {
+					found[k] = matched[k];
+				}
+			}
+			else {
+				for (k = 0; k < n; k++) {
+					found[k] = (minutes[k] >= 0) ? lookup_table[minutes[k]] : -1;
+				}
+			}
+			// Write the answers
+			for (k = 0; k < n; k++) {
+				if (out_length + lengths[k] + name_max + 2 > BATCH_WRITE) {
+					if (!write_all(out_fd, out, out_length)) {
+						fprintf(stderr, "Can't write the answers: %s\n", strerror(errno));
+						result = 1;
+						goto done;
+					}
+					out_length = 0;
+				}
+				if (lengths[k] + name_max + 2 > BATCH_WRITE) { // absurdly long line: only its start is echoed
+					lengths[k] = BATCH_WRITE - name_max - 2;
+				}
+				memcpy(out + out_length, lines[k], lengths[k]);
+				out_length += lengths[k];
+				out[out_length++] = '\t';
+				if (minutes[k] == -2) {
+					name = "?";
+					name_length = 1;
+				}
+				else if (found[k] < 0) {
+					name = "-";
+					name_length = 1;
+				}
+				else {
+					name = schedule_name(&acts, found[k]);
+					name_length = name_lengths[found[k]];
+				}
+				memcpy(out + out_length, name, name_length);
+				out_length += name_length;
+				out[out_length++] = '\n';
+			}
+		}
+		done = chunk_end - in;
+		memmove(in, chunk_end, length - done);
+		length -= done;
+	}
+	if (out_length && !write_all(out_fd, out, out_length)) {
+		fprintf(stderr, "Can't write the answers: %s\n", strerror(errno));
+		result = 1;
+	}
+done:
+	free(in);
+	free(out);
+	free(minutes);
+	free(matched);
+	free(found);
+	free(lines);
+	free(lengths);
+	free(name_lengths);
+	return result;
+}
+
+uint32_t journal_fingerprint(const struct schedule *sch) {
+// The times, names and rules (a schedule where every activity is daily hashes like before rules existed)
+	const struct rule *rule;
+	uint32_t hash = 2166136261u, k;
+	int i;
+	for (i = 0; i < sch->count; i++) {
+		hash = (hash ^ ((uint32_t)sch->start[i] << 16 | sch->end[i])) * 16777619u;
+		hash = (hash ^ schedule_hash(schedule_name(sch, i), strlen(schedule_name(sch, i)))) * 16777619u;
+		if (schedule_start_ms(sch, i) || schedule_end_ms(sch, i)) { // (same for whole minutes as before)
+			hash = (hash ^ ((uint32_t)schedule_start_ms(sch, i) << 16 | schedule_end_ms(sch, i))) * 16777619u;
+		}
+		if (sch->rule[i] == 0) {
+			continue;
+		}
+		rule = &sch->rules[sch->rule[i]];
+		hash = (hash ^ ((uint32_t)rule->kind << 24 | (uint32_t)rule->weekdays << 16 | rule->every)) * 16777619u;
+		for (k = 0; k < (rule->kind == RULE_DATES ? rule->count : 1); k++) {
+			hash = (hash ^ (rule->kind == RULE_DATES ? sch->dates[rule->first + k] : rule->first)) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+uint32_t journal_check(const struct journal_record *r) {
+	uint64_t x = ((uint64_t)r->activity << 32 | r->day) ^ ((uint64_t)r->flag << 48) ^ ((uint64_t)r->reserved << 16);
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL; // murmur3 finalizer
+	x ^= x >> 33;
+	return (uint32_t)x ^ JOURNAL_MAGIC;
+}
+
+struct journal_record journal_make(uint32_t activity, uint32_t day, int flag) {
+	struct journal_record r = { 0, activity, day, (uint16_t)flag, 0 };
+	r.check = journal_check(&r);
+	return r;
+}
+
+int journal_open(struct journal *j, const char *path, struct schedule *sch, uint32_t day) {
+// Replay the file into the states of sch (before anything else uses them), then journal its transitions. day is
+// today: the records of older occurrences than yesterday's are stale.
+	const struct journal_record *file = MAP_FAILED;
+	const struct journal_record *record;
+	struct journal_record header;
+	struct stat info;
+	long long t0 = bench_ns(CLOCK_MONOTONIC);
+	long long n = 0, valid, stale = 0;
+	uint32_t word;
+	bool compact;
+
+	memset(j, 0, sizeof(*j));
+	j->path = path;
+	j->sch = sch;
+	j->day = day;
+	j->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (j->fd == -1 || fstat(j->fd, &info) == -1) {
+		fprintf(stderr, "Can't open the journal %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	n = info.st_size / sizeof(struct journal_record);
+	if (n > 0) {
+		file = mmap(NULL, n * sizeof(struct journal_record), PROT_READ, MAP_PRIVATE, j->fd, 0);
+		if (file == MAP_FAILED) {
+			fprintf(stderr, "Can't map the journal %s: %s\n", path, strerror(errno));
+			close(j->fd);
+			return -1;
+		}
+		madvise((void *)file, n * sizeof(struct journal_record), MADV_SEQUENTIAL);
+	}
+	j->count = sch->count;
+	j->fingerprint = journal_fingerprint(sch);
+	header = journal_make(j->count, j->fingerprint, JOURNAL_SCHEDULE);
+	valid = 0;
+	if (n > 0 && !memcmp(&file[0], &header, sizeof(header))) {
+		for (valid = 1; valid < n; valid++) {
+			if (file[valid].check != journal_check(&file[valid])) { // torn by a crash: everything after it is lost
+				break;
+			}
+			record = &file[valid];
+			if (record->day + 1 < day || record->day > day || record->activity >= (uint32_t)j->count || record->flag >= ACTIVITY_FLAGS) {
+				stale++;
+				continue;
+			}
+			// Like schedule_transition(), without journaling it again: the latest occurrence wins
+			word = atomic_load_explicit(&sch->state[record->activity], memory_order_relaxed);
+			if ((word >> STATE_FLAGS) < record->day) {
+				word = record->day << STATE_FLAGS;
+			}
+			if ((word >> STATE_FLAGS) == record->day) {
+				atomic_store_explicit(&sch->state[record->activity], word | 1u << record->flag, memory_order_relaxed);
+			}
+			j->replayed++;
+		}
+	}
+	else if (n > 0) {
+		fprintf(stderr, "The journal %s was written for another schedule, starting a new one\n", path);
+	}
+	if (file != MAP_FAILED) {
+		munmap((void *)file, n * sizeof(struct journal_record));
+	}
+	if (valid < n || info.st_size % sizeof(struct journal_record)) {
+		if (valid > 0) {
+			fprintf(stderr, "The journal %s ended with a torn record, %lld records dropped\n", path,
+				(long long)((info.st_size - valid * sizeof(struct journal_record) + sizeof(struct journal_record) - 1) / sizeof(struct journal_record)));
+		}
+		if (ftruncate(j->fd, valid * sizeof(struct journal_record)) == -1) {
+			fprintf(stderr, "Can't truncate the journal %s: %s\n", path, strerror(errno));
+			close(j->fd);
+			return -1;
+		}
+	}
+	j->records = valid;
+	compact = (stale > 0 || valid == 0);
+	j->recovery_ns = bench_ns(CLOCK_MONOTONIC) - t0;
+
+	if (compact && journal_compact(j) != 0) { // (also writes the header of a new journal)
+		close(j->fd);
+		return -1;
+	}
+	pthread_mutex_init(&j->mutex, NULL);
+	pthread_cond_init(&j->cond, NULL);
+	sch->journal = j;
+	pthread_create(&j->thread, NULL, journal_writer, j);
+	return 0;
+}
+
+void journal_append(struct journal *j, int activity, uint32_t day, enum activity_flag flag) {
+	struct journal_record *bigger;
+	size_t capacity;
+	pthread_mutex_lock(&j->mutex);
+	if (j->pending_count == j->pending_capacity) { // grows instead of waiting for the journal thread
+		capacity = j->pending_capacity ? j->pending_capacity * 2 : 1024;
+		bigger = realloc(j->pending, capacity * sizeof(*bigger));
+		if (bigger == NULL) {
+			j->lost++;
+			pthread_mutex_unlock(&j->mutex);
+			return;
+		}
+		j->pending = bigger;
+		j->pending_capacity = capacity;
+	}
+	j->pending[j->pending_count++] = journal_make(activity, day, flag);
+	if (day > j->day) { // a new day: yesterday's records are all that's still needed of the ones before
+		j->day = day;
+	}
+	if (j->pending_count == 1) {
+		pthread_cond_signal(&j->cond);
+	}
+	pthread_mutex_unlock(&j->mutex);
+}
+
+long long journal_live(struct journal *j) {
+	long long live = 0;
+	uint32_t word, day;
+	int i;
+	pthread_mutex_lock(&j->mutex);
+	day = j->day;
+	pthread_mutex_unlock(&j->mutex);
+	for (i = 0; i < j->count; i++) {
+		word = atomic_load_explicit(&j->sch->state[i], memory_order_relaxed);
+		if ((word >> STATE_FLAGS) + 1 >= day) {
+			live += __builtin_popcount(word & ((1u << STATE_FLAGS) - 1));
+		}
+	}
+	return live;
+}
+
+int journal_compact(struct journal *j) {
+// Write the flags set now in the occurrences of the latest day and the day before (each one is either set before
+// this snapshot or its record is still to be appended, so nothing is lost) to PATH.compact, make it durable and
+// rename it over the journal
+	struct journal_record *chunk = malloc(JOURNAL_CHUNK * sizeof(*chunk));
+	char temp[4096], directory[4096];
+	const char *slash;
+	long long records = 0;
+	uint32_t word, day;
+	int fd, dir, f, i, n = 0;
+	bool ok = true;
+	if (chunk == NULL) {
+		return -1;
+	}
+	snprintf(temp, sizeof(temp), "%s.compact", j->path);
+	fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		fprintf(stderr, "Can't create %s: %s\n", temp, strerror(errno));
+		free(chunk);
+		return -1;
+	}
+	if (j->thread) {
+		pthread_mutex_lock(&j->mutex);
+		day = j->day;
+		pthread_mutex_unlock(&j->mutex);
+	}
+	else {
+		day = j->day;
+	}
+	chunk[n++] = journal_make(j->count, j->fingerprint, JOURNAL_SCHEDULE);
+	for (i = 0; i < j->count && ok; i++) { // (activities added by live edits aren't journaled)
+		word = atomic_load_explicit(&j->sch->state[i], memory_order_acquire);
+		if ((word >> STATE_FLAGS) + 1 < day) {
+			continue;
+		}
+		for (f = 0; f < ACTIVITY_FLAGS; f++) {
+			if ((word >> f) & 1) {
+				chunk[n++] = journal_make(i, word >> STATE_FLAGS, f);
+			}
+		}
+		if (n > JOURNAL_CHUNK - ACTIVITY_FLAGS) {
+			ok = write_all(fd, chunk, n * sizeof(*chunk));
+			records += n;
+			n = 0;
+		}
+	}
+	ok = ok && write_all(fd, chunk, n * sizeof(*chunk)) && fdatasync(fd) == 0 && rename(temp, j->path) == 0;
+	records += n;
+	free(chunk);
+	if (!ok) {
+		fprintf(stderr, "Can't compact the journal %s: %s\n", j->path, strerror(errno));
+		close(fd);
+		unlink(temp);
+		return -1;
+	}
+	// The rename has to be durable too
+	slash = strrchr(j->path, '/');
+	snprintf(directory, sizeof(directory), "%.*s", slash ? (int)(slash - j->path) + 1 : 1, slash ? j->path : ".");
+	dir = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir != -1) {
+		fsync(dir);
+		close(dir);
+	}
+	close(j->fd);
+	j->fd = fd;
+	j->records = records;
+	j->compactions++;
+	return 0;
+}
+
+void *journal_writer(void *arg) {
+// Takes everything appended since the last commit, writes it and waits for the disk while the next batch fills
+	struct journal *j = arg;
+	struct journal_record *batch;
+	size_t n, capacity;
+	bool stop;
+	pthread_mutex_lock(&j->mutex);
+	while (1) {
+		while (j->pending_count == 0 && !j->stop) {
+			pthread_cond_wait(&j->cond, &j->mutex);
+		}
+		stop = j->stop;
+		n = j->pending_count;
+		batch = j->pending; // swap the batches
+		capacity = j->pending_capacity;
+		j->pending = j->writing;
+		j->pending_capacity = j->writing_capacity;
+		j->pending_count = 0;
+		j->writing = batch;
+		j->writing_capacity = capacity;
+		pthread_mutex_unlock(&j->mutex);
+
+		if (n > 0) {
+			if (write_all(j->fd, batch, n * sizeof(*batch)) && fdatasync(j->fd) == 0) {
+				j->records += n;
+				j->commits++;
+			}
+			else {
+				fprintf(stderr, "Can't write the journal %s: %s\n", j->path, strerror(errno));
+				j->lost += n;
+			}
+			if (j->records > JOURNAL_COMPACT_MIN && j->records > 2 * (journal_live(j) + 1)) {
+				journal_compact(j);
+			}
+		}
+		pthread_mutex_lock(&j->mutex);
+		if (stop && j->pending_count == 0) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&j->mutex);
+	return 0;
+}
+
+void journal_close(struct journal *j) {
+	pthread_mutex_lock(&j->mutex);
+	j->stop = true;
+	pthread_cond_signal(&j->cond);
+	pthread_mutex_unlock(&j->mutex);
+	pthread_join(j->thread, NULL);
+	j->sch->journal = NULL;
+	close(j->fd);
+	free(j->pending);
+	free(j->writing);
+	j->pending = j->writing = NULL;
+	j->pending_capacity = j->writing_capacity = 0;
+}
+
+int history_name(struct history_names *d, const char *name, size_t length, bool add) {
+// Like schedule_intern(), except that the names get consecutive ids
+	uint32_t hash = schedule_hash(name, length);
+	uint32_t k, id, capacity, *slots, *offset;
+	char *text;
+	for (k = hash & (d->slots_capacity - 1); d->slots_capacity && d->slots[k]; k = (k + 1) & (d->slots_capacity - 1)) {
+		id = d->slots[k] - 1;
+		if (!strncmp(d->text + d->offset[id], name, length) && d->text[d->offset[id] + length] == '\0') {
+			return id;
+		}
+	}
+	if (!add) {
+		return -1;
+	}
+	if ((d->count + 1) * 2 > d->slots_capacity) { // double the table and insert the ids again
+		capacity = d->slots_capacity ? d->slots_capacity * 2 : 64;
+		slots = calloc(capacity, sizeof(*slots));
+		if (slots == NULL) {
+			return -1;
+		}
+		for (id = 0; id < d->count; id++) {
+			text = d->text + d->offset[id];
+			for (k = schedule_hash(text, strlen(text)) & (capacity - 1); slots[k]; k = (k + 1) & (capacity - 1)) {
+			}
+			slots[k] = id + 1;
+		}
+		free(d->slots);
+		d->slots = slots;
+		d->slots_capacity = capacity;
+	}
+	if (d->count == d->offset_capacity) {
+		capacity = d->offset_capacity ? d->offset_capacity * 2 : 64;
+		offset = realloc(d->offset, capacity * sizeof(*offset));
+		if (offset == NULL) {
+			return -1;
+		}
+		d->offset = offset;
+		d->offset_capacity = capacity;
+	}
+	if (d->size + length + 1 > d->capacity) {
+		capacity = d->capacity * 2 > d->size + length + 1 ? d->capacity * 2 : d->size + length + 1024;
+		text = realloc(d->text, capacity);
+		if (text == NULL) {
+			return -1;
+		}
+		d->text = text;
+		d->capacity = capacity;
+	}
+	memcpy(d->text + d->size, name, length);
+	d->text[d->size + length] = '\0';
+	d->offset[d->count] = d->size;
+	d->size += length + 1;
+	for (k = hash & (d->slots_capacity - 1); d->slots[k]; k = (k + 1) & (d->slots_capacity - 1)) {
+	}
+	d->slots[k] = d->count + 1;
+	return d->count++;
+}
+
+void history_names_free(struct history_names *d) {
+	free(d->text);
+	free(d->offset);
+	free(d->slots);
+	memset(d, 0, sizeof(*d));
+}
+
+size_t history_size(const struct history_header *header) {
+	return header->names_size + (size_t)header->count * (header->day_bytes + header->id_bytes) + (header->count + 3) / 4 + header->answers_size;
+}
+
+uint32_t history_check(const struct history_header *header, const unsigned char *block) {
+	struct history_header copy = *header;
+	copy.check = 0;
+	return schedule_hash((const char *)&copy, sizeof(copy)) * 16777619u ^ schedule_hash((const char *)block, history_size(header));
+}
+
+unsigned char *history_put(unsigned char *p, uint32_t value, int bytes) {
+	int b;
+	for (b = 0; b < bytes; b++) {
+		*p++ = value >> 8*b;
+	}
+	return p;
+}
+
+uint32_t history_get(const unsigned char *p, int bytes) {
+	uint32_t value = 0;
+	int b;
+	for (b = 0; b < bytes; b++) {
+		value |= (uint32_t)p[b] << 8*b;
+	}
+	return value;
+}
+
+bool history_read(struct history_reader *r, uint32_t from) {
+// false at the end of the file or at a torn / damaged block (r->offset is then where the good blocks end). When the
+// block ends before day from only its names are read (and it isn't checked, only that it's all there).
+	struct history_header *header = &r->header;
+	const char *name, *end;
+	unsigned char *bigger;
+	size_t size, wanted, length;
+	uint32_t k;
+	if (r->offset + (off_t)sizeof(*header) > r->size ||
+	    pread(r->fd, header, sizeof(*header), r->offset) != (ssize_t)sizeof(*header) || header->magic != HISTORY_MAGIC ||
+	    header->count == 0 || header->count > HISTORY_BLOCK || (header->day_bytes != 1 && header->day_bytes != 2) ||
+	    (header->id_bytes != 1 && header->id_bytes != 2 && header->id_bytes != 4)) {
+		return false;
+	}
+	size = history_size(header);
+	if (r->offset + (off_t)(sizeof(*header) + size) > r->size) { // torn
+		return false;
+	}
+	r->columns = (header->first_day + header->span >= from);
+	wanted = r->columns ? size : header->names_size;
+	if (wanted > r->block_capacity) {
+		bigger = realloc(r->block, wanted);
+		if (bigger == NULL) {
+			return false;
+		}
+		r->block = bigger;
+		r->block_capacity = wanted;
+	}
+	if (pread(r->fd, r->block, wanted, r->offset + sizeof(*header)) != (ssize_t)wanted ||
+	    (r->columns && history_check(header, r->block) != header->check)) {
+		return false;
+	}
+	// The new names: all of them have to be there before any is added
+	end = (const char *)r->block + header->names_size;
+	for (k = 0, name = (const char *)r->block; k < header->names; k++, name += length + 1) {
+		length = strnlen(name, end - name);
+		if (name + length == end) {
+			return false;
+		}
+	}
+	for (k = 0, name = (const char *)r->block; k < header->names; k++, name += length + 1) {
+		length = strlen(name);
+		if (history_name(r->names, name, length, true) != (int)r->names->count - 1) { // memory, or seen before
+			return false;
+		}
+	}
+	r->offset += sizeof(*header) + size;
+	return true;
+}
+
+int history_open(struct history *h, const char *path, struct schedule *sch) {
+// Only the names of the blocks already in the file are needed to go on appending to it
+	struct history_reader r;
+	struct stat info;
+	int i;
+	memset(h, 0, sizeof(*h));
+	h->path = path;
+	h->sch = sch;
+	h->count = sch->count;
+	h->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (h->fd == -1 || fstat(h->fd, &info) == -1) {
+		fprintf(stderr, "Can't open the history %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	h->ids = malloc((h->count + 1) * sizeof(*h->ids));
+	h->answered = malloc((h->count + 1) * sizeof(*h->answered));
+	h->pending = malloc(HISTORY_BLOCK * sizeof(*h->pending));
+	if (h->ids == NULL || h->answered == NULL || h->pending == NULL) {
+		fprintf(stderr, "Not enough memory for the history\n");
+		close(h->fd);
+		return -1;
+	}
+	for (i = 0; i < h->count; i++) {
+		h->ids[i] = -1;
+		atomic_init(&h->answered[i], 0);
+	}
+	memset(&r, 0, sizeof(r));
+	r.fd = h->fd;
+	r.size = info.st_size;
+	r.names = &h->names;
+	while (history_read(&r, UINT32_MAX)) {
+		h->outcomes += r.header.count;
+		h->blocks++;
+	}
+	free(r.block);
+	if (r.offset < info.st_size) {
+		fprintf(stderr, "The history %s ended with a torn block, %lld bytes dropped\n", path, (long long)(info.st_size - r.offset));
+		if (ftruncate(h->fd, r.offset) == -1) {
+			fprintf(stderr, "Can't truncate the history %s: %s\n", path, strerror(errno));
+			close(h->fd);
+			return -1;
+		}
+	}
+	h->bytes = r.offset;
+	h->names_written = h->names.count;
+	pthread_mutex_init(&h->mutex, NULL);
+	sch->history = h;
+	return 0;
+}
+
+void history_answer(struct history *h, int i, uint32_t day, long long now) {
+// Kept with the occurrence it's for (day << 32 | ms after its start + 1), until the occurrence is over
+	long long start;
+	unsigned long long delay;
+	if (i >= h->count) {
+		return;
+	}
+	start = ((long long)day - internal_first_day) * 86400000 + h->sch->start[i] * 60000LL + schedule_start_ms(h->sch, i);
+	delay = now > start ? (unsigned long long)(now - start) : 0; // (she can say yes before it starts)
+	if (delay > UINT32_MAX - 1) {
+		delay = UINT32_MAX - 1;
+	}
+	atomic_store_explicit(&h->answered[i], (unsigned long long)day << 32 | (delay + 1), memory_order_relaxed);
+}
+
+void history_record(struct history *h, int i, uint32_t day, bool by_granny) {
+	unsigned long long answered;
+	uint32_t answer = 0;
+	const char *name;
+	int state = 0;
+	if (i >= h->count) { // added by a live edit
+		return;
+	}
+	if (by_granny) {
+		state |= HISTORY_GRANNY;
+		answered = atomic_load_explicit(&h->answered[i], memory_order_relaxed);
+		if (answered >> 32 == day) { // (unknown when she answered before a restart)
+			answer = (uint32_t)answered;
+		}
+	}
+	if (schedule_state(h->sch, i, day, FLAG_WARNED)) {
+		state |= HISTORY_WARNED;
+	}
+	pthread_mutex_lock(&h->mutex);
+	if (h->ids[i] < 0) {
+		name = schedule_name(h->sch, i);
+		h->ids[i] = history_name(&h->names, name, strlen(name), true);
+	}
+	if (h->ids[i] < 0) {
+		h->lost++;
+	}
+	else {
+		history_append(h, h->ids[i], day, state, answer);
+	}
+	pthread_mutex_unlock(&h->mutex);
+}
+
+void history_append(struct history *h, uint32_t id, uint32_t day, int state, uint32_t answer) {
+// (mutex held) A full block, or one whose days wouldn't fit in 2 bytes anymore, is written first
+	uint32_t first = h->pending_first, last = h->pending_last;
+	if (h->pending_count > 0) {
+		first = day < first ? day : first;
+		last = day > last ? day : last;
+		if (h->pending_count == HISTORY_BLOCK || last - first > 65535) {
+			history_flush(h);
+			first = last = day;
+		}
+	}
+	else {
+		first = last = day;
+	}
+	h->pending_first = first;
+	h->pending_last = last;
+	h->pending[h->pending_count++] = (struct history_outcome){ .day = day, .id = id, .answer = answer, .state = state };
+}
+
+bool history_flush(struct history *h) {
+// (mutex held) The pending outcomes as one block of columns (see the adherence history section)
+	struct history_header header;
+	struct history_outcome *o = h->pending;
+	unsigned char *block, *p, *answers;
+	uint32_t max_id = 0, value;
+	int k, n = h->pending_count;
+	bool ok;
+	if (n == 0) {
+		return true;
+	}
+	// Blocks appended after a torn one would never be read (the reader stops at the first bad block)
+	if (h->torn && ftruncate(h->fd, h->bytes) == 0) {
+		h->torn = false;
+	}
+	if (h->torn) {
+		fprintf(stderr, "Can't truncate the history %s: %s\n", h->path, strerror(errno));
+		h->lost += n;
+		h->pending_count = 0;
+		return false;
+	}
+	for (k = 0; k < n; k++) {
+		max_id = o[k].id > max_id ? o[k].id : max_id;
+	}
+	memset(&header, 0, sizeof(header));
+	header.magic = HISTORY_MAGIC;
+	header.count = n;
+	header.first_day = h->pending_first;
+	header.names = h->names.count - h->names_written;
+	header.names_size = header.names ? h->names.size - h->names.offset[h->names_written] : 0;
+	header.span = h->pending_last - h->pending_first;
+	header.day_bytes = (header.span < 256) ? 1 : 2;
+	header.id_bytes = (max_id < 256) ? 1 : (max_id < 65536) ? 2 : 4;
+	block = malloc(sizeof(header) + header.names_size + (size_t)n * (header.day_bytes + header.id_bytes + 5) + (n + 3) / 4);
+	if (block == NULL) {
+		h->lost += n;
+		h->pending_count = 0;
+		return false;
+	}
+	p = block + sizeof(header);
+	if (header.names) {
+		memcpy(p, h->names.text + h->names.offset[h->names_written], header.names_size);
+		p += header.names_size;
+	}
+	for (k = 0; k < n; k++) {
+		p = history_put(p, o[k].day - header.first_day, header.day_bytes);
+	}
+	for (k = 0; k < n; k++) {
+		p = history_put(p, o[k].id, header.id_bytes);
+	}
+	memset(p, 0, (n + 3) / 4);
+	for (k = 0; k < n; k++) {
+		p[k / 4] |= o[k].state << (k % 4 * 2);
+	}
+	p += (n + 3) / 4;
+	for (answers = p, k = 0; k < n; k++) {
+		if (o[k].state & HISTORY_GRANNY) { // LEB128
+			for (value = o[k].answer; value >= 0x80; value >>= 7) {
+				*p++ = (value & 0x7f) | 0x80;
+			}
+			*p++ = value;
+		}
+	}
+	header.answers_size = p - answers;
+	header.check = history_check(&header, block + sizeof(header));
+	memcpy(block, &header, sizeof(header));
+	ok = write_all(h->fd, block, p - block);
+	if (ok) {
+		h->outcomes += n;
+		h->blocks++;
+		h->bytes += p - block;
+		h->names_written = h->names.count;
+	}
+	else { // (the names go with the next block)
+		fprintf(stderr, "Can't write the history %s: %s\n", h->path, strerror(errno));
+		h->lost += n;
+		h->torn = ftruncate(h->fd, h->bytes) == -1; // otherwise tried again before the next block
+	}
+	free(block);
+	h->pending_count = 0;
+	return ok;
+}
+
+void history_close(struct history *h) {
+	pthread_mutex_lock(&h->mutex);
+	history_flush(h);
+	pthread_mutex_unlock(&h->mutex);
+	h->sch->history = NULL;
+	close(h->fd);
+	free(h->ids);
+	free(h->answered);
+	free(h->pending);
+	history_names_free(&h->names);
+	h->ids = NULL;
+	h->answered = NULL;
+	h->pending = NULL;
+}
+
+int history_aggregate(const char *path, uint32_t from, struct history_summary *s) {
+// One pass over the file, a block at a time; only the outcomes of day from and later are counted
+	struct history_reader r;
+	struct history_stats *stats, *bigger;
+	struct stat info;
+	const unsigned char *days, *ids, *states, *answers, *end;
+	uint32_t k, day, id, answer, capacity;
+	int state, shift;
+	memset(s, 0, sizeof(*s));
+	s->first_day = UINT32_MAX;
+	memset(&r, 0, sizeof(r));
+	r.fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (r.fd == -1 || fstat(r.fd, &info) == -1) {
+		fprintf(stderr, "Can't open the history %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	posix_fadvise(r.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	r.size = info.st_size;
+	r.names = &s->names;
+	while (history_read(&r, from)) {
+		s->blocks++;
+		if (!r.columns) {
+			continue;
+		}
+		if (s->names.count > s->stats_capacity) {
+			capacity = s->stats_capacity * 2 > s->names.count ? s->stats_capacity * 2 : s->names.count + 64;
+			bigger = realloc(s->stats, capacity * sizeof(*bigger));
+			if (bigger == NULL) {
+				fprintf(stderr, "Not enough memory for the history of %u activities\n", s->names.count);
+				break;
+			}
+			memset(bigger + s->stats_capacity, 0, (capacity - s->stats_capacity) * sizeof(*bigger));
+			s->stats = bigger;
+			s->stats_capacity = capacity;
+		}
+		days = r.block + r.header.names_size;
+		ids = days + (size_t)r.header.count * r.header.day_bytes;
+		states = ids + (size_t)r.header.count * r.header.id_bytes;
+		answers = states + (r.header.count + 3) / 4;
+		end = answers + r.header.answers_size;
+		for (k = 0; k < r.header.count; k++) {
+			day = r.header.first_day + history_get(days + k * r.header.day_bytes, r.header.day_bytes);
+			id = history_get(ids + k * r.header.id_bytes, r.header.id_bytes);
+			state = states[k / 4] >> (k % 4 * 2) & 3;
+			answer = 0;
+			if (state & HISTORY_GRANNY) { // (read whatever the day, to stay on the next one)
+				for (shift = 0; answers < end; shift += 7) {
+					answer |= (uint32_t)(*answers & 0x7f) << shift;
+					if (!(*answers++ & 0x80)) {
+						break;
+					}
+				}
+			}
+			if (day < from || id >= s->names.count) {
+				continue;
+			}
+			stats = &s->stats[id];
+			stats->occurrences++;
+			stats->granny += state & HISTORY_GRANNY;
+			stats->warned += (state & HISTORY_WARNED) != 0;
+			if (answer) {
+				stats->answers++;
+				stats->answer_ms += answer - 1;
+				stats->answer_buckets[histogram_bucket(answer - 1)]++;
+				stats->answer_max = answer - 1 > stats->answer_max ? answer - 1 : stats->answer_max;
+			}
+			s->first_day = day < s->first_day ? day : s->first_day;
+			s->last_day = day > s->last_day ? day : s->last_day;
+			s->outcomes++;
+		}
+	}
+	s->bytes = r.offset;
+	if (r.offset < r.size) {
+		fprintf(stderr, "The history %s has a torn or damaged block at byte %lld, the rest of it is ignored\n", path, (long long)r.offset);
+	}
+	s->memory = r.block_capacity + s->stats_capacity * sizeof(*s->stats) + s->names.capacity +
+		(s->names.offset_capacity + s->names.slots_capacity) * sizeof(uint32_t);
+	free(r.block);
+	close(r.fd);
+	return 0;
+}
+
+void history_summary_free(struct history_summary *s) {
+	history_names_free(&s->names);
+	free(s->stats);
+	s->stats = NULL;
+}
+
+int history_report(const char *path, int days) {
+	struct history_summary s;
+	struct history_stats *stats;
+	struct histogram answers;
+	char first[11], last[11];
+	long long t0 = bench_ns(CLOCK_MONOTONIC), t1;
+	uint32_t id;
+	int k;
+	if (history_aggregate(path, days > 0 ? local_day() + 1 - days : 0, &s) != 0) {
+		return 1;
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	if (s.outcomes == 0) {
+		printf("No outcomes in %s%s\n", path, days > 0 ? " for these days" : "");
+		history_summary_free(&s);
+		return 0;
+	}
+	format_date(first, s.first_day);
+	format_date(last, s.last_day);
+	printf("%lld occurrences from %s to %s\n", s.outcomes, first, last);
+	printf("%-30s %12s %10s %12s %11s %16s %10s\n", "activity", "occurrences", "done (%)", "skipped (%)", "warned (%)", "answered (min)", "p90 (min)");
+	for (id = 0; id < s.names.count; id++) {
+		stats = &s.stats[id];
+		if (stats->occurrences == 0) {
+			continue;
+		}
+		memset(&answers, 0, sizeof(answers)); // (for its percentiles)
+		for (k = 0; k < HISTOGRAM_BUCKETS; k++) {
+			answers.buckets[k] = stats->answer_buckets[k];
+		}
+		answers.count = stats->answers;
+		answers.max = stats->answer_max;
+		printf("%-30.30s %12lld %10.1f %12.1f %11.1f %16.1f %10.1f\n", s.names.text + s.names.offset[id], stats->occurrences,
+			100.0 * stats->granny / stats->occurrences, 100.0 * (stats->occurrences - stats->granny) / stats->occurrences,
+			100.0 * stats->warned / stats->occurrences, stats->answers ? stats->answer_ms / 60000.0 / stats->answers : 0.0,
+			stats->answers ? histogram_percentile(&answers, 90) / 60000.0 : 0.0);
+	}
+	printf("(done: granny said so, skipped: completed by the agenda at its end; answered: mean time from the start to her yes)\n");
+	printf("Read %lld blocks (%lld bytes) in %.1f ms with %zu kB of memory\n", s.blocks, s.bytes, (t1 - t0) / 1e6, s.memory / 1024);
+	history_summary_free(&s);
+	return 0;
+}
+
+int live_init(struct live *l, struct schedule *sch, struct agenda *a, const int *lookup, bool editable) {
+// The first version is the lookup table built at start-up. When editable, the schedule arrays and the events are
+// reserved at their maximum size before anything uses them (so before build_events()).
+	int i;
+	memset(l, 0, sizeof(*l));
+	l->sch = sch;
+	l->agenda = a;
+	l->editable = editable;
+	l->version = malloc(sizeof(struct version));
+	if (l->version == NULL) {
+		return -1;
+	}
+	memcpy(l->version->lookup, lookup, sizeof(l->version->lookup));
+	l->version->number = 0;
+	if (!editable) {
+		return 0;
+	}
+	l->removed = calloc(LIVE_CAPACITY / 64, sizeof(*l->removed));
+	if (l->removed == NULL || !schedule_reserve(sch, LIVE_CAPACITY, LIVE_NAMES)) {
+		return -1;
+	}
+	if (a->events == NULL) {
+		a->events = schedule_map((size_t)LIVE_CAPACITY * 3 * sizeof(*a->events), NULL, 0);
+		if (a->events == MAP_FAILED) {
+			a->events = NULL;
+			return -1;
+		}
+	}
+	for (i = 0; i < sch->count; i++) {
+		live_cover(l, NULL, i, 1);
+	}
+	return 0;
+}
+
+void live_free(struct live *l) {
+	free(atomic_load(&l->version));
+	free(l->removed);
+	if (l->editable && l->agenda->events) {
+		munmap(l->agenda->events, (size_t)LIVE_CAPACITY * 3 * sizeof(*l->agenda->events));
+		l->agenda->events = NULL;
+	}
+}
+
+unsigned long live_read_lock(struct live *l) {
+// Count the reader in the counter of the current epoch; if the editor moved to the next epoch meanwhile it might
+// have missed it, so it's counted again in the new one (the editor never waits for a reader that isn't counted)
+	unsigned long epoch;
+	while (1) {
+		epoch = atomic_load(&l->epoch);
+		atomic_fetch_add(&l->readers[epoch % 2], 1);
+		if (atomic_load(&l->epoch) == epoch) {
+			return epoch;
+		}
+		atomic_fetch_sub(&l->readers[epoch % 2], 1);
+	}
+}
+
+void live_read_unlock(struct live *l, unsigned long epoch) {
+	atomic_fetch_sub_explicit(&l->readers[epoch % 2], 1, memory_order_release);
+}
+
+int live_lookup(struct live *l, int minute_of_day) {
+	unsigned long epoch = live_read_lock(l);
+	int j = atomic_load_explicit(&l->version, memory_order_acquire)->lookup[minute_of_day];
+	live_read_unlock(l, epoch);
+	return j;
+}
+
+void live_synchronize(struct live *l) {
+// After publishing a version: readers counted in the epoch that's ending may still use the old one
+	unsigned long epoch = atomic_fetch_add(&l->epoch, 1);
+	long long t0 = bench_ns(CLOCK_MONOTONIC);
+	while (atomic_load_explicit(&l->readers[epoch % 2], memory_order_acquire) != 0) {
+		sched_yield();
+	}
+	l->grace_ns += bench_ns(CLOCK_MONOTONIC) - t0;
+}
+
+void live_cover(struct live *l, struct version *v, int i, int delta) {
+// Activity i covers its minutes (delta 1: added, the latest activity wins like in the lookup table) or stops
+// covering them (delta -1: the minutes it had go to the latest activity still covering them, or to nobody).
+// Without a version only the counts change (start-up).
+	struct schedule *sch = l->sch;
+	bool lost[24*60];
+	bool overlapped = false;
+	int minute, k;
+	if (v && delta < 0) {
+		memset(lost, 0, sizeof(lost));
+	}
+	for (minute = sch->start[i]; ; minute = (minute + 1) % (24*60)) {
+		l->covering[minute] += delta;
+		if (v && delta > 0) {
+			v->lookup[minute] = i;
+		}
+		else if (v && v->lookup[minute] == i) {
+			v->lookup[minute] = -1;
+			lost[minute] = (l->covering[minute] > 0); // somebody else covers it too
+			overlapped |= lost[minute];
+		}
+		if (minute == sch->end[i]) {
+			break;
+		}
+	}
+	if (!overlapped) {
+		return;
+	}
+	// Only when the schedule file had overlapping activities
+	for (k = 0; k < sch->count; k++) {
+		if ((l->removed[k / 64] >> (k % 64)) & 1) {
+			continue;
+		}
+		for (minute = sch->start[k]; ; minute = (minute + 1) % (24*60)) {
+			if (lost[minute] && v->lookup[minute] < k) {
+				v->lookup[minute] = k;
+			}
+			if (minute == sch->end[k]) {
+				break;
+			}
+		}
+	}
+}
+
+void live_push(struct live *l, struct event *ev, bool cancel) {
+	struct timer_change *change = malloc(sizeof(*change));
+	if (change == NULL) {
+		return;
+	}
+	change->ev = ev;
+	change->cancel = cancel;
+	change->next = atomic_load_explicit(&l->timers, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&l->timers, &change->next, change, memory_order_release, memory_order_relaxed)) {
+	}
+}
+
+int live_edit(struct live *l, const char *line, const char *end) {
+// Parse one edit, build the next version off to the side, publish it, hand the events to the scheduler and free
+// the old version once no reader can be using it
+	struct version *current = atomic_load(&l->version);
+	struct version *next;
+	struct schedule *sch = l->sch;
+	struct event *pending[3];
+	long long t0 = bench_ns(CLOCK_MONOTONIC);
+	const char *p = line, *name = NULL;
+	char start_time[6], end_time[6];
+	size_t length = 0;
+	int at = -1, start = -1, finish = -1, i = -1, n, k, minute, armed = 0;
+	enum { EDIT_ADD, EDIT_MOVE, EDIT_REMOVE } op;
+
+	while (end > line && (end[-1] == '\r' || end[-1] == ' ')) {
+		end--;
+	}
+	if (end - p > 4 && !memcmp(p, "add ", 4)) {
+		op = EDIT_ADD;
+		p += 4;
+	}
+	else if (end - p > 5 && !memcmp(p, "move ", 5)) {
+		op = EDIT_MOVE;
+		p += 5;
+	}
+	else if (end - p > 7 && !memcmp(p, "remove ", 7)) {
+		op = EDIT_REMOVE;
+		p += 7;
+	}
+	else {
+		fprintf(stderr, "Edit refused: unknown edit \"%.*s\"\n", (int)(end - line), line);
+		l->refused++;
+		return -1;
+	}
+	if (op != EDIT_ADD && (!parse_time(&p, end, &at) || (op == EDIT_MOVE && (p == end || *p++ != ' ')))) {
+		fprintf(stderr, "Edit refused: no time in \"%.*s\"\n", (int)(end - line), line);
+		l->refused++;
+		return -1;
+	}
+	if (op != EDIT_REMOVE) {
+		if (!parse_time(&p, end, &start) || p == end || *p++ != ',' || !parse_time(&p, end, &finish) ||
+		    (op == EDIT_ADD && (p == end || *p++ != ',' || p == end || end - p > 100)) || (op == EDIT_MOVE && p != end)) {
+			fprintf(stderr, "Edit refused: expected %s in \"%.*s\"\n", op == EDIT_ADD ? "HH:MM,HH:MM,name" : "HH:MM HH:MM,HH:MM",
+				(int)(end - line), line);
+			l->refused++;
+			return -1;
+		}
+		name = p;
+		length = end - p;
+	}
+	if (op != EDIT_ADD) {
+		i = current->lookup[at];
+		if (i < 0) {
+			format_time(start_time, at);
+			fprintf(stderr, "Edit refused: no activity at %s\n", start_time);
+			l->refused++;
+			return -1;
+		}
+		if (op == EDIT_MOVE) {
+			name = schedule_name(sch, i);
+			length = strlen(name);
+		}
+	}
+	if (op != EDIT_REMOVE) {
+		for (minute = start; ; minute = (minute + 1) % (24*60)) {
+			if (current->lookup[minute] != -1 && current->lookup[minute] != i) {
+				format_time(start_time, minute);
+				fprintf(stderr, "Edit refused: %.*s would overlap %s at %s\n", (int)length, name,
+					schedule_name(sch, current->lookup[minute]), start_time);
+				l->refused++;
+				return -1;
+			}
+			if (minute == finish) {
+				break;
+			}
+		}
+		if (sch->count == sch->capacity || sch->names_size + length + 1 > sch->names_capacity) {
+			fprintf(stderr, "Edit refused: the schedule is full (%d activities)\n", sch->count);
+			l->refused++;
+			return -1;
+		}
+	}
+
+	// The next version, off to the side
+	next = malloc(sizeof(*next));
+	if (next == NULL) {
+		fprintf(stderr, "Edit refused: not enough memory\n");
+		l->refused++;
+		return -1;
+	}
+	memcpy(next->lookup, current->lookup, sizeof(next->lookup));
+	next->number = current->number + 1;
+	if (i >= 0) {
+		l->removed[i / 64] |= 1ULL << (i % 64);
+		live_cover(l, next, i, -1);
+	}
+	n = sch->count;
+	if (op != EDIT_REMOVE) {
+		if (!schedule_add(sch, start, finish, name, length, schedule_hash(name, length))) { // (never reallocates)
+			fprintf(stderr, "Edit refused: not enough memory\n");
+			l->refused++;
+			free(next);
+			return -1;
+		}
+		if (i >= 0) { // a moved activity keeps its days
+			sch->rule[n] = sch->rule[i];
+		}
+		live_cover(l, next, n, 1);
+		armed = agenda_activity(l->agenda, n, internal_now(), pending); // before a reader can acknowledge it
+	}
+
+	// Publish it, then the events: a removed activity won't be notified, an added one will
+	atomic_store_explicit(&l->version, next, memory_order_release);
+	if (i >= 0) {
+		for (k = 0; k < 3; k++) {
+			live_push(l, &l->agenda->events[i*3 + k], true);
+		}
+	}
+	while (armed > 0) {
+		live_push(l, pending[--armed], false);
+	}
+	if (!l->quiet) {
+		if (op == EDIT_REMOVE) {
+			output("Schedule changed: %s was removed\n", schedule_name(sch, i));
+		}
+		else {
+			format_time(start_time, start);
+			format_time(end_time, finish);
+			output("Schedule changed: %s at: %s until: %s (%s)\n", schedule_name(sch, n), start_time, end_time, op == EDIT_ADD ? "new" : "moved");
+		}
+	}
+	live_synchronize(l);
+	free(current);
+	l->edits++;
+	l->edit_ns += bench_ns(CLOCK_MONOTONIC) - t0;
+	return 0;
+}
+
+void live_timers(struct live *l, struct wheel *w) {
+// The list is a stack: reversed first, so an activity added and removed right away ends up removed
+	struct timer_change *changes = atomic_exchange_explicit(&l->timers, NULL, memory_order_acquire);
+	struct timer_change *ordered = NULL, *next;
+	for (; changes; changes = next) {
+		next = changes->next;
+		changes->next = ordered;
+		ordered = changes;
+	}
+	for (; ordered; ordered = next) {
+		next = ordered->next;
+		if (ordered->cancel) {
+			wheel_cancel(w, ordered->ev);
+		}
+		else {
+			wheel_add(w, ordered->ev);
+		}
+		free(ordered);
+	}
+}
+
+void *editor(void *arg) {
+// Reads the edits file line by line. A named pipe is opened for writing too, so it never reaches the end of the
+// file when a writer closes it (the next one can write more edits); a regular file is read once.
+	const char *path = arg;
+	char input[LIVE_INPUT];
+	size_t length = 0;
+	struct pollfd fds[2];
+	struct stat info;
+	ssize_t bytes;
+	char *newline;
+	bool fifo = (stat(path, &info) == 0 && S_ISFIFO(info.st_mode));
+	int fd = open(path, (fifo ? O_RDWR : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1) {
+		fprintf(stderr, "Can't open the edits %s: %s\n", path, strerror(errno));
+		return 0;
+	}
+	fds[0] = (struct pollfd){ .fd = fd, .events = POLLIN };
+	fds[1] = (struct pollfd){ .fd = editor_wakeup, .events = POLLIN };
+	while (1) {
+		if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+			break;
+		}
+		atomic_fetch_add_explicit(&wakeups, 1, memory_order_relaxed);
+		if (fds[1].revents) { // the agenda stops
+			break;
+		}
+		if (!fds[0].revents) {
+			continue;
+		}
+		bytes = read(fd, input + length, sizeof(input) - length);
+		if (bytes == -1 && (errno == EAGAIN || errno == EINTR)) {
+			continue;
+		}
+		if (bytes <= 0) { // end of a regular file: the last line, then only wait to stop
+			if (length > 0) {
+				live_edit(&live, input, input + length);
+				length = 0;
+			}
+			fds[0].fd = -1;
+			continue;
+		}
+		length += bytes;
+		while ((newline = memchr(input, '\n', length)) != NULL) {
+			if (newline > input) {
+				live_edit(&live, input, newline);
+				sched_lock(); // the scheduler takes the events when it wakes up
+				pthread_cond_signal(&sched_cond);
+				sched_unlock();
+			}
+			length -= newline + 1 - input;
+			memmove(input, newline + 1, length);
+		}
+		if (length == sizeof(input)) { // a line longer than the buffer
+			fprintf(stderr, "Edit refused: line too long\n");
+			length = 0;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+int histogram_bucket(long long value) {
+	int shift;
+	if (value < HISTOGRAM_SUB) {
+		return (value <= 0) ? 0 : (int)value;
+	}
+	shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS; // the top HISTOGRAM_SUB_BITS + 1 bits are kept
+	return (shift + 1) * HISTOGRAM_SUB + (int)((value >> shift) - HISTOGRAM_SUB);
+}
+
+long long histogram_bucket_max(int bucket) {
+	int shift = bucket / HISTOGRAM_SUB - 1;
+	if (shift < 0) {
+		return bucket;
+	}
+	return ((long long)(bucket % HISTOGRAM_SUB + HISTOGRAM_SUB + 1) << shift) - 1;
+}
+
+void histogram_add(struct histogram *h, long long value) {
+	long long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->buckets[histogram_bucket(value)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+	while (value > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, value, memory_order_relaxed, memory_order_relaxed)) {
+	}
+}
+
+long long histogram_percentile(const struct histogram *h, double percent) {
+	long long wanted = (long long)(h->count * percent / 100.0 + 0.5);
+	long long seen = 0;
+	int bucket;
+	if (wanted < 1) {
+		wanted = 1;
+	}
+	for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+		seen += h->buckets[bucket];
+		if (seen >= wanted) {
+			return (histogram_bucket_max(bucket) < h->max) ? histogram_bucket_max(bucket) : h->max;
+		}
+	}
+	return h->max;
+}
+
+int stats_open(void) {
+	char name[32];
+	int fd;
+	snprintf(name, sizeof(name), "/granny.%d", (int)getpid());
+	fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd == -1 || ftruncate(fd, sizeof(struct stats_page)) == -1) {
+		fprintf(stderr, "Can't create the stats page %s: %s\n", name, strerror(errno));
+		if (fd != -1) {
+			close(fd);
+			shm_unlink(name);
+		}
+		return -1;
+	}
+	stats = mmap(NULL, sizeof(struct stats_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (stats == MAP_FAILED) {
+		fprintf(stderr, "Can't map the stats page %s: %s\n", name, strerror(errno));
+		stats = NULL;
+		shm_unlink(name);
+		return -1;
+	}
+	// The page is zeroed by ftruncate
+	stats->version = STATS_VERSION;
+	stats->pid = (int)getpid();
+	stats->started_ns = bench_ns(CLOCK_MONOTONIC);
+	atomic_thread_fence(memory_order_release);
+	stats->magic = STATS_MAGIC; // last, so a reader never sees a half initialized page
+	fprintf(stderr, "Statistics: shared memory %s, SIGUSR1 to dump them (kill -USR1 %d)\n", name, (int)getpid());
+	return 0;
+}
+
+void stats_close(void) {
+	char name[32];
+	snprintf(name, sizeof(name), "/granny.%d", (int)getpid());
+	shm_unlink(name);
+	munmap(stats, sizeof(struct stats_page));
+	stats = NULL;
+}
+
+void stats_print(FILE *file, const struct stats_page *page) {
+	const struct histogram *h[] = {&page->sched_wait_ns, &page->sched_hold_ns, &page->output_pacing_ns, &page->lateness_ns, &page->lookup_ns};
+	const char *names[] = {"sched_mutex wait", "sched_mutex hold", "3 seconds pacing", "notification lateness", "lookup"};
+	double seconds = (bench_ns(CLOCK_MONOTONIC) - page->started_ns) / 1e9;
+	int k;
+	fprintf(file, "Statistics of pid %d after %.1f s: %lld scheduler wakeups (%.3f/s), %lld outputs overflowed the ring, %lld dropped\n",
+		page->pid, seconds, (long long)page->scheduler_wakeups, seconds > 0 ? page->scheduler_wakeups / seconds : 0.0,
+		(long long)page->output_overflowed, (long long)page->output_dropped);
+	fprintf(file, "%24s %12s %14s %14s %14s %14s\n", "(ns)", "count", "mean", "p50", "p99", "max");
+	for (k = 0; k < 5; k++) {
+		fprintf(file, "%24s %12lld %14lld %14lld %14lld %14lld\n", names[k], (long long)h[k]->count,
+			h[k]->count ? h[k]->sum / h[k]->count : 0, histogram_percentile(h[k], 50), histogram_percentile(h[k], 99), (long long)h[k]->max);
+	}
+}
+
+int stats_read(const char *pid) {
+// Another process: the page is only read, the agenda keeps running
+	char name[32];
+	struct stats_page *page;
+	int fd;
+	snprintf(name, sizeof(name), "/granny.%s", pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1) {
+		fprintf(stderr, "Can't open the stats page %s (is the agenda running with --stats?): %s\n", name, strerror(errno));
+		return 1;
+	}
+	page = mmap(NULL, sizeof(struct stats_page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED) {
+		fprintf(stderr, "Can't map the stats page %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+	if (page->magic != STATS_MAGIC || page->version != STATS_VERSION) {
+		fprintf(stderr, "%s isn't a stats page of this version of the agenda\n", name);
+		munmap(page, sizeof(struct stats_page));
+		return 1;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	stats_print(stdout, page);
+	munmap(page, sizeof(struct stats_page));
+	return 0;
+}
+
+void *stats_signals(void *arg) {
+// SIGUSR1 is blocked in every thread (main blocks it before creating them), this one takes it synchronously.
+// SIGUSR2 is only sent by main to stop it.
+	sigset_t *signals = arg;
+	int signal;
+	while (sigwait(signals, &signal) == 0 && signal == SIGUSR1) {
+		stats_print(stderr, stats);
+	}
+	return 0;
+}
+
+void sched_lock(void) {
+	long long start;
+	if (stats == NULL) {
+		pthread_mutex_lock(&sched_mutex);
+		return;
+	}
+	start = bench_ns(CLOCK_MONOTONIC);
+	pthread_mutex_lock(&sched_mutex);
+	sched_locked_ns = bench_ns(CLOCK_MONOTONIC);
+	histogram_add(&stats->sched_wait_ns, sched_locked_ns - start);
+}
+
+void sched_unlock(void) {
+	if (stats) {
+		histogram_add(&stats->sched_hold_ns, bench_ns(CLOCK_MONOTONIC) - sched_locked_ns);
+	}
+	pthread_mutex_unlock(&sched_mutex);
+}
+
+int sched_timedwait(const struct timespec *deadline) {
+// sched_mutex is released while waiting, so it counts as held again from the wakeup (no deadline if NULL)
+	int result;
+	if (stats == NULL) {
+		return deadline ? pthread_cond_timedwait(&sched_cond, &sched_mutex, deadline) : pthread_cond_wait(&sched_cond, &sched_mutex);
+	}
+	histogram_add(&stats->sched_hold_ns, bench_ns(CLOCK_MONOTONIC) - sched_locked_ns);
+	result = deadline ? pthread_cond_timedwait(&sched_cond, &sched_mutex, deadline) : pthread_cond_wait(&sched_cond, &sched_mutex);
+	sched_locked_ns = bench_ns(CLOCK_MONOTONIC);
+	atomic_fetch_add_explicit(&stats->scheduler_wakeups, 1, memory_order_relaxed);
+	return result;
+}
+
+void simulation_record(struct event *ev) {
+	uint8_t bit = 1 << ev->kind;
+	uint8_t *seen = &simulation->seen[(size_t)(ev->day % SIMULATION_DAYS) * acts.count + ev->act];
+	simulation->fired[ev->kind]++;
+	histogram_add(&simulation->lateness_ms, internal_now() - ev->deadline);
+	if (*seen & bit) {
+		simulation->duplicates[ev->kind]++;
+	}
+	*seen |= bit;
+}
+
+void simulation_check(struct simulation *sim, uint32_t day, long long end_ms) {
+// What should have been notified for the occurrences of a day, from the schedule, the rules and the script only,
+// against what was; then the slot of the day is cleared for the one that will use it next
+	size_t base = (size_t)(day % SIMULATION_DAYS) * acts.count;
+	long long midnight = ((long long)day - internal_first_day) * 86400000;
+	long long start, end, at;
+	int i, k;
+	for (i = 0; i < acts.count; i++) {
+		if (rule_matches(&acts, acts.rule[i], day)) {
+			start = midnight + acts.start[i] * 60000LL + schedule_start_ms(&acts, i);
+			end = midnight + acts.end[i] * 60000LL + schedule_end_ms(&acts, i);
+			if (end < start) { // past midnight: it ends the next day
+				end += 86400000;
+			}
+			for (k = EVENT_START; k <= EVENT_WARNING; k++) {
+				at = (k == EVENT_START) ? start + 60000 - 1 : end - 10*60000;
+				if (k == EVENT_WARNING && at <= start) {
+					continue; // 10 minutes long or less: no warning
+				}
+				if (at <= 0 || at >= end_ms || (k == EVENT_WARNING && sim->acked_at[base + i] != -1 && sim->acked_at[base + i] <= at)) {
+					continue; // before the simulation started or after it ended, or granny had already done it
+				}
+				sim->expected[k]++;
+				if (!(sim->seen[base + i] & (1 << k))) {
+					sim->missed[k]++;
+				}
+			}
+		}
+		sim->seen[base + i] = 0;
+		sim->acked_at[base + i] = -1;
+	}
+}
+
+int load_script(const char *path, struct script_entry **entries) {
+// Small file, read line by line; returns the number of entries
+	FILE *file = fopen(path, "r");
+	char line[256];
+	const char *p, *end;
+	struct script_entry *bigger;
+	int count = 0, capacity = 0, number = 0;
+	*entries = NULL;
+	if (file == NULL) {
+		fprintf(stderr, "Can't open script file %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file)) {
+		number++;
+		end = line + strcspn(line, "\r\n");
+		if (end == line || line[0] == '#') {
+			continue;
+		}
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			bigger = realloc(*entries, capacity * sizeof(**entries));
+			if (bigger == NULL) {
+				fprintf(stderr, "Not enough memory for the script\n");
+				goto error;
+			}
+			*entries = bigger;
+		}
+		p = line;
+		if (!parse_time(&p, end, &(*entries)[count].at) || p >= end || *p++ != ',' ||
+		    !parse_time(&p, end, &(*entries)[count].question) || p >= end || *p++ != ',' ||
+		    (strncmp(p, "yes", end - p) && strncmp(p, "no", end - p))) {
+			fprintf(stderr, "Script file %s, line %d: expected time, question and answer, eg. 10:05,10:00,yes\n", path, number);
+			goto error;
+		}
+		(*entries)[count].yes = !strncmp(p, "yes", end - p);
+		count++;
+	}
+	fclose(file);
+	return count;
+
+error:
+	fclose(file);
+	free(*entries);
+	*entries = NULL;
+	return -1;
+}
+
+int script_compare(const void *a, const void *b) {
+	return ((const struct script_entry *)a)->at - ((const struct script_entry *)b)->at;
+}
+
+int simulate(int days, const char *script_path, long long jitter_ms) {
+	struct simulation sim;
+	struct script_entry *script = NULL;
+	struct script_entry *entry = NULL;
+	struct event *ev, *next_ev, *ends;
+	struct rusage usage;
+	pthread_t thread_output;
+	int n_script = 0;
+	int i;
+	long long asked = 0; // script entries asked so far: entry asked % n_script of day asked / n_script
+	long long end_ms = days * 86400000LL, now, at, next, hold, fire_start, c0, c1, first_day_kb = 0;
+	unsigned long long seed = 88172645463325252ULL; // the same wake-ups every run
+	uint32_t day, checked;
+	size_t k;
+
+	if (script_path && (n_script = load_script(script_path, &script)) < 0) {
+		return 1;
+	}
+	qsort(script, n_script, sizeof(*script), script_compare);
+	memset(&sim, 0, sizeof(sim));
+	sim.seen = calloc((size_t)SIMULATION_DAYS * acts.count, 1);
+	sim.acked_at = malloc((size_t)SIMULATION_DAYS * acts.count * sizeof(*sim.acked_at));
+	if (sim.seen == NULL || sim.acked_at == NULL) {
+		fprintf(stderr, "Not enough memory for the simulation\n");
+		return 1;
+	}
+	for (k = 0; k < (size_t)SIMULATION_DAYS * acts.count; k++) {
+		sim.acked_at[k] = -1;
+	}
+	pthread_mutex_init(&sched_mutex, NULL);
+	speed_max = true; // the internal clock starts at midnight of today and only moves when it's told to
+	internal_origin = 0;
+	internal_first_day = local_day();
+	atomic_store(&clock_jumps, 0);
+	// The notifications go through the ring (and its overflow) to a dispatcher that prints nothing, so what's
+	// checked is what the console would get
+	output_console = false;
+	output_init();
+	atomic_store(&output_stop, false);
+	pthread_create(&thread_output, NULL, dispatcher, NULL);
+	simulation = &sim;
+	build_lookup();
+	if (live_init(&live, &acts, &granny, lookup_table, false) != 0) {
+		fprintf(stderr, "Not enough memory for the simulation\n");
+		return 1;
+	}
+	c0 = bench_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+	// The agenda is started once: every activity recurs, and granny asks the questions of the script every day
+	build_events();
+	checked = internal_first_day - 1; // next day to check, from last night's occurrences
+	while (1) {
+		hold = bench_ns(CLOCK_MONOTONIC);
+		pthread_mutex_lock(&sched_mutex);
+		next = wheel_next(&agenda_wheel);
+		pthread_mutex_unlock(&sched_mutex);
+		histogram_add(&sim.hold_ns, bench_ns(CLOCK_MONOTONIC) - hold);
+		at = -1;
+		if (n_script > 0) {
+			entry = &script[asked % n_script];
+			at = asked / n_script * 86400000LL + entry->at * 60000LL;
+		}
+		now = (next == -1 || (at != -1 && at <= next)) ? at : next;
+		if (now == -1 || now >= end_ms) { // the days asked for are over (or nothing occurs anymore)
+			break;
+		}
+		// A day is checked once its occurrences are all over, the night activity ends the next day
+		while (now >= ((long long)checked - internal_first_day + 2) * 86400000) {
+			simulation_check(&sim, checked, end_ms);
+			if (checked == internal_first_day) {
+				getrusage(RUSAGE_SELF, &usage);
+				first_day_kb = usage.ru_maxrss;
+			}
+			checked++;
+		}
+		if (now == at) { // granny asks something (like main() does)
+			clock_jump(at);
+			asked++;
+			i = agenda_lookup(&live, entry->question, at, &day);
+			if (i >= 0 && entry->yes && schedule_transition(&acts, i, day, FLAG_DONE)) {
+				sim.acks++;
+				sim.acked_at[(size_t)(day % SIMULATION_DAYS) * acts.count + i] = at;
+				if (acts.history) {
+					history_answer(acts.history, i, day, at);
+				}
+				hold = bench_ns(CLOCK_MONOTONIC);
+				pthread_mutex_lock(&sched_mutex);
+				if (granny.events[i*3 + EVENT_WARNING].day == day) {
+					wheel_cancel(&agenda_wheel, &granny.events[i*3 + EVENT_WARNING]);
+				}
+				pthread_mutex_unlock(&sched_mutex);
+				histogram_add(&sim.hold_ns, bench_ns(CLOCK_MONOTONIC) - hold);
+			}
+			continue;
+		}
+		// Like the scheduler thread, which the kernel may wake up late (timer slack, a busy machine)
+		clock_jump(now + (jitter_ms ? (long long)(bench_random(&seed) % (jitter_ms + 1)) : 0));
+		hold = bench_ns(CLOCK_MONOTONIC);
+		pthread_mutex_lock(&sched_mutex);
+		ev = wheel_expire(&agenda_wheel, internal_now());
+		pthread_mutex_unlock(&sched_mutex);
+		histogram_add(&sim.hold_ns, bench_ns(CLOCK_MONOTONIC) - hold);
+		for (ends = NULL; ev; ev = next_ev) {
+			next_ev = ev->next;
+			fire_start = bench_ns(CLOCK_MONOTONIC);
+			fire(ev);
+			histogram_add(&sim.fire_ns, bench_ns(CLOCK_MONOTONIC) - fire_start);
+			if (ev->kind == EVENT_END) {
+				ev->next = ends;
+				ends = ev;
+			}
+		}
+		hold = bench_ns(CLOCK_MONOTONIC);
+		pthread_mutex_lock(&sched_mutex);
+		agenda_rearm(ends, &agenda_wheel, internal_now());
+		pthread_mutex_unlock(&sched_mutex);
+		histogram_add(&sim.hold_ns, bench_ns(CLOCK_MONOTONIC) - hold);
+	}
+	for (; checked < internal_first_day + days; checked++) { // the last days, up to where the simulation stopped
+		simulation_check(&sim, checked, end_ms);
+	}
+	c1 = bench_ns(CLOCK_PROCESS_CPUTIME_ID);
+	atomic_store(&output_stop, true);
+	sem_post(&output_ready);
+	pthread_join(thread_output, NULL);
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("Simulated %d day(s) of %d activities (%d script entries", days, acts.count, n_script);
+	if (jitter_ms) {
+		printf(", wake-ups up to %lld ms late", jitter_ms);
+	}
+	printf(") in %.3f s of CPU\n", (c1 - c0) / 1e9);
+	printf("%24s %12s %12s %12s %12s\n", "", "fired", "expected", "missed", "duplicates");
+	printf("%24s %12lld %12lld %12lld %12lld\n", "starts", sim.fired[EVENT_START], sim.expected[EVENT_START], sim.missed[EVENT_START], sim.duplicates[EVENT_START]);
+	printf("%24s %12lld %12lld %12lld %12lld\n", "10 minutes remaining", sim.fired[EVENT_WARNING], sim.expected[EVENT_WARNING], sim.missed[EVENT_WARNING], sim.duplicates[EVENT_WARNING]);
+	printf("%24s %12lld %12s %12s %12s\n", "auto-completions", sim.fired[EVENT_END], "", "", "");
+	printf("%24s %12lld\n", "acknowledged by granny", sim.acks);
+	printf("%24s %12ld (%ld through the overflow, %ld dropped)\n", "outputs queued", (long)output_enqueued, (long)output_overflowed, (long)output_dropped);
+	printf("%24s %12s %12s %12s\n", "", "p50", "p99", "max");
+	printf("%24s %12lld %12lld %12lld\n", "lateness (internal ms)", histogram_percentile(&sim.lateness_ms, 50), histogram_percentile(&sim.lateness_ms, 99), sim.lateness_ms.max);
+	printf("%24s %12lld %12lld %12lld\n", "fire (ns)", histogram_percentile(&sim.fire_ns, 50), histogram_percentile(&sim.fire_ns, 99), sim.fire_ns.max);
+	printf("%24s %12lld %12lld %12lld\n", "sched_mutex held (ns)", histogram_percentile(&sim.hold_ns, 50), histogram_percentile(&sim.hold_ns, 99), sim.hold_ns.max);
+	if (first_day_kb) {
+		printf("Memory (max RSS): %lld kB after the first day, %ld kB after %d days\n", first_day_kb, usage.ru_maxrss, days);
+	}
+	else {
+		printf("Memory (max RSS): %ld kB\n", usage.ru_maxrss);
+	}
+
+	simulation = NULL;
+	free(sim.seen);
+	free(sim.acked_at);
+	free(script);
+	return (sim.missed[0] || sim.missed[1] || sim.duplicates[0] || sim.duplicates[1] || sim.lateness_ms.max >= 60000) ? 1 : 0;
+}
+
+// Benchmarks ******************************************************************************************************
+// The --bench-* modes are only built with -DGRANNY_BENCH, so the agenda itself doesn't carry them. bench_random()
+// and bench_ns() are always there: the simulation, the live edits and the journal use them too.
+unsigned long long bench_random(unsigned long long *state) {
+// xorshift64, so the benchmarks don't measure rand()
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+long long bench_ns(clockid_t clock) {
+	struct timespec t;
+	clock_gettime(clock, &t);
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+#ifdef GRANNY_BENCH
+int bench_wheel(void) {
+// Schedule n events spread over 30 days, cancel 10% of them and run the wheel like the scheduler does (jumping
+// from one wake-up to the next) until all of them expired. The CPU used per simulated day is the steady-state
+// cost at x1, where a day takes 86400 real seconds.
+	const long long horizon = 30LL * 24 * 3600000; // 30 days in ms
+	unsigned long long seed = 88172645463325252ULL;
+	long n, i, expired, misfired, wakeups;
+	long long t0, t1, t2, t3, c0, c1;
+	long long ms;
+	struct event *pool;
+	struct event *ev;
+	struct wheel *w = malloc(sizeof(*w));
+
+	printf("%10s %12s %12s %12s %10s %16s %12s\n", "events", "insert ns", "cancel ns", "expire ns", "wakeups", "cpu ms / day", "cpu % at x1");
+	for (n = 10; n <= 10000000; n *= 10) {
+		pool = malloc(n * sizeof(*pool));
+		if (pool == NULL || w == NULL) {
+			printf("Not enough memory for %ld events\n", n);
+			return 1;
+		}
+		wheel_init(w, 0);
+		for (i = 0; i < n; i++) {
+			pool[i].deadline = bench_random(&seed) % horizon;
+			pool[i].act = 0;
+			pool[i].kind = EVENT_START;
+		}
+
+		t0 = bench_ns(CLOCK_MONOTONIC);
+		for (i = 0; i < n; i++) {
+			wheel_add(w, &pool[i]);
+		}
+		t1 = bench_ns(CLOCK_MONOTONIC);
+		for (i = 0; i < n; i += 10) {
+			wheel_cancel(w, &pool[i]);
+		}
+		t2 = bench_ns(CLOCK_MONOTONIC);
+		c0 = bench_ns(CLOCK_PROCESS_CPUTIME_ID);
+		expired = 0;
+		misfired = 0;
+		wakeups = 0;
+		while ((ms = wheel_next(w)) != -1) {
+			for (ev = wheel_expire(w, ms); ev; ev = ev->next) {
+				expired++;
+				if (ev->deadline != ms) {
+					misfired++;
+				}
+			}
+			wakeups++;
+		}
+		c1 = bench_ns(CLOCK_PROCESS_CPUTIME_ID);
+		t3 = bench_ns(CLOCK_MONOTONIC);
+
+		printf("%10ld %12.1f %12.1f %12.1f %10ld %16.3f %12.6f\n", n,
+			(double)(t1 - t0) / n, (double)(t2 - t1) / ((n + 9) / 10), (double)(t3 - t2) / (expired ? expired : 1),
+			wakeups, (c1 - c0) / 1e6 / 30, (c1 - c0) / 1e9 / 30 / 86400 * 100);
+		if (misfired > 0 || expired != n - (n + 9) / 10) {
+			printf("Error: %ld events expired at the wrong millisecond, %ld of %ld expired\n", misfired, expired, n - (n + 9) / 10);
+			return 1;
+		}
+		free(pool);
+	}
+	free(w);
+	return 0;
+}
+
+int bench_lookup(void) {
+// Answer the same random minutes of the day with the old search loop and with the lookup table, checking that both
+// give the same activity
+	const long n = 10000000;
+	unsigned long long seed = 88172645463325252ULL;
+	int *queries = malloc(n * sizeof(*queries));
+	long i, mismatches = 0;
+	long long checksum_scan = 0, checksum_table = 0;
+	long long t0, t1, t2;
+	if (queries == NULL) {
+		printf("Not enough memory for %ld queries\n", n);
+		return 1;
+	}
+	if (acts.count == 0 && !schedule_load_default(&acts)) {
+		printf("Not enough memory for the schedule\n");
+		return 1;
+	}
+	build_lookup();
+	for (i = 0; i < n; i++) {
+		queries[i] = bench_random(&seed) % (24*60);
+	}
+
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < n; i++) {
+		checksum_scan += lookup_scan(queries[i] / 60, queries[i] % 60);
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < n; i++) {
+		checksum_table += lookup_table[queries[i]];
+	}
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < 24*60; i++) {
+		if (lookup_scan(i / 60, i % 60) != lookup_table[i]) {
+			mismatches++;
+		}
+	}
+
+	printf("%14s %14s %16s\n", "method", "ns / query", "queries / s");
+	printf("%14s %14.2f %16.0f\n", "search loop", (double)(t1 - t0) / n, n / ((t1 - t0) / 1e9));
+	printf("%14s %14.2f %16.0f\n", "lookup table", (double)(t2 - t1) / n, n / ((t2 - t1) / 1e9));
+	if (mismatches > 0 || checksum_scan != checksum_table) {
+		printf("Error: %ld minutes of the day give a different activity\n", mismatches);
+		return 1;
+	}
+	free(queries);
+	return 0;
+}
+
+int bench_load(void) {
+// Write a schedule file with 1M activities and measure how long load_schedule() takes to read it. The budget for
+// 1M activities is 250 ms (the file is in the page cache, like it is on a normal start-up).
+	const int n = 1000000;
+	const long long budget_ns = 250000000LL;
+	char path[] = "/tmp/granny-schedule-XXXXXX";
+	unsigned long long seed = 88172645463325252ULL;
+	unsigned long long r;
+	long long t0, t1;
+	int i, start, end;
+	FILE *file;
+	int fd = mkstemp(path);
+	if (fd == -1 || (file = fdopen(fd, "w")) == NULL) {
+		printf("Can't create a temporary schedule file\n");
+		return 1;
+	}
+	fprintf(file, "# start,end,name\n");
+	for (i = 0; i < n; i++) {
+		r = bench_random(&seed);
+		start = r % (24*60);
+		end = (start + 1 + (r >> 16) % 180) % (24*60);
+		fprintf(file, "%02d:%02d,%02d:%02d,Activity number %d\n", start / 60, start % 60, end / 60, end % 60, i);
+	}
+	fclose(file);
 
-// Global variables / mutexes ****************************************************************************
-// The last time each thread executed printf will be stored, with respect to the real time clock so that
-// the user can perceive 3 seconds (with respect to what they're seeing on the screen, the last print). 
-// Additionally, each thread will keep its own internal clock (structs) to keep as their internal 
-// time trackers, since the internal clock can go faster than the one in the real world. These structs
-// are not declared here but in the thread's functions.
-// There will be mutexes to synchronize threads and protect global variables, thus making the program
-// thread safe (below).
-struct tm tm_main; // MAIN THREAD: to capture a point of reference in time (static point of reference)
-time_t raw_init;   // Main thread: to capture main thread's raw time 
-struct tm tm_th1;  // THREAD1: static point of reference
-time_t raw_th1;
-struct tm tm_th2;  // THREAD2: static point of reference 
-time_t raw_th2;
-struct tm tm_granny; // Granny: when waiting for granny to answer to not lock other threads
-time_t raw_granny; 
-pthread_mutex_t time_mutex; // to protect modifications to time related global variables
-pthread_mutex_t state_mutex; // the same, but to protect state members of the struct variables
-pthread_mutex_t internal_mutex; // to read the internal clock
-
-// Create global variable to add extra hours to internal clock *******************************************
-// About this part it's important to say that the speedup will increase the frequency of the internal
-// clock used by the threads. The frequency might be too fast to go through all the activities, 
-// for instance when using a speedup of 10 the program goes way faster and the internal clock is 
-// produced correctly. However, it's not possible to check all 8 activities in one cycle which causes
-// some outputs to get omitted. 
-// Using a speedup factor of 3 (ie. 60 real seconds (1 minute) = 3 internal minutes) worked well. 
-// Also, 'sleep' calls in the code need to consider the internal frequency.
-struct tm tm_internal; // internal clock for the speedup
-int speedup = 3; // speedup factor for internal clock 
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	if (load_schedule(path) != 0) {
+		unlink(path);
+		return 1;
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	unlink(path);
 
-// Function declarations *********************************************************************************
-void three_seconds(struct tm reference_point); // for the 3 second latency between any two outputs
-void capture(int index); // to capture a static point of reference
-struct tm minimum_reference(void); // to look for most recent static point of reference 
-void *f1(); // for thread 1 (which checks for the start  and end of an activity)
-void *f2(); // for thread 2 (which checks when there are 10 mins remaining for an activity)
-void *f3(); // for thread 3 (which will accelerate or not the internal clock)
+	printf("Loaded %d activities in %.1f ms (%.0f ns / activity, budget %lld ms): %s\n", acts.count, (t1 - t0) / 1e6,
+		(double)(t1 - t0) / acts.count, budget_ns / 1000000, (t1 - t0) <= budget_ns ? "ok" : "over budget");
+	return (acts.count == n && (t1 - t0) <= budget_ns) ? 0 : 1;
+}
 
-// Main **************************************************************************************************
+int bench_layout(void) {
+// 1M activities (names taken from 1000 different ones) stored both ways, then the same scan over both: how many
+// undone activities are in progress at some minute, which needs the start, the end and the state of every one.
+	const int n = 1000000;
+	const int rounds = 20;
+	struct old_activity { // the way activities used to be stored
+		int start_hour;
+		int start_minute;
+		int end_hour;
+		int end_minute;
+		char start_time[6];
+		char end_time[6];
+		char name[101];
+		char state[7];
+	} *old = malloc(n * sizeof(*old));
+	struct schedule sch;
+	unsigned long long seed = 88172645463325252ULL;
+	unsigned long long r;
+	char name[32];
+	int i, round, length, minute, start, end;
+	long found_old = 0, found_new = 0;
+	long long t0, t1, t2;
+	double new_bytes;
+	if (old == NULL) {
+		printf("Not enough memory for %d activities\n", n);
+		return 1;
+	}
+	schedule_init(&sch);
+	for (i = 0; i < n; i++) {
+		r = bench_random(&seed);
+		start = r % (24*60);
+		end = (start + 1 + (r >> 16) % 180) % (24*60);
+		length = snprintf(name, sizeof(name), "Activity %d", (int)((r >> 32) % 1000));
+		old[i].start_hour = start / 60;
+		old[i].start_minute = start % 60;
+		old[i].end_hour = end / 60;
+		old[i].end_minute = end % 60;
+		format_time(old[i].start_time, start);
+		format_time(old[i].end_time, end);
+		strcpy(old[i].name, name);
+		strcpy(old[i].state, (r >> 48) % 2 ? "Done" : "Undone");
+		if (!schedule_add(&sch, start, end, name, length, schedule_hash(name, length))) {
+			printf("Not enough memory for %d activities\n", n);
+			return 1;
+		}
+		if ((r >> 48) % 2) {
+			schedule_transition(&sch, i, 1, FLAG_DONE);
+		}
+	}
 
-int main(void){
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (round = 0; round < rounds; round++) {
+		minute = round * 71 % (24*60);
+		for (i = 0; i < n; i++) {
+			start = old[i].start_hour*60 + old[i].start_minute;
+			end = old[i].end_hour*60 + old[i].end_minute;
+			if (((start <= end) ? (start <= minute && minute <= end) : (start <= minute || minute <= end)) &&
+			    !strcmp(old[i].state, "Undone")) {
+				found_old++;
+			}
+		}
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	for (round = 0; round < rounds; round++) {
+		minute = round * 71 % (24*60);
+		for (i = 0; i < n; i++) {
+			start = sch.start[i];
+			end = sch.end[i];
+			if (((start <= end) ? (start <= minute && minute <= end) : (start <= minute || minute <= end)) &&
+			    !schedule_state(&sch, i, 1, FLAG_DONE)) {
+				found_new++;
+			}
+		}
+	}
+	t2 = bench_ns(CLOCK_MONOTONIC);
 
-// This is the initial schedule, printed when initializing the program  
-printf("-------------------------------------- Granny's schedule --------------------------------------\n");
-printf("%s at: %s until: %s\n", acts[0].name,acts[0].start_time, acts[0].end_time);
-printf("%s at: %s until: %s\n", acts[1].name,acts[1].start_time, acts[1].end_time);
-printf("%s at: %s until: %s\n", acts[2].name,acts[2].start_time, acts[2].end_time);
-printf("%s at: %s until: %s\n", acts[3].name,acts[3].start_time, acts[3].end_time);
-printf("%s at: %s until: %s\n", acts[4].name,acts[4].start_time, acts[4].end_time);
-printf("%s at: %s until: %s\n", acts[5].name,acts[5].start_time, acts[5].end_time);
-printf("%s at: %s until: %s\n", acts[6].name,acts[6].start_time, acts[6].end_time);
-printf("%s at: %s until: %s\n", acts[7].name,acts[7].start_time, acts[7].end_time);
-printf("-----------------------------------------------------------------------------------------------\n");
+	new_bytes = (double)n * (sizeof(*sch.start) + sizeof(*sch.end) + sizeof(*sch.name) + sizeof(*sch.rule) + sizeof(*sch.state)) +
+		sch.names_size + (double)sch.intern_capacity * sizeof(*sch.intern);
+	printf("%16s %18s %14s %16s\n", "layout", "bytes / activity", "scan ns / act", "scan GB/s");
+	printf("%16s %18.1f %14.2f %16.2f\n", "struct", (double)sizeof(*old), (double)(t1 - t0) / n / rounds,
+		(double)sizeof(*old) * n * rounds / (t1 - t0));
+	printf("%16s %18.1f %14.2f %16.2f\n", "arrays + arena", new_bytes / n, (double)(t2 - t1) / n / rounds,
+		(double)n * (sizeof(*sch.start) + sizeof(*sch.end) + sizeof(*sch.state)) * rounds / (t2 - t1));
+	printf("(scan bytes: the struct is read whole, the arrays only read start, end and the state)\n");
+	free(old);
+	schedule_free(&sch);
+	if (found_old != found_new) {
+		printf("Error: the scans found %ld and %ld activities\n", found_old, found_new);
+		return 1;
+	}
+	return 0;
+}
 
-// Variable declarations for the main thread
-int input_hour; // for user input
-int input_minute; // for user input
-int i; // for the for loop
-int j; // to save the value of the activity to print out on the console
-bool flag = false; // flag used when searching for the right activity
-char answer[4]; // to capture answer from the user (yes/no)?
-char hour_user[6]; // to capture user's input in string format ie. 08:25, 6th place for \0
-char hour_in[3]; // to capture the user's hour input (substring)
-char min_in[3]; // to capture the user's minute input (substring)
-struct tm tm_local_ref; // to capture local time reference for the main thread
-time_t local_raw; 
-
-// Initialize the other three threads
-pthread_t thread1, thread2, thread3; 
-pthread_create(&thread1, NULL, f1, NULL); // for activities starting / ending
-pthread_create(&thread2, NULL, f2, NULL); // for activities about to end
-pthread_create(&thread3, NULL, f3, NULL); // for internal clock production
-
-// Initialize mutexes to coordinate threads / protect global vars
-pthread_mutex_init(&time_mutex, NULL);
-pthread_mutex_init(&state_mutex, NULL);
-pthread_mutex_init(&internal_mutex, NULL);
+// State benchmark: every thread does the same mix of operations on random activities, 90% queries (is it done?)
+// and 10% acknowledgements (mark it as done), either with the atomic flags or the old way (state strings, with
+// a mutex held for reading and writing them)
+#define BENCH_STATE_ACTIVITIES 65536
+#define BENCH_STATE_OPS 2000000
 
-while(1) {
-sched_yield(); // for scheduling 
+struct bench_state_arg {
+	struct schedule *sch; // NULL: use the mutex and the strings
+	char (*states)[7];
+	pthread_mutex_t *mutex;
+	unsigned long long seed;
+	long done; // how many queries found the activity done (so the work isn't optimized away)
+};
 
-// Store information from the user (Granny) (note: assume she will input the time correctly, either for eg. 8:25 or 08:25)
-pthread_mutex_lock(&time_mutex);
-tm_local_ref = minimum_reference(); //obtain most recent static reference
-three_seconds(tm_local_ref); // calculate three seconds from most recent static reference
-pthread_mutex_unlock(&time_mutex);
-
-printf("Please input some time: \n"); 
-
-pthread_mutex_lock(&time_mutex);
-capture(3); // capture question time (granny struct tm)
-pthread_mutex_unlock(&time_mutex);
-
-scanf("%s", hour_user);
-
-pthread_mutex_lock(&time_mutex); // put mutexes here to not lock threads
-capture(0); // capture static reference time here so that granny can observe 3 seconds 
-pthread_mutex_unlock(&time_mutex);
-
-// Now extract useful information (substrings)
-if( strcmp(hour_user, "now")  ) { // for strings with numbers
-	if((hour_user[0] == '0') || (hour_user[0]!='0' && hour_user[1] != ':')){ // for cases like 08:25 or 15:00
-		hour_in[0] = hour_user[0];
-		hour_in[1] = hour_user[1];
-		min_in[0] = hour_user[3];
-		min_in[1] = hour_user[4];
-			
-	}
-	else{ // if the first character is not '0', for example 8:25
-		hour_in[0] = '0';
-		hour_in[1] = hour_user[0];
-		min_in[0] = hour_user[2];
-		min_in[1] = hour_user[3];
-	}
-	strcpy(hour_user, "");
-	hour_in[2] = '\0';
-	min_in[2] = '\0';
-	input_hour = atoi(hour_in); // transforming to int to work with this info internally
-	input_minute = atoi(min_in);
-}
-else { // other possible input option: "now"
-	local_raw = time(NULL);
-	if (local_raw == -1){
-		printf("Error calculating raw time, please restart program.\n");
-	}
-	tm_local_ref = *localtime(&local_raw);	
-	input_hour = tm_local_ref.tm_hour;
-	input_minute = tm_local_ref.tm_min;
-	printf("Time captured, hour: %d and minute: %d\n", input_hour, input_minute);
-}
-
-// Now phase 1 and phase 2 of the main thread begin
-// PHASE 1: Search to see if there's an activity that matches the input data
-	for(i=0;i<8;i++){
-		if((acts[i].start_hour == input_hour) && (acts[i].end_hour == input_hour) ){ // in the same hour
-			// Check minutes for next decision
-			if((input_minute >= acts[i].start_minute) && (input_minute <= acts[i].end_minute)){
-				j = i; // save the right activity
-				flag = true;
+void *bench_state_worker(void *arg) {
+	struct bench_state_arg *a = arg;
+	unsigned long long r;
+	long k;
+	int i;
+	for (k = 0; k < BENCH_STATE_OPS; k++) {
+		r = bench_random(&a->seed);
+		i = r % BENCH_STATE_ACTIVITIES;
+		if ((r >> 32) % 10 == 0) { // acknowledgement
+			if (a->sch) {
+				schedule_transition(a->sch, i, 1, FLAG_DONE);
+			}
+			else {
+				pthread_mutex_lock(a->mutex);
+				strcpy(a->states[i], "Done");
+				pthread_mutex_unlock(a->mutex);
 			}
 		}
-		else if((acts[i].start_hour <= input_hour) && (input_hour <= acts[i].end_hour)){ // some range, different hours
-			// check subcases now
-			if( ( (input_minute >= acts[i].start_minute) && (acts[i].start_hour == input_hour)) || ( (input_minute <= acts[i].end_minute) && (input_hour == acts[i].end_hour) )) { // It's in the range of the activity (limit hours) 
-				j = i; 
-				flag = true;
+		else { // query
+			if (a->sch) {
+				a->done += schedule_state(a->sch, i, 1, FLAG_DONE);
 			}
-			if((acts[i].start_hour < input_hour) && (input_hour < acts[i].end_hour)) { // within the range (not edges)
-				j = i;
-				flag = true;
+			else {
+				pthread_mutex_lock(a->mutex);
+				a->done += !strcmp(a->states[i], "Done");
+				pthread_mutex_unlock(a->mutex);
 			}
 		}
+	}
+	return 0;
+}
 
-		else if ((acts[i].start_hour > acts[i].end_hour)) { // for activities like sleeping where we have, for instance, 23:00 - 6:00 am
-			if( (input_hour == acts[i].end_hour) && (input_minute <= acts[i].end_minute) ){
-				j = i;
-				flag = true;
+int bench_state(void) {
+	struct schedule sch;
+	char (*states)[7] = malloc(BENCH_STATE_ACTIVITIES * sizeof(*states));
+	pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_t threads[16];
+	struct bench_state_arg args[16];
+	char name[32];
+	int n_threads, t, i, method, length;
+	long long t0, t1;
+	double rate[2];
+	if (states == NULL) {
+		printf("Not enough memory for %d activities\n", BENCH_STATE_ACTIVITIES);
+		return 1;
+	}
+	printf("%8s %22s %22s\n", "threads", "mutex + strings Mop/s", "atomic flags Mop/s");
+	for (n_threads = 1; n_threads <= 16; n_threads *= 2) {
+		for (method = 0; method < 2; method++) {
+			schedule_init(&sch);
+			for (i = 0; i < BENCH_STATE_ACTIVITIES; i++) {
+				length = snprintf(name, sizeof(name), "Activity %d", i);
+				if (!schedule_add(&sch, 0, 0, name, length, schedule_hash(name, length))) {
+					printf("Not enough memory for %d activities\n", BENCH_STATE_ACTIVITIES);
+					return 1;
+				}
+				strcpy(states[i], "Undone");
+			}
+			t0 = bench_ns(CLOCK_MONOTONIC);
+			for (t = 0; t < n_threads; t++) {
+				args[t] = (struct bench_state_arg){ method ? &sch : NULL, states, &mutex, 88172645463325252ULL + t * 7919, 0 };
+				pthread_create(&threads[t], NULL, bench_state_worker, &args[t]);
+			}
+			for (t = 0; t < n_threads; t++) {
+				pthread_join(threads[t], NULL);
 			}
+			t1 = bench_ns(CLOCK_MONOTONIC);
+			rate[method] = (double)n_threads * BENCH_STATE_OPS / ((t1 - t0) / 1e3);
+			schedule_free(&sch);
+		}
+		printf("%8d %22.1f %22.1f\n", n_threads, rate[0], rate[1]);
+	}
+	free(states);
+	return 0;
+}
 
-			if ( (input_hour == acts[i].start_hour) && (input_minute >= acts[i].start_minute) ) {
-				j = i;
-				flag = true;
+// Wall clock benchmark: threads asking for the local minute of the day as fast as they can, with time() +
+// localtime() (what capture(), three_seconds() and the internal clock thread used to call in their loops) or with
+// wallclock_ms()
+#define BENCH_WALLCLOCK_CALLS 2000000
+
+void *bench_wallclock_worker(void *arg) {
+	long *result = arg; // in: 0 for time() + localtime(), 1 for wallclock_ms(); out: sum of the minutes
+	bool cached = (*result == 1);
+	long sum = 0;
+	long k;
+	time_t raw;
+	for (k = 0; k < BENCH_WALLCLOCK_CALLS; k++) {
+		if (cached) {
+			sum += wallclock_ms() / 60000;
+		}
+		else {
+			raw = time(NULL);
+			struct tm local = *localtime(&raw);
+			sum += local.tm_hour*60 + local.tm_min;
+		}
+	}
+	*result = sum;
+	return 0;
+}
 
+int bench_wallclock(void) {
+	pthread_t threads[4];
+	long results[4];
+	int n_threads, t, method;
+	long long t0, t1, c0, c1;
+	double ns_per_call[2];
+	double rate[2];
+	time_t raw = time(NULL);
+	struct tm local = *localtime(&raw);
+	uint32_t day;
+	long long check = wallclock(&day) / 60000;
+	if (check != local.tm_hour*60 + local.tm_min && check != (local.tm_hour*60 + local.tm_min + 1) % 1440) {
+		printf("Error: wallclock_ms() says minute %lld, localtime() says %d\n", check, local.tm_hour*60 + local.tm_min);
+		return 1;
+	}
+	if (day != (uint32_t)((raw + local.tm_gmtoff) / 86400) && check != 0) { // (unless midnight just passed)
+		printf("Error: local_day() says day %u, localtime() says %ld\n", day, (long)((raw + local.tm_gmtoff) / 86400));
+		return 1;
+	}
+	printf("%8s %24s %24s %16s\n", "threads", "time + localtime Mcalls/s", "wallclock_ms Mcalls/s", "CPU ns saved");
+	for (n_threads = 1; n_threads <= 4; n_threads *= 4) {
+		for (method = 0; method < 2; method++) {
+			t0 = bench_ns(CLOCK_MONOTONIC);
+			c0 = bench_ns(CLOCK_PROCESS_CPUTIME_ID);
+			for (t = 0; t < n_threads; t++) {
+				results[t] = method;
+				pthread_create(&threads[t], NULL, bench_wallclock_worker, &results[t]);
+			}
+			for (t = 0; t < n_threads; t++) {
+				pthread_join(threads[t], NULL);
 			}
+			c1 = bench_ns(CLOCK_PROCESS_CPUTIME_ID);
+			t1 = bench_ns(CLOCK_MONOTONIC);
+			ns_per_call[method] = (double)(c1 - c0) / n_threads / BENCH_WALLCLOCK_CALLS; // CPU time per call
+			rate[method] = (double)n_threads * BENCH_WALLCLOCK_CALLS / ((t1 - t0) / 1e3);
+		}
+		printf("%8d %24.1f %24.1f %16.1f\n", n_threads, rate[0], rate[1], ns_per_call[0] - ns_per_call[1]);
+	}
+	printf("(CPU ns saved: per call; eg. the old three_seconds() spin made millions of calls per output)\n");
+	return 0;
+}
 
-			if ( ((input_hour > acts[i].start_hour) || (input_hour < acts[i].end_hour) ) ) { // within the range
-				j = i;
-				flag = true; 
+// Multi-agenda engine benchmark: 100k agendas (granny's schedule shifted by up to an hour for each person) go through
+// a whole day as fast as possible while bursts of queries, each burst for agendas of a single shard, are submitted,
+// with 1 to 8 worker threads. Every event either fires or is a warning cancelled by a "yes".
+#define BENCH_AGENDAS 100000
+#define BENCH_AGENDAS_QUERIES 2000000
+#define BENCH_AGENDAS_BURST 1024
+
+void bench_agendas_complete(struct query *q) {
+	(void)q; // the engine counts the answered queries, nothing else to do
+}
+
+int bench_agendas(void) {
+	struct schedule *schedules = calloc(BENCH_AGENDAS, sizeof(*schedules));
+	struct agenda *agendas = calloc(BENCH_AGENDAS, sizeof(*agendas));
+	struct query *queries = calloc(BENCH_AGENDAS_QUERIES, sizeof(*queries));
+	struct engine engine;
+	unsigned long long seed = 88172645463325252ULL;
+	long long t0, t1, expected_events = 0, fired, cancelled, stolen;
+	double base_rate = 0, rate;
+	int n_threads, k, i, shift, shard = 0;
+	uint32_t day;
+	if (schedules == NULL || agendas == NULL || queries == NULL) {
+		printf("Not enough memory for %d agendas\n", BENCH_AGENDAS);
+		return 1;
+	}
+	for (k = 0; k < BENCH_AGENDAS; k++) {
+		if (!schedule_load_default(&schedules[k])) {
+			printf("Not enough memory for %d agendas\n", BENCH_AGENDAS);
+			return 1;
+		}
+		shift = bench_random(&seed) % 60;
+		for (i = 0; i < schedules[k].count; i++) {
+			schedules[k].start[i] = (schedules[k].start[i] + shift) % 1440;
+			schedules[k].end[i] = (schedules[k].end[i] + shift) % 1440;
+		}
+		agendas[k].sch = &schedules[k];
+		agendas[k].quiet = true;
+	}
+	output_discard = true;
+	speed_max = true;
+	printf("%d agendas, %d queries in bursts of %d for one shard\n", BENCH_AGENDAS, BENCH_AGENDAS_QUERIES, BENCH_AGENDAS_BURST);
+	printf("%8s %12s %12s %12s %14s %10s %10s\n", "threads", "ms", "events", "queries", "ops/s", "speedup", "stolen %");
+	for (n_threads = 1; n_threads <= 8; n_threads *= 2) {
+		// Every run starts at midnight of the same day with every activity undone
+		internal_origin = 0;
+		internal_first_day = local_day();
+		atomic_store(&clock_jumps, 0);
+		for (k = 0; k < BENCH_AGENDAS; k++) {
+			schedule_reset(&schedules[k]);
+			atomic_store(&agendas[k].notified, 0);
+		}
+		if (engine_init(&engine, agendas, BENCH_AGENDAS, n_threads) != 0) {
+			printf("Not enough memory for the engine\n");
+			return 1;
+		}
+		expected_events = 0;
+		for (k = 0; k < n_threads; k++) {
+			expected_events += engine.shards[k].wheel.count;
+		}
+		t0 = bench_ns(CLOCK_MONOTONIC);
+		engine_start(&engine);
+		for (k = 0; k < BENCH_AGENDAS_QUERIES; k++) {
+			if (k % BENCH_AGENDAS_BURST == 0) {
+				shard = bench_random(&seed) % n_threads;
+			}
+			queries[k].agenda = shard + n_threads * (int)(bench_random(&seed) % (BENCH_AGENDAS / n_threads));
+			queries[k].minute = bench_random(&seed) % 1440;
+			queries[k].yes = bench_random(&seed) & 1;
+			queries[k].complete = bench_agendas_complete;
+			while (!engine_submit(&engine, &queries[k])) { // queue full: wait for the workers
+				sched_yield();
+			}
+		}
+		// Wait for every query to be answered and every wheel to be empty
+		for (k = 0; k < n_threads; k++) {
+			while (1) {
+				pthread_mutex_lock(&engine.shards[k].mutex);
+				i = (engine.shards[k].wheel.count == 0);
+				pthread_mutex_unlock(&engine.shards[k].mutex);
+				if (i && atomic_load(&engine.answered) == BENCH_AGENDAS_QUERIES) {
+					break;
+				}
+				sched_yield();
 			}
+		}
+		t1 = bench_ns(CLOCK_MONOTONIC);
+		engine_stop(&engine);
+		fired = cancelled = stolen = 0;
+		for (k = 0; k < n_threads; k++) {
+			fired += engine.shards[k].fired;
+			cancelled += engine.shards[k].cancelled;
+			stolen += engine.shards[k].stolen;
+		}
+		engine_free(&engine);
+		for (k = 0; k < BENCH_AGENDAS; k++) { // the day is over: everything is done (or tonight's occurrence already)
+			for (i = 0; i < schedules[k].count; i++) {
+				day = agendas[k].events[i*3 + EVENT_END].day;
+				if (!schedule_state(&schedules[k], i, day, FLAG_DONE) && !schedule_state(&schedules[k], i, day + 1, FLAG_DONE)) {
+					fired = -1;
+				}
+			}
+		}
+		if (fired + cancelled != expected_events) {
+			printf("Error: %lld events fired and %lld cancelled, %lld expected (or an activity isn't done)\n", fired, cancelled, expected_events);
+			return 1;
+		}
+		rate = (expected_events + BENCH_AGENDAS_QUERIES) / ((t1 - t0) / 1e9);
+		if (n_threads == 1) {
+			base_rate = rate;
+		}
+		printf("%8d %12.1f %12lld %12d %14.0f %10.2f %10.1f\n", n_threads, (t1 - t0) / 1e6, expected_events, BENCH_AGENDAS_QUERIES,
+			rate, rate / base_rate, 100.0 * stolen / BENCH_AGENDAS_QUERIES);
+	}
+	return 0;
+}
+
+// Query server benchmark: the server thread of this process with 1 to 1000 clients of the load generator (on the
+// same machine, so both share the CPUs)
+#define BENCH_SERVER_SECONDS 3
+
+int bench_server(void) {
+	char path[64];
+	struct rlimit files;
+	int clients, result = 0;
+	if (acts.count == 0 && !schedule_load_default(&acts)) {
+		printf("Not enough memory for the schedule\n");
+		return 1;
+	}
+	getrlimit(RLIMIT_NOFILE, &files); // 2 descriptors per client in this process
+	files.rlim_cur = files.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &files);
+	pthread_mutex_init(&sched_mutex, NULL);
+	clock_init();
+	build_lookup();
+	if (live_init(&live, &acts, &granny, lookup_table, false) != 0) { // the server looks activities up through it
+		printf("Not enough memory for the schedule\n");
+		return 1;
+	}
+	build_events(); // acknowledgements cancel warnings in the wheel (nobody fires them here)
+	snprintf(path, sizeof(path), "/tmp/granny-bench.%d", (int)getpid());
+	if (server_start(path) != 0) {
+		return 1;
+	}
+	printf("%8s %14s %12s %12s %12s %12s %8s\n", "clients", "queries/s", "p50 us", "p99 us", "p99.9 us", "max us", "errors");
+	for (clients = 1; clients <= 1000; clients *= 10) {
+		result |= load_generate(path, clients, BENCH_SERVER_SECONDS, true);
+	}
+	server_stop(path);
+	printf("(%d requests in flight per client, 90%% lookups and 10%% acknowledgements)\n", LOAD_DEPTH);
+	return result;
+}
+
+// Batch benchmark: the same random minutes matched with the scalar scan (schedule_find() for each query), with the
+// vectors and with the lookup table; then lines of text through batch_run() against fscanf() / fprintf() per line
+#define BENCH_BATCH_QUERIES 10000000
+#define BENCH_BATCH_LINES 2000000
+
+int bench_batch(void) {
+	int16_t *minutes = malloc(BENCH_BATCH_QUERIES * sizeof(*minutes));
+	int16_t *scalar = malloc(BENCH_BATCH_QUERIES * sizeof(*scalar));
+	int16_t *vector = malloc(BENCH_BATCH_QUERIES * sizeof(*vector));
+	int16_t *table = malloc(BENCH_BATCH_QUERIES * sizeof(*table));
+	unsigned long long seed = 88172645463325252ULL;
+	char path[64], line[16], time_text[6];
+	FILE *file, *null;
+	long long t0, t1, t2, t3;
+	long k, mismatches = 0;
+	int fd, null_fd, minute, j;
+	if (!minutes || !scalar || !vector || !table) {
+		printf("Not enough memory for %d queries\n", BENCH_BATCH_QUERIES);
+		return 1;
+	}
+	if (acts.count == 0 && !schedule_load_default(&acts)) {
+		printf("Not enough memory for the schedule\n");
+		return 1;
+	}
+	build_lookup();
+	for (k = 0; k < BENCH_BATCH_QUERIES; k++) {
+		minutes[k] = bench_random(&seed) % 1440;
+	}
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (k = 0; k < BENCH_BATCH_QUERIES; k++) {
+		scalar[k] = schedule_find(&acts, minutes[k]);
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	batch_match(&acts, minutes, vector, BENCH_BATCH_QUERIES); // a multiple of BATCH_LANES
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	for (k = 0; k < BENCH_BATCH_QUERIES; k++) {
+		table[k] = lookup_table[minutes[k]];
+	}
+	t3 = bench_ns(CLOCK_MONOTONIC);
+	for (k = 0; k < BENCH_BATCH_QUERIES; k++) {
+		mismatches += (scalar[k] != vector[k]) + (scalar[k] != table[k]);
+	}
+	printf("Matching %d random minutes against %d activities (%d lanes per vector):\n", BENCH_BATCH_QUERIES, acts.count, BATCH_LANES);
+	printf("%24s %12.1f Mqueries/s\n", "scalar scan", BENCH_BATCH_QUERIES / ((t1 - t0) / 1e3));
+	printf("%24s %12.1f Mqueries/s (x%.1f)\n", "vectors", BENCH_BATCH_QUERIES / ((t2 - t1) / 1e3), (double)(t1 - t0) / (t2 - t1));
+	printf("%24s %12.1f Mqueries/s (x%.1f)\n", "lookup table", BENCH_BATCH_QUERIES / ((t3 - t2) / 1e3), (double)(t1 - t0) / (t3 - t2));
+	if (mismatches) {
+		printf("Error: %ld different answers\n", mismatches);
+		return 1;
+	}
 
+	// End to end, from a file of HH:MM lines to /dev/null
+	snprintf(path, sizeof(path), "/tmp/granny-batch.%d", (int)getpid());
+	file = fopen(path, "w");
+	null = fopen("/dev/null", "w");
+	if (file == NULL || null == NULL) {
+		printf("Can't create %s\n", path);
+		return 1;
+	}
+	for (k = 0; k < BENCH_BATCH_LINES; k++) {
+		format_time(time_text, minutes[k]);
+		fprintf(file, "%s\n", time_text);
+	}
+	fclose(file);
+	file = fopen(path, "r");
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	while (fscanf(file, "%15s", line) == 1) { // what main() does for one prompt, for every line
+		j = -1;
+		minute = 0;
+		const char *p = line;
+		if (parse_time(&p, line + strlen(line), &minute)) {
+			j = lookup_scan(minute / 60, minute % 60);
 		}
+		fprintf(null, "%s\t%s\n", line, j >= 0 ? schedule_name(&acts, j) : "-");
+	}
+	fflush(null);
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	fclose(file);
+	fd = open(path, O_RDONLY);
+	null_fd = open("/dev/null", O_WRONLY);
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	batch_run(fd, null_fd);
+	t3 = bench_ns(CLOCK_MONOTONIC);
+	close(fd);
+	close(null_fd);
+	fclose(null);
+	unlink(path);
+	printf("Answering %d lines of a file (to /dev/null):\n", BENCH_BATCH_LINES);
+	printf("%24s %12.1f Mlines/s\n", "fscanf + fprintf", BENCH_BATCH_LINES / ((t1 - t0) / 1e3));
+	printf("%24s %12.1f Mlines/s (x%.1f)\n", "batch_run", BENCH_BATCH_LINES / ((t3 - t2) / 1e3), (double)(t1 - t0) / (t3 - t2));
+	free(minutes);
+	free(scalar);
+	free(vector);
+	free(table);
+	return 0;
+}
+
+// Journal benchmark: threads acknowledge every flag of 1M activities (3M transitions) without and with a journal;
+// the journal is then recovered into a fresh schedule (and checked), the next day comes while running (so the
+// journal thread compacts the stale records away as the new ones arrive), and the next day's journal is recovered
+#define BENCH_JOURNAL_ACTIVITIES 1000000
+
+struct bench_journal_arg {
+	struct schedule *sch;
+	uint32_t day;
+	int thread, threads;
+};
 
+void *bench_journal_worker(void *arg) {
+	struct bench_journal_arg *a = arg;
+	int i, f;
+	for (i = a->thread; i < a->sch->count; i += a->threads) {
+		for (f = 0; f < ACTIVITY_FLAGS; f++) {
+			schedule_transition(a->sch, i, a->day, f);
+		}
 	}
+	return 0;
+}
 
-// PHASE 2: After searching, print the right outputs and ensure latency between agenda printed outputs
-	if(flag == false){ // No activity found for the input data
-		pthread_mutex_lock(&time_mutex);
-		tm_local_ref = minimum_reference(); 
-		three_seconds(tm_local_ref);
-		printf("No activity scheduled for this time.\n");
-		capture(0);
-		pthread_mutex_unlock(&time_mutex);
-	}
-	else{ // If it's true, return the flag to false to continue to the next loop
-		pthread_mutex_lock(&time_mutex); 
-		tm_local_ref = minimum_reference();
-		three_seconds(tm_local_ref);
-		printf("Activity scheduled for this time: %s, with start time: %s and end time: %s\n", acts[j].name, acts[j].start_time, acts[j].end_time);
-		capture(0);
-		pthread_mutex_unlock(&time_mutex);
-		flag = false;
-
-		// Check here if the activity is undone / done
-		if( (strcmp(acts[j].state, "Undone")) ){ // 0 if both are identical -> "if" activates if result is '1' (activity is done)
-			pthread_mutex_lock(&time_mutex);
-			tm_local_ref = minimum_reference();
-			three_seconds(tm_local_ref);	
-			printf("Chill out! You already completed the activity: %s\n", acts[j].name);
-			capture(0);
-			pthread_mutex_unlock(&time_mutex);
-		
-		}
-		else{ // so if the result is 0 (meaning the activity is undone)
-			pthread_mutex_lock(&time_mutex);
-			tm_local_ref = minimum_reference();
-			three_seconds(tm_local_ref);
-			printf("Are you doing the activity: %s (yes/no)?\n", acts[j].name);
-			capture(3);
-			pthread_mutex_unlock(&time_mutex);
-
-			scanf("%s", answer); // just like before, add mutexes after the scanf
-
-			pthread_mutex_lock(&time_mutex);
-			capture(0);
-			pthread_mutex_unlock(&time_mutex);
-
-			// The following printf is just to verify it worked (can be commented out) 
-			//printf("Answer received: %s\n", answer); // this is for checking only (should be removed)
-		
-			if((strcmp(answer, "no"))){ //0 if both identical -> "if" activates if result is '1' (answer is yes)
-				pthread_mutex_lock(&state_mutex);
-				sleep(1);
-				strcpy(acts[j].state, "");
-				strcpy(acts[j].state, "Done");
-				pthread_mutex_unlock(&state_mutex);
-			}
-
-			strcpy(answer, ""); // reset string
-			// This part below is also to check, it can be commented out
-			//printf("State of activity: %s and contents of string answer: %s\n", acts[j].state, answer);
-		}
-
-	}
-
-	// This part is only for checking whether inputs were received correctly or not (this can be commented out)
-	// if(input_minute >= 10){
-	//	printf("Value received is: %d:%d\n",input_hour,input_minute);
-	// }
-	// else{
-	//	printf("Value received is: %d:0%d\n",input_hour,input_minute);
-	//}
+long bench_journal_compare(const struct schedule *a, const struct schedule *b) {
+	long mismatches = 0;
+	int i;
+	for (i = 0; i < a->count; i++) {
+		mismatches += (atomic_load(&a->state[i]) != atomic_load(&b->state[i]));
+	}
+	return mismatches;
 }
-return 0;
+
+long long bench_journal_run(struct schedule *sch, uint32_t day, int n_threads) {
+	struct bench_journal_arg args[8];
+	pthread_t threads[8];
+	long long t0 = bench_ns(CLOCK_MONOTONIC);
+	int t;
+	for (t = 0; t < n_threads; t++) {
+		args[t] = (struct bench_journal_arg){ sch, day, t, n_threads };
+		pthread_create(&threads[t], NULL, bench_journal_worker, &args[t]);
+	}
+	for (t = 0; t < n_threads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	return bench_ns(CLOCK_MONOTONIC) - t0;
 }
 
-// Function bodies ****************************************************************************************************
-struct tm minimum_reference(void) {
-// This function is just to find the latest static point of reference and later return it to the calling thread. 
-// Calls to this function are protected by mutexes.
-	struct tm result;
-	// keep tm static references in an array 
-	struct tm array_references_tm[4] = {tm_main, tm_th1, tm_th2, tm_granny};
-	// convert important metrics to int for easier manipulation 
-	int init_conversion    = tm_main.tm_hour*60     + tm_main.tm_min;
-	int thread1_conversion = tm_th1.tm_hour*60 + tm_th1.tm_min;
-	int thread2_conversion = tm_th2.tm_hour*60 + tm_th2.tm_min;
-	int granny_conversion =  tm_granny.tm_hour*60 + tm_granny.tm_min;
-	// keep the conversions in an array
-	int array_references_int[4] = {init_conversion, thread1_conversion, thread2_conversion, granny_conversion};
-	int k; // for index to go through the array above
-	int temp = init_conversion; //assume this is the minimum, to start with (the latest in time)
-	int result_index = 0; // preliminary condition if init is the minimum one (just assuming)
-	for(k=1; k<4; k++) {
-		if( array_references_int[k] > temp){ // if one of the others is bigger than the current result
-			temp = array_references_int[k];
-			result_index = k;
-		}
-	}
-	result = array_references_tm[result_index];
-	return result; 
-}
-
-void three_seconds(struct tm reference_point) {
-// This is the function that takes the latest static point of reference (any), and calculates 3 real time seconds 
-	struct tm current_struct; // keep track of local (current) time
-	int time_delta = 0; // local variable to keep the difference
-	time_t raw = time(NULL);
-	if (raw == -1){
-		printf("Error calculating raw time, please restart program.\n");
-	}
-	current_struct = *localtime(&raw);
-	// To avoid having multiple 'ifs' for all the possible cases (from one hour to the next, separate minutes, etc), transform
-	// everything to seconds. The largest possible value can be stored in an int variable
-	time_delta = (current_struct.tm_hour*3600 + current_struct.tm_min*60 + current_struct.tm_sec) - (reference_point.tm_hour*3600 + reference_point.tm_min*60 + reference_point.tm_sec);
-	// The printf below was a checkpoint, which can be commented out
-	// printf("Time_delta: %d\n, with tm_current_struct second: %d, tm_current_struct minute: %d and reference_point second: %d\n", time_delta, current_struct.tm_sec, current_struct.tm_min, reference_point.tm_sec);
-
-	if (time_delta < 3 && time_delta >= 0) { // includes the case in which both printfs happened at the same time 
-	// If more than 3 seconds have already passed (in the real world), then output will be printed immediately
-		while(time_delta < 3){
-			raw = time(NULL);
-			if (raw == -1){
-			 	printf("Error calculating raw time, please restart program.\n");
-			 	break;
-			}
-			current_struct = *localtime(&raw);
-			time_delta = (current_struct.tm_hour*3600 + current_struct.tm_min*60 + current_struct.tm_sec) - (reference_point.tm_hour*3600 + reference_point.tm_min*60 + reference_point.tm_sec);
-			// the instruction below was just to verify
-			//printf("Time delta: %d\n",time_delta);
+int bench_journal(void) {
+	struct schedule sch, recovered;
+	struct journal j, r;
+	char path[64];
+	struct stat info;
+	long long t0, t1, plain_ns, journal_ns;
+	int n_threads, i;
+	const double transitions = ACTIVITY_FLAGS * (double)BENCH_JOURNAL_ACTIVITIES;
+	snprintf(path, sizeof(path), "/tmp/granny-journal.%d", (int)getpid());
+	schedule_init(&sch);
+	schedule_init(&recovered);
+	for (i = 0; i < BENCH_JOURNAL_ACTIVITIES; i++) {
+		if (!schedule_add(&sch, i % 1440, (i + 30) % 1440, "Activity", 8, schedule_hash("Activity", 8)) ||
+		    !schedule_add(&recovered, i % 1440, (i + 30) % 1440, "Activity", 8, schedule_hash("Activity", 8))) {
+			printf("Not enough memory for %d activities\n", BENCH_JOURNAL_ACTIVITIES);
+			return 1;
 		}
 	}
+	printf("Acknowledging %.0f transitions (every flag of %d activities) in %s:\n", transitions, BENCH_JOURNAL_ACTIVITIES, path);
+	printf("%8s %16s %16s %12s %14s %14s\n", "threads", "no journal Mop/s", "journal Mop/s", "commits", "records/commit", "durable after");
+	for (n_threads = 1; n_threads <= 8; n_threads *= 2) {
+		schedule_reset(&sch);
+		plain_ns = bench_journal_run(&sch, 1, n_threads);
+		unlink(path);
+		schedule_reset(&sch);
+		if (journal_open(&j, path, &sch, 1) != 0) {
+			return 1;
+		}
+		journal_ns = bench_journal_run(&sch, 1, n_threads);
+		t0 = bench_ns(CLOCK_MONOTONIC);
+		journal_close(&j); // waits for the last commit
+		t1 = bench_ns(CLOCK_MONOTONIC);
+		printf("%8d %16.1f %16.1f %12lld %14.0f %11.1f ms\n", n_threads, transitions / (plain_ns / 1e3), transitions / (journal_ns / 1e3),
+			j.commits, (double)(j.records - 1) / j.commits, (t1 - t0) / 1e6);
+		if (j.lost) {
+			printf("Error: %lld records lost\n", j.lost);
+			return 1;
+		}
+	}
+
+	// Crash recovery of the last run
+	stat(path, &info);
+	schedule_reset(&recovered);
+	if (journal_open(&r, path, &recovered, 1) != 0) {
+		return 1;
+	}
+	printf("Recovery of %lld records (%.1f MB): %.1f ms (%.1f Mrecords/s), %lld replayed\n",
+		(long long)(info.st_size / sizeof(struct journal_record)), info.st_size / 1e6, r.recovery_ns / 1e6,
+		info.st_size / sizeof(struct journal_record) / (r.recovery_ns / 1e3), r.replayed);
+	if (bench_journal_compare(&sch, &recovered)) {
+		printf("Error: the recovered flags differ\n");
+		return 1;
+	}
+
+	// Two days later while running: the occurrences replace the old ones (nothing is reset) and everything in the
+	// file becomes stale
+	journal_ns = bench_journal_run(&recovered, 3, 1);
+	journal_close(&r);
+	stat(path, &info);
+	printf("Two days later: %.1f Mop/s, %lld compactions while running, %lld records in the file (%.1f MB)\n",
+		transitions / (journal_ns / 1e3), r.compactions, (long long)(info.st_size / sizeof(struct journal_record)), info.st_size / 1e6);
+	schedule_reset(&sch);
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	if (journal_open(&j, path, &sch, 3) != 0) {
+		return 1;
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	journal_close(&j);
+	printf("Recovery two days later: %.1f ms (%.1f ms with compaction and the thread), %lld replayed, %lld compactions\n",
+		j.recovery_ns / 1e6, (t1 - t0) / 1e6, j.replayed, j.compactions);
+	unlink(path);
+	if (bench_journal_compare(&sch, &recovered)) {
+		printf("Error: the recovered flags differ\n");
+		return 1;
+	}
+	schedule_free(&sch);
+	schedule_free(&recovered);
+	return 0;
+}
+
+// Live edits benchmark: the cost of an edit (in the afternoon, which is free) on top of schedules of 1k to 1M
+// activities (in the morning, overlapping) against rebuilding the lookup and the events of the whole schedule;
+// then threads asking for random minutes, alone and while edits run continuously (on the 1k schedule, until its
+// arrays are full), with their latencies
+#define BENCH_EDITS 20000
+#define BENCH_EDITS_SLOTS 72 // 10 minute slots in the afternoon
+#define BENCH_EDITS_READERS 2
+#define BENCH_EDITS_SECONDS 1
+
+struct bench_edits_arg {
+	struct live *l;
+	struct histogram latency;
+	_Atomic bool *stop;
+	unsigned long long seed;
+	long queries;
+	long found; // so the lookups aren't optimized away
+};
+
+void *bench_edits_reader(void *arg) {
+	struct bench_edits_arg *a = arg;
+	long long t0, t1 = bench_ns(CLOCK_MONOTONIC);
+	while (!atomic_load_explicit(a->stop, memory_order_relaxed)) {
+		t0 = t1;
+		a->found += live_lookup(a->l, bench_random(&a->seed) % (24*60)) >= 0;
+		t1 = bench_ns(CLOCK_MONOTONIC);
+		histogram_add(&a->latency, t1 - t0);
+		a->queries++;
+	}
+	return 0;
+}
 
+int bench_edits_step(struct live *l, struct wheel *w, bool occupied[], unsigned long long *seed) {
+// One random edit of the afternoon slots: add to a free slot, or move / remove an occupied one
+	char line[64];
+	int slot = bench_random(seed) % BENCH_EDITS_SLOTS, to = bench_random(seed) % BENCH_EDITS_SLOTS;
+	int start = 12*60 + slot*10, result;
+	if (!occupied[slot]) {
+		snprintf(line, sizeof(line), "add %d:%02d,%d:%02d,Visit", start / 60, start % 60, (start + 9) / 60, (start + 9) % 60);
+		occupied[slot] = true;
+	}
+	else if (!occupied[to] && (bench_random(seed) & 1)) {
+		snprintf(line, sizeof(line), "move %d:%02d %d:%02d,%d:%02d", start / 60, start % 60, (12*60 + to*10) / 60,
+			(12*60 + to*10) % 60, (12*60 + to*10 + 9) / 60, (12*60 + to*10 + 9) % 60);
+		occupied[slot] = false;
+		occupied[to] = true;
+	}
+	else {
+		snprintf(line, sizeof(line), "remove %d:%02d", start / 60, start % 60);
+		occupied[slot] = false;
+	}
+	result = live_edit(l, line, line + strlen(line));
+	live_timers(l, w);
+	return result;
 }
 
-void capture(int index) { // 0: main thread, 1: thread1, 2: thread2, 3: waiting for granny 
-// This function is to capture, in its respective variable, the last time a thread printed out something to the console or when
-// the user inputs something so they can observe 3 seconds from when they input information
-		if(index == 0) {
-			raw_init = time(NULL);
-			if (raw_init == -1){
-			 	printf("Error calculating raw time; please restart program.\n");
+int bench_edits(void) {
+	static int sizes[] = { 1000000, 100000, 1000 }; // the last one is kept for the latencies (room for 1M edits)
+	static struct live l, full;
+	static struct version rebuilt;
+	struct schedule sch;
+	struct agenda a;
+	struct wheel w;
+	struct event *events;
+	struct bench_edits_arg args[BENCH_EDITS_READERS];
+	pthread_t threads[BENCH_EDITS_READERS];
+	_Atomic bool stop;
+	bool occupied[BENCH_EDITS_SLOTS];
+	unsigned long long seed = 88172645463325252ULL;
+	long long t0, t1, queries;
+	long edits;
+	int s, i, k, start, phase;
+	struct histogram latency;
+	clock_init();
+	printf("%12s %16s %18s %22s\n", "activities", "edit (us)", "grace period (us)", "full rebuild (us)");
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+		schedule_init(&sch);
+		for (i = 0; i < sizes[s]; i++) {
+			start = bench_random(&seed) % 690;
+			if (!schedule_add(&sch, start, start + bench_random(&seed) % 30, "Morning", 7, schedule_hash("Morning", 7))) {
+				printf("Not enough memory for %d activities\n", sizes[s]);
+				return 1;
 			}
-			tm_main = *localtime(&raw_init);
 		}
-		else if(index == 1) { // thread 1: the one that prints start + changes internal states
-			raw_th1 = time(NULL);
-			if (raw_th1 == -1){
-			 	printf("Error calculating raw time; please restart program.\n");
-			}
-			tm_th1 = *localtime(&raw_th1);
+		// Rebuilding everything: every minute of every activity, and every event
+		t0 = bench_ns(CLOCK_MONOTONIC);
+		memset(&full, 0, sizeof(full));
+		full.sch = &sch;
+		for (k = 0; k < 24*60; k++) {
+			rebuilt.lookup[k] = -1;
+		}
+		for (i = 0; i < sch.count; i++) {
+			live_cover(&full, &rebuilt, i, 1);
+		}
+		a = (struct agenda){ .sch = &sch };
+		wheel_init(&w, internal_now());
+		agenda_build(&a, &w, internal_now());
+		t1 = bench_ns(CLOCK_MONOTONIC);
+		events = a.events;
+		a.events = NULL;
+		free(events);
+		schedule_reset(&sch);
 
+		// Editing it
+		wheel_init(&w, internal_now());
+		if (live_init(&l, &sch, &a, rebuilt.lookup, true) != 0) {
+			printf("Not enough memory for the live schedule\n");
+			return 1;
 		}
-		else if (index == 2) { // thread 2: the one that watches out for the last 10 remaining minutes
-			raw_th2 = time(NULL);
-			if (raw_th2 == -1){
-			 	printf("Error calculating raw time; please restart program.\n");
+		l.quiet = true;
+		agenda_build(&a, &w, internal_now());
+		memset(occupied, 0, sizeof(occupied));
+		for (k = 0; k < BENCH_EDITS; k++) {
+			if (bench_edits_step(&l, &w, occupied, &seed) != 0) {
+				return 1;
 			}
-			tm_th2 = *localtime(&raw_th2);
 		}
+		printf("%12d %16.2f %18.2f %22.0f\n", sizes[s], l.edit_ns / 1e3 / l.edits, l.grace_ns / 1e3 / l.edits, (t1 - t0) / 1e3);
+		if (s < (int)(sizeof(sizes) / sizeof(sizes[0])) - 1) {
+			live_free(&l);
+			schedule_free(&sch);
+		}
+	}
 
-		else { // 3: when waiting for granny (so other threads won't get locked)
-			raw_granny = time(NULL);
-			if (raw_granny == -1) {
-			 	printf("Error calculating raw time; please restart program.\n");			
+	// Query latency, with the last schedule
+	printf("%d threads asking for random minutes for %d s:\n", BENCH_EDITS_READERS, BENCH_EDITS_SECONDS);
+	printf("%12s %14s %10s %10s %10s %10s %10s\n", "edits", "Mqueries/s", "p50 (ns)", "p99", "p99.9", "max", "edits/s");
+	for (phase = 0; phase < 2; phase++) {
+		atomic_init(&stop, false);
+		for (k = 0; k < BENCH_EDITS_READERS; k++) {
+			memset(&args[k], 0, sizeof(args[k]));
+			args[k].l = &l;
+			args[k].stop = &stop;
+			args[k].seed = seed + k * 7919;
+			pthread_create(&threads[k], NULL, bench_edits_reader, &args[k]);
+		}
+		edits = 0;
+		t0 = bench_ns(CLOCK_MONOTONIC);
+		do {
+			if (phase == 1) {
+				if (l.sch->count + 1 == LIVE_CAPACITY) { // (the arrays are append-only)
+					break;
+				}
+				if (bench_edits_step(&l, &w, occupied, &seed) != 0) {
+					return 1;
+				}
+				edits++;
+			}
+			else {
+				usleep(10000);
 			}
-			tm_granny = *localtime(&raw_granny);
+		} while ((t1 = bench_ns(CLOCK_MONOTONIC)) - t0 < BENCH_EDITS_SECONDS * 1000000000LL);
+		atomic_store(&stop, true);
+		memset(&latency, 0, sizeof(latency));
+		for (queries = 0, k = 0; k < BENCH_EDITS_READERS; k++) {
+			pthread_join(threads[k], NULL);
+			histogram_merge(&latency, &args[k].latency);
+			queries += args[k].queries;
 		}
+		printf("%12s %14.1f %10lld %10lld %10lld %10lld %10.0f\n", phase ? "continuous" : "none", queries / ((t1 - t0) / 1e3),
+			histogram_percentile(&latency, 50), histogram_percentile(&latency, 99), histogram_percentile(&latency, 99.9),
+			(long long)latency.max, edits / ((t1 - t0) / 1e9));
+	}
+	live_free(&l);
+	schedule_free(&sch);
+	return 0;
+}
 
+// Interval index benchmark: 1M activities of up to 15 minutes starting in the first half of the hours from 6:00 to
+// 21:59 (so every hour has a free quarter) and a night one, asked about random spans of the day (some across
+// midnight) and free slots of 5 to 60 minutes, by the index and by linear scans that must give the same answers; then
+// the overlap check against comparing every pair of pieces, which is only done for the first 20k activities
+#define BENCH_INTERVALS 1000000
+#define BENCH_INTERVALS_QUERIES 500
+#define BENCH_INTERVALS_PAIRS 20000
+
+bool bench_intervals_contains(int start, int end, int minute) {
+	return start <= end ? (minute >= start && minute <= end) : (minute >= start || minute <= end);
 }
 
-void *f1(){
-// This thread will have its own internal clock and check the activities, to see which one will start next.
-// It will also change an activity's state to 'done' if the ending has been reached (so it will check the start and finish)
+int bench_intervals(void) {
+	struct schedule sch;
+	struct intervals x;
+	int *found = malloc(BENCH_INTERVALS * sizeof(*found));
+	int *starts = malloc(BENCH_INTERVALS_QUERIES * sizeof(*starts));
+	int *lengths = malloc(BENCH_INTERVALS_QUERIES * sizeof(*lengths));
+	int *answers = malloc(BENCH_INTERVALS_QUERIES * sizeof(*answers));
+	unsigned long long seed = 88172645463325252ULL;
+	unsigned long long r, sum_index = 0, sum_scan = 0;
+	long long t0, t1, t2;
+	long found_index = 0, found_scan = 0, count, k, mismatches = 0, pieces;
+	long overlaps_index, overlaps_counted, overlaps_pairs;
+	int covering[24*60 + 1];
+	uint16_t pair_start[2*BENCH_INTERVALS_PAIRS], pair_end[2*BENCH_INTERVALS_PAIRS];
+	int i, q, start, minute, slot, covered, a = -1, b = -1;
+	if (!found || !starts || !lengths || !answers) {
+		printf("Not enough memory for %d activities\n", BENCH_INTERVALS);
+		return 1;
+	}
+	schedule_init(&sch);
+	for (i = 0; i < BENCH_INTERVALS; i++) {
+		r = bench_random(&seed);
+		start = (6 + r % 16)*60 + (r >> 8) % 30;
+		if (!schedule_add(&sch, (i == 0) ? 22*60 + 30 : start, (i == 0) ? 6*60 + 15 : start + (r >> 16) % 15, "Activity", 8,
+		    schedule_hash("Activity", 8))) {
+			printf("Not enough memory for %d activities\n", BENCH_INTERVALS);
+			return 1;
+		}
+	}
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	if (intervals_build(&x, &sch) != 0) {
+		printf("Not enough memory for the index\n");
+		return 1;
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	printf("%d activities (%ld pieces): index built in %.1f ms\n", sch.count, x.count, (t1 - t0) / 1e6);
+	printf("%22s %14s %14s %10s %17s\n", "question", "index (us)", "scan (us)", "speedup", "found / question");
+
+	// Spans of the day: the index, then every activity checked
+	for (q = 0; q < BENCH_INTERVALS_QUERIES; q++) {
+		starts[q] = bench_random(&seed) % (24*60);
+		lengths[q] = bench_random(&seed) % 60;
+	}
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (q = 0; q < BENCH_INTERVALS_QUERIES; q++) {
+		count = intervals_range(&x, starts[q], (starts[q] + lengths[q]) % (24*60), found, BENCH_INTERVALS);
+		for (k = 0; k < count; k++) {
+			sum_index += found[k];
+		}
+		found_index += count;
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	for (q = 0; q < BENCH_INTERVALS_QUERIES; q++) {
+		for (i = 0; i < sch.count; i++) {
+			if (bench_intervals_contains(sch.start[i], sch.end[i], starts[q]) ||
+			    bench_intervals_contains(starts[q], (starts[q] + lengths[q]) % (24*60), sch.start[i])) {
+				sum_scan += i;
+				found_scan++;
+			}
+		}
+	}
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	printf("%22s %14.1f %14.1f %10.1f %17.0f\n", "activities in a span", (t1 - t0) / 1e3 / BENCH_INTERVALS_QUERIES,
+		(t2 - t1) / 1e3 / BENCH_INTERVALS_QUERIES, (double)(t2 - t1) / (t1 - t0), (double)found_index / BENCH_INTERVALS_QUERIES);
+	if (found_index != found_scan || sum_index != sum_scan) {
+		printf("Error: the index found %ld activities, the scan %ld\n", found_index, found_scan);
+		mismatches++;
+	}
+
+	// Free slots: the index, then the minutes covered counted from every activity and the candidates tried in turn
+	for (q = 0; q < BENCH_INTERVALS_QUERIES; q++) {
+		lengths[q] = 5 + bench_random(&seed) % 56;
+	}
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (q = 0; q < BENCH_INTERVALS_QUERIES; q++) {
+		answers[q] = intervals_free_slot(&x, lengths[q], starts[q]);
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	found_scan = found_index = 0;
+	for (q = 0; q < BENCH_INTERVALS_QUERIES; q++) {
+		memset(covering, 0, sizeof(covering));
+		for (i = 0; i < sch.count; i++) {
+			covering[sch.start[i]]++;
+			if (sch.end[i] < sch.start[i]) {
+				covering[24*60]--;
+				covering[0]++;
+			}
+			covering[sch.end[i] + 1]--;
+		}
+		for (minute = 1; minute < 24*60; minute++) {
+			covering[minute] += covering[minute - 1];
+		}
+		slot = -1;
+		for (k = 0; k < 24*60 && slot < 0; k++) {
+			start = (starts[q] + k) % (24*60);
+			for (covered = 0, minute = 0; minute <= lengths[q] && !covered; minute++) {
+				covered = covering[(start + minute) % (24*60)];
+			}
+			if (!covered) {
+				slot = start;
+			}
+		}
+		found_index += (answers[q] >= 0);
+		found_scan += (slot >= 0);
+		if (slot != answers[q]) {
+			printf("Error: free slot of %d minutes after minute %d: %d with the index, %d with the scan\n", lengths[q],
+				starts[q], answers[q], slot);
+			mismatches++;
+		}
+	}
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	printf("%22s %14.2f %14.1f %10.0f %17.2f\n", "first free slot", (t1 - t0) / 1e3 / BENCH_INTERVALS_QUERIES,
+		(t2 - t1) / 1e3 / BENCH_INTERVALS_QUERIES, (double)(t2 - t1) / (t1 - t0), (double)found_index / BENCH_INTERVALS_QUERIES);
+
+	// Overlaps: the index and the counts of schedule_overlaps() at 1M, then the first activities against every pair
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	overlaps_index = intervals_overlaps(&x, local_day(), &a, &b);
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	overlaps_counted = schedule_overlaps(&sch, local_day(), &a, &b);
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	printf("Overlap check of %d activities: %.1f ms with the index, %.1f ms counting the starts of each minute (%ld pieces start during another one)\n",
+		BENCH_INTERVALS, (t1 - t0) / 1e6, (t2 - t1) / 1e6, overlaps_index);
+	intervals_free(&x);
+	sch.count = BENCH_INTERVALS_PAIRS;
+	for (i = 0, pieces = 0; i < sch.count; i++) { // in the order of the index within a minute
+		pair_start[pieces] = sch.start[i];
+		pair_end[pieces++] = (sch.end[i] < sch.start[i]) ? 24*60 - 1 : sch.end[i];
+		if (sch.end[i] < sch.start[i]) {
+			pair_start[pieces] = 0;
+			pair_end[pieces++] = sch.end[i];
+		}
+	}
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (k = 0, overlaps_pairs = 0; k < pieces; k++) { // starting during a piece sorted before it
+		for (count = 0; count < pieces; count++) {
+			if (count != k && (pair_start[count] < pair_start[k] || (pair_start[count] == pair_start[k] && count < k)) &&
+			    pair_end[count] >= pair_start[k]) {
+				overlaps_pairs++;
+				break;
+			}
+		}
+	}
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	if (intervals_build(&x, &sch) != 0) {
+		printf("Not enough memory for the index\n");
+		return 1;
+	}
+	count = intervals_overlaps(&x, local_day(), &a, &b);
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	printf("Overlap check of %d activities: %.2f ms building the index and checking, %.1f ms comparing every pair\n",
+		BENCH_INTERVALS_PAIRS, (t2 - t1) / 1e6, (t1 - t0) / 1e6);
+	if (overlaps_index != overlaps_counted || count != overlaps_pairs || schedule_overlaps(&sch, local_day(), &a, &b) != count) {
+		printf("Error: the overlaps found differ\n");
+		mismatches++;
+	}
+	intervals_free(&x);
+	sch.count = BENCH_INTERVALS;
+	schedule_free(&sch);
+	free(found);
+	free(starts);
+	free(lengths);
+	free(answers);
+	return mismatches > 0;
+}
 
-// Local variables for thread 1
-struct tm tm_thread1; // struct for the thread's internal clock
-int j = 0; // index for the for loop below 
-int counter_one = 0; // counter for the thread
+// Output benchmark: threads sending notifications as fast as they can for a second, the old way (a mutex held around
+// fprintf() + fflush() to a file, like the printf()s that were done under time_mutex) and through the ring with the
+// console off, to the log file and then to the log file and a datagram socket read by another thread. Gives how long
+// the mutex is held / output() takes, messages per second and messages per system call of the sinks.
+#define BENCH_OUTPUT_SECONDS 1
 
-	while ( counter_one < 8 ){
-		for(j=0;j<8;j++){ // go through the activities
-			// Check the internal time first to look for any candidates
-			// Use the mutex destined for internal clock protection
-			pthread_mutex_lock(&internal_mutex);
-			tm_thread1.tm_sec = tm_internal.tm_sec;
-			tm_thread1.tm_min = tm_internal.tm_min;
-			tm_thread1.tm_hour = tm_internal.tm_hour; // this can also be changed to tm_thread1 = tm_internal
-			pthread_mutex_unlock(&internal_mutex);
-			sched_yield(); // important for the CPU
-			
-			// This part below was just a checkpoint to verify behavior (it's commented out)
-			//printf("Testing data, hour: %d and minute: %d and j: %d, and counter: %d, activity state: %s, and counted: %d\n", tm_thread1.tm_hour, tm_thread1.tm_min, j, counter_one, acts[j].state, acts[j].counted);
+struct bench_output_arg {
+	pthread_mutex_t *mutex; // NULL: through output()
+	FILE *file;
+	_Atomic bool *stop;
+	struct histogram latency; // of the mutex being held / of output()
+	long messages;
+	long retries; // the ring was full (the message went to the overflow), waited for the dispatcher to empty it
+};
 
-			// Part 1: check if an activity is starting now (based on internal clock)
-			if ( (acts[j].start_hour == tm_thread1.tm_hour) && (acts[j].start_minute == tm_thread1.tm_min) ){
-				// We should print this out 3 seconds after the last message printed to the console		
-				pthread_mutex_lock(&time_mutex);
-				struct tm tm_thread1_2 = minimum_reference(); // struct used for real world clock
-				three_seconds(tm_thread1_2);
-				printf("Activity: %s is starting now, hour: %d and minute: %d\n", acts[j].name, tm_thread1.tm_hour, tm_thread1.tm_min);		
-				capture(1); // capture the last time the thread printed out something to the console
-				pthread_mutex_unlock(&time_mutex);
-				sleep(20);  // sleep to only print the start once; seconds here depend on frequency
+void *bench_output_worker(void *arg) {
+	struct bench_output_arg *a = arg;
+	long long t0, t1;
+	while (!atomic_load_explicit(a->stop, memory_order_relaxed)) {
+		if (a->mutex) {
+			pthread_mutex_lock(a->mutex);
+			t0 = bench_ns(CLOCK_MONOTONIC);
+			fprintf(a->file, "Activity: %s will be finishing in 10 minutes.\n", "Go for a walk");
+			fflush(a->file);
+			t1 = bench_ns(CLOCK_MONOTONIC);
+			pthread_mutex_unlock(a->mutex);
+		}
+		else {
+			if (atomic_load_explicit(&output_overflowing, memory_order_relaxed) > 0) { // what's measured is the ring
+				a->retries++;
+				sched_yield(); // let the dispatcher empty it
+				continue;
+			}
+			t0 = bench_ns(CLOCK_MONOTONIC);
+			if (!output("Activity: %s will be finishing in 10 minutes.\n", "Go for a walk")) {
+				break;
 			}
+			t1 = bench_ns(CLOCK_MONOTONIC);
+		}
+		histogram_add(&a->latency, t1 - t0);
+		a->messages++;
+	}
+	return 0;
+}
+
+void *bench_output_reader(void *arg) {
+// The other end of the datagram socket, until it's shut down
+	int fd = *(int *)arg;
+	char buffer[OUTPUT_TEXT + 16];
+	while (recv(fd, buffer, sizeof(buffer), 0) > 0) {
+	}
+	return 0;
+}
 
-						
-			if ( ( (acts[j].end_hour == tm_thread1.tm_hour) && (acts[j].end_minute < tm_thread1.tm_min) ) || 
-(acts[j].end_hour < tm_thread1.tm_hour) ) { // when an activity just finished or finished in some past hour
-				if( ((strcmp(acts[j].state, "Done")) && (acts[j].counted == 0) && (counter_one < 7)) && acts[j].start_hour <= acts[j].end_hour ){ // all activities except the last one 
-					pthread_mutex_lock(&state_mutex);
-					sleep(6);					
-					strcpy(acts[j].state, "");
-					strcpy(acts[j].state, "Done");
-					acts[j].counted = 1;
-					pthread_mutex_unlock(&state_mutex);
-					// The following was just used to verify behavior, it can be commented out
-					//printf("State of activity: %s and name of activity: %s\n", acts[j].state, acts[j].name);				
-					counter_one++;
+int bench_output(void) {
+	static int threads_counts[] = { 1, 4 };
+	static const char *ways[] = { "mutex + fprintf", "ring + log", "ring + log + socket" };
+	struct bench_output_arg args[4];
+	pthread_t threads[4], thread_output, thread_reader;
+	pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	struct sockaddr_un address;
+	struct histogram latency;
+	_Atomic bool stop;
+	char path[64], socket_path[64], rotated[80], sends[16];
+	FILE *file;
+	long long t0, t1;
+	long messages, retries, calls;
+	int t, way, k, reader_fd, threads_count;
+
+	clock_init();
+	output_console = false;
+	snprintf(path, sizeof(path), "/tmp/granny-output.%d", (int)getpid());
+	snprintf(socket_path, sizeof(socket_path), "/tmp/granny-output.%d.sock", (int)getpid());
+	reader_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	if (reader_fd == -1 || bind(reader_fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+		printf("Can't bind %s: %s\n", socket_path, strerror(errno));
+		return 1;
+	}
+	pthread_create(&thread_reader, NULL, bench_output_reader, &reader_fd);
+
+	printf("%8s %20s %12s %10s %10s %10s %12s %12s %10s\n", "threads", "way", "kmsgs/s", "p50 (ns)", "p99", "max",
+		"msgs/write", "msgs/send", "lost");
+	for (t = 0; t < (int)(sizeof(threads_counts) / sizeof(threads_counts[0])); t++) {
+		threads_count = threads_counts[t];
+		for (way = 0; way < 3; way++) {
+			file = NULL;
+			if (way == 0) {
+				file = fopen(path, "w");
+				if (file == NULL) {
+					printf("Can't open %s: %s\n", path, strerror(errno));
+					return 1;
+				}
+			}
+			else {
+				output_init();
+				output_log_messages = output_log_writes = output_log_rotations = output_log_lost = 0;
+				output_socket_messages = output_socket_calls = output_socket_lost = 0;
+				output_log_fd = output_socket_fd = -1;
+				unlink(path);
+				if (output_sinks_open(path, way == 2 ? socket_path : NULL) != 0) {
+					return 1;
+				}
+				atomic_store(&output_stop, false);
+				pthread_create(&thread_output, NULL, dispatcher, NULL);
+			}
+			atomic_init(&stop, false);
+			for (k = 0; k < threads_count; k++) {
+				memset(&args[k], 0, sizeof(args[k]));
+				args[k].mutex = way == 0 ? &mutex : NULL;
+				args[k].file = file;
+				args[k].stop = &stop;
+				pthread_create(&threads[k], NULL, bench_output_worker, &args[k]);
+			}
+			t0 = bench_ns(CLOCK_MONOTONIC);
+			usleep(BENCH_OUTPUT_SECONDS * 1000000);
+			atomic_store(&stop, true);
+			memset(&latency, 0, sizeof(latency));
+			for (messages = 0, retries = 0, k = 0; k < threads_count; k++) {
+				pthread_join(threads[k], NULL);
+				histogram_merge(&latency, &args[k].latency);
+				messages += args[k].messages;
+				retries += args[k].retries;
+			}
+			if (way == 0) {
+				fclose(file);
+				calls = messages;
+			}
+			else { // what's still in the ring is counted, it's written before the dispatcher finishes
+				atomic_store(&output_stop, true);
+				sem_post(&output_ready);
+				pthread_join(thread_output, NULL);
+				close(output_log_fd);
+				if (output_socket_fd != -1) {
+					close(output_socket_fd);
 				}
+				calls = output_log_writes;
+			}
+			t1 = bench_ns(CLOCK_MONOTONIC);
+			strcpy(sends, "-");
+			if (way == 2 && output_socket_calls > 0) {
+				snprintf(sends, sizeof(sends), "%.1f", (double)output_socket_messages / output_socket_calls);
+			}
+			printf("%8d %20s %12.0f %10lld %10lld %10lld %12.1f %12s %10ld\n", threads_count, ways[way],
+				messages / ((t1 - t0) / 1e6), histogram_percentile(&latency, 50), histogram_percentile(&latency, 99),
+				(long long)latency.max, calls ? (double)messages / calls : 0.0, sends,
+				way == 0 ? 0 : output_log_lost + output_socket_lost);
+			if (retries > 0) {
+				printf("%8s %20s (the ring was full %ld times)\n", "", "", retries);
+			}
+		}
+	}
+	shutdown(reader_fd, SHUT_RDWR);
+	pthread_join(thread_reader, NULL);
+	close(reader_fd);
+	unlink(socket_path);
+	unlink(path);
+	for (k = 1; k <= OUTPUT_LOG_KEEP; k++) {
+		snprintf(rotated, sizeof(rotated), "%s.%d", path, k);
+		unlink(rotated);
+	}
+	return 0;
+}
+
+// Start-up benchmark: the schedule the agenda was compiled with (see the compiled schedule section) against parsing
+// the file it was compiled from, or the predesigned schedule written to a file if none was given. In this process:
+// loading it, the lookup table and the first version of the live schedule, then the first question (the first
+// run, whose pages aren't touched yet, and the median of the others); and from starting another agenda (--batch)
+// to reading its answer to one question
+#define BENCH_STARTUP_RUNS 21
+
+int bench_startup_compare(const void *a, const void *b) {
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+long long bench_startup_process(char *const args[]) {
+	posix_spawn_file_actions_t actions;
+	int in[2], out[2], status;
+	char buffer[4096];
+	ssize_t bytes;
+	long long t0, answered = -1;
+	pid_t pid;
+	if (pipe(in) == -1 || pipe(out) == -1) {
+		return -1;
+	}
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, in[1]);
+	posix_spawn_file_actions_addclose(&actions, out[0]);
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	if (posix_spawn(&pid, "/proc/self/exe", &actions, NULL, args, environ) != 0) {
+		posix_spawn_file_actions_destroy(&actions);
+		return -1;
+	}
+	posix_spawn_file_actions_destroy(&actions);
+	close(in[0]);
+	close(out[1]);
+	write_all(in[1], "12:30\n", 6);
+	close(in[1]);
+	while ((bytes = read(out[0], buffer, sizeof(buffer))) > 0) {
+		if (answered < 0 && memchr(buffer, '\n', bytes)) {
+			answered = bench_ns(CLOCK_MONOTONIC) - t0;
+		}
+	}
+	close(out[0]);
+	waitpid(pid, &status, 0);
+	return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? answered : -1;
+}
+
+int bench_startup(void) {
+	static const char *ways[] = { "parsed", "compiled" };
+	char path[64];
+	char *args[5];
+	const char *source = NULL;
+	long long startup[BENCH_STARTUP_RUNS], query[BENCH_STARTUP_RUNS], process[BENCH_STARTUP_RUNS];
+	long long t0, t1, t2;
+	long found = 0;
+	int way, run, i, j;
+	FILE *file;
+	clock_init();
+#ifdef GRANNY_SCHEDULE
+	source = COMPILED_SOURCE;
+#endif
+	if (source == NULL) {
+		snprintf(path, sizeof(path), "/tmp/granny-startup.%d", (int)getpid());
+		file = fopen(path, "w");
+		if (file == NULL) {
+			printf("Can't open %s: %s\n", path, strerror(errno));
+			return 1;
+		}
+		for (i = 0; i < (int)(sizeof(default_acts) / sizeof(default_acts[0])); i++) {
+			fprintf(file, "%02d:%02d,%02d:%02d,%s\n", default_acts[i].start_hour, default_acts[i].start_minute,
+				default_acts[i].end_hour, default_acts[i].end_minute, default_acts[i].name);
+		}
+		fclose(file);
+		source = path;
+	}
+	printf("schedule: %s\n", source);
+	printf("%10s %18s %18s %18s %18s %18s\n", "", "start-up (us)", "warm start-up", "first query (ns)", "warm query",
+		"process (us)");
+	for (way = 0; way < 2; way++) {
+		if (way == 1 && !schedule_load_compiled(&acts)) {
+			printf("%10s (build with -DGRANNY_SCHEDULE='\"FILE\"' after ./granny --schedule ... --compile FILE)\n", ways[way]);
+			break;
+		}
+		schedule_free(&acts);
+		for (run = 0; run < BENCH_STARTUP_RUNS; run++) {
+			t0 = bench_ns(CLOCK_MONOTONIC);
+			if (way == 0 ? load_schedule(source) != 0 : !schedule_load_compiled(&acts)) {
+				return 1;
+			}
+			build_lookup();
+			if (live_init(&live, &acts, &granny, lookup_table, false) != 0) {
+				printf("Not enough memory for the live schedule\n");
+				return 1;
 			}
+			t1 = bench_ns(CLOCK_MONOTONIC);
+			if ((j = live_lookup(&live, 12*60 + 30)) >= 0) {
+				found += schedule_name(&acts, j)[0];
+			}
+			t2 = bench_ns(CLOCK_MONOTONIC);
+			startup[run] = t1 - t0;
+			query[run] = t2 - t1;
+			live_free(&live);
+			schedule_free(&acts);
 
-			if ((strcmp(acts[j].state, "Undone")) && (acts[j].counted == 0)) { // if granny changed an activity to 'done'
-				acts[j].counted = 1;
-				// The part below was just a checkpoint; it can be removed
-				//printf("(in else) state of activity: %s and name of activity: %s\n", acts[j].state, acts[j].name);				
-				counter_one++;
-			}	
+			i = 0;
+			args[i++] = "granny";
+			if (way == 0) {
+				args[i++] = "--schedule";
+				args[i++] = (char *)source;
+			}
+			args[i++] = "--batch";
+			args[i] = NULL;
+			if ((process[run] = bench_startup_process(args)) < 0) {
+				printf("The agenda started for %s didn't answer\n", ways[way]);
+				return 1;
+			}
+		}
+		qsort(startup + 1, BENCH_STARTUP_RUNS - 1, sizeof(startup[0]), bench_startup_compare);
+		qsort(query + 1, BENCH_STARTUP_RUNS - 1, sizeof(query[0]), bench_startup_compare);
+		qsort(process, BENCH_STARTUP_RUNS, sizeof(process[0]), bench_startup_compare);
+		printf("%10s %18.1f %18.1f %18lld %18lld %18.1f\n", ways[way], startup[0] / 1e3, startup[BENCH_STARTUP_RUNS / 2] / 1e3,
+			query[0], query[BENCH_STARTUP_RUNS / 2], process[BENCH_STARTUP_RUNS / 2] / 1e3);
+	}
+	if (source == path) {
+		unlink(path);
+	}
+	return found < 0;
+}
 
-			// The last activity to check for is when granny goes to sleep (critical since hours restart)
-			if ( (counter_one == 7) && (acts[j].start_hour > acts[j].end_hour) && (strcmp(acts[j].state, "Done")) && (acts[j].counted == 0) && (tm_thread1.tm_hour <= acts[0].start_hour) ) { // Only to be marked as done once all other activities are ready	
-				if( ( (acts[j].end_hour == tm_thread1.tm_hour) && (acts[j].end_minute < tm_thread1.tm_min) ) || (acts[j].end_hour < tm_thread1.tm_hour) ) { // now, the usual condition 				
-					pthread_mutex_lock(&state_mutex);					
-					strcpy(acts[j].state, "");
-					strcpy(acts[j].state, "Done");
-					acts[j].counted = 1;
-					pthread_mutex_unlock(&state_mutex);
-					// The following is just to verify (can be deleted)
-					//printf("State of activity: %s and name of activity: %s\n", acts[j].state, acts[j].name);
-					counter_one++;
-				}	
-
-			}
-			
-
-		}
-	}
-	//pthread_exit(NULL); // if all the activities are done exit
-	return 0; // instead of the return 0, pthread_exit(NULL) can be used
-} // thread1 function
-
-
-void *f2(){
-// Thread 2 will have its own internal clock too and check the activities. 
-// The goal is to check when there are 10 minutes remaining.
+// Lateness benchmark: 100k activities timed to the millisecond start within 5 seconds of real time (at x1) and the
+// scheduler thread notifies them like it does granny's, quietly (nothing printed). fire_due() measures each
+// notification against its deadline into the lateness histogram of a private stats page, so the percentiles are the
+// upper bounds of their buckets (within 6%). Run with the default timer slack (50 us) and with 1 us (--timer-slack):
+// the p99 has to stay under 1 ms. The same thread sleeping to absolute deadlines 1 ms apart, with nothing else to do,
+// is measured first: that's what the kernel (or the virtual machine) gives any timer, the scheduler is only to
+// blame for what it adds to it.
+#define BENCH_LATENESS 100000
+#define BENCH_LATENESS_SPREAD_MS 5000
+#define BENCH_LATENESS_SLEEPS 5000
 
-// Local variables
-struct tm tm_thread2; // struct for the thread's internal clock
-int j = 0; // index for the for loop below 
-int counter_two = 0; // if the activity has been changed to "done", then update the counter
-
-	while ( counter_two < 8 ){	
-		for(j=0;j<8;j++){ // check the activities
-			// Just like for thread 1, check the internal clock first
-			sched_yield(); // important for the CPU
-			pthread_mutex_lock(&internal_mutex);
-			tm_thread2.tm_sec = tm_internal.tm_sec;
-			tm_thread2.tm_min = tm_internal.tm_min;
-			tm_thread2.tm_hour = tm_internal.tm_hour; // again, this can be changed for tm_thread2 = tm_internal
-			pthread_mutex_unlock(&internal_mutex);
-
-			// The printf below was used only to to verify behavior (can be deleted)
-			//printf("Thread2, Testing data, hour: %d and minute: %d and j: %d, and counter: %d, activity state: %s, and counted: %d\n", tm_thread2.tm_hour, tm_thread2.tm_min, j, counter_two, acts[j].state, acts[j].counted2);			
-
-			if ( (strcmp(acts[j].state, "Done")) ){ // 1 if different, meaning activity is undone
- 
-				if ( ( (acts[j].end_hour == tm_thread2.tm_hour) && (acts[j].end_minute == (tm_thread2.tm_min+10)) && (acts[j].end_hour != 0) ) || 
- ( (acts[j].end_hour == (tm_thread2.tm_hour+1)) && ((acts[j].end_minute+50) == (tm_thread2.tm_min)) && (acts[j].end_hour != 0) ) || 
- ( (tm_thread2.tm_hour + 1 == acts[j].end_hour + 24 ) &&  ((acts[j].end_minute+50) == (tm_thread2.tm_min)) ) 
-  ) { // (10 mins remaining, normal case) || (when passing from one hour to another) || (edge case, something ending at midnight)
-					pthread_mutex_lock(&time_mutex);
-					struct tm tm_thread2_2 = minimum_reference(); // to store real world reference
-					three_seconds(tm_thread2_2);
-					//printf("Activity: %s will be finishing in 10 minutes, internal hour: %d and minute: %d; tm copy (reference) has hour: %d and minute: %d\n", acts[j].name, tm_thread2.tm_hour, tm_thread2.tm_min, tm_thread2_2.tm_hour, tm_thread2_2.tm_min);
-					printf("Activity: %s will be finishing in 10 minutes.\n", acts[j].name);
-					capture(2);
-					pthread_mutex_unlock(&time_mutex);
-					counter_two++;
-					acts[j].counted2 = 1; 
-					sleep(20); // sleep to avoid printing this many times for the same activity
-				}
-
-			}
-
-			if ( (strcmp(acts[j].state, "Undone") && acts[j].counted2 == 0) ){ // 1 if the activity is done - this is from user input
-				counter_two++;
-				acts[j].counted2 = 1;
-			}				
-	
-		}	
+void bench_lateness_sleeps(struct histogram *h) {
+// The reference: plain clock_nanosleep() to BENCH_LATENESS_SLEEPS absolute deadlines
+	struct timespec deadline, now;
+	int k;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	for (k = 0; k < BENCH_LATENESS_SLEEPS; k++) {
+		deadline.tv_nsec += 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_nsec -= 1000000000;
+			deadline.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		histogram_add(h, (now.tv_sec - deadline.tv_sec) * 1000000000LL + (now.tv_nsec - deadline.tv_nsec));
 	}
-	return 0; // The pthread_exit(NULL) could be used here instead
-	//pthread_exit(NULL); // if all the activities are already done, exit
 }
 
-void *f3(void) {
-// This is the thread that creates the internal, accelerated clock
+int bench_lateness(void) {
+	static const long slacks[] = { 0, 1000 }; // ns, 0: the default of the thread
+	struct stats_page *page = calloc(1, sizeof(*page));
+	struct histogram sleeps;
+	pthread_condattr_t cond_attr;
+	pthread_t thread;
+	struct timespec wait;
+	long long at, t, wakeups0;
+	long notified;
+	int i, k, missed = 0, late = 0, host_late = 0;
+	if (page == NULL) {
+		return 1;
+	}
+	pthread_mutex_init(&sched_mutex, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sched_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	speed_num = speed_den = 1;
+	speed_max = false;
+	clock_init();
+	schedule_free(&acts);
+	for (i = 0; i < BENCH_LATENESS; i++) { // (times set before each run)
+		if (!schedule_add(&acts, 0, 0, "Pills", 5, schedule_hash("Pills", 5))) {
+			return 1;
+		}
+	}
+	if (!schedule_precise(&acts)) {
+		return 1;
+	}
+	build_lookup();
+	if (live_init(&live, &acts, &granny, lookup_table, false) != 0) {
+		return 1;
+	}
+	granny.quiet = true;
+	stats = page;
 
-// Local variables 
-struct tm tm_test; // to obtain reference time from the outside world (using localtime()) for the start
-int start = 0; // to capture static reference only for the start 
-int factor = (60/speedup); // the speedup factor for the seconds
+	printf("%d notifications within %d ms at x1\n", BENCH_LATENESS, BENCH_LATENESS_SPREAD_MS);
+	printf("%12s %16s %10s %10s %10s %10s %10s %10s\n", "slack (us)", "", "count", "p50 (us)", "p99 (us)", "p99.9 (us)", "max (us)", "wakeups");
+	for (k = 0; k < 2; k++) {
+		if (prctl(PR_SET_TIMERSLACK, slacks[k]) == -1) { // the scheduler thread inherits it
+			fprintf(stderr, "Can't set the timer slack: %s\n", strerror(errno));
+			return 1;
+		}
+		memset(&sleeps, 0, sizeof(sleeps));
+		bench_lateness_sleeps(&sleeps);
+		printf("%12s %16s %10lld %10.1f %10.1f %10.1f %10.1f %10d\n", slacks[k] ? "1" : "default", "clock_nanosleep",
+			(long long)sleeps.count, histogram_percentile(&sleeps, 50) / 1e3, histogram_percentile(&sleeps, 99) / 1e3,
+			histogram_percentile(&sleeps, 99.9) / 1e3, sleeps.max / 1e3, BENCH_LATENESS_SLEEPS);
 
-	while (1) { // This is for the speedup
-		sched_yield(); // for the CPU
+		at = internal_now() + 500; // leaves the time to build the events
+		for (i = 0; i < BENCH_LATENESS; i++) {
+			t = at + (long long)i * BENCH_LATENESS_SPREAD_MS / BENCH_LATENESS;
+			acts.start[i] = t / 60000 % (24*60);
+			acts.start_ms[i] = t % 60000;
+			acts.end[i] = (acts.start[i] + 30) % (24*60); // its warning and end are well after the run
+		}
+		schedule_reset(&acts);
+		memset(&page->lateness_ns, 0, sizeof(page->lateness_ns));
+		atomic_store(&granny.notified, 0);
+		wakeups0 = page->scheduler_wakeups;
+		scheduler_stop = false;
+		build_events();
+		pthread_create(&thread, NULL, scheduler, NULL);
 
-		time_t local_test = time(NULL);
-		if (local_test == -1){
-			printf("Error calculating raw time, please restart program.\n");
+		wait = internal_to_monotonic(at + BENCH_LATENESS_SPREAD_MS + 500);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wait, NULL) == EINTR) {
 		}
-		tm_test = *localtime(&local_test);
+		sched_lock();
+		scheduler_stop = true;
+		pthread_cond_signal(&sched_cond);
+		sched_unlock();
+		pthread_join(thread, NULL);
 
-		pthread_mutex_lock(&internal_mutex);
-		if(start == 0) {
-			tm_internal.tm_hour = tm_test.tm_hour; // capture the reference
-			tm_internal.tm_min = tm_test.tm_min;
-			start = 1; 
+		notified = atomic_load(&granny.notified);
+		printf("%12s %16s %10ld %10.1f %10.1f %10.1f %10.1f %10lld\n", "", "notifications", notified,
+			histogram_percentile(&page->lateness_ns, 50) / 1e3, histogram_percentile(&page->lateness_ns, 99) / 1e3,
+			histogram_percentile(&page->lateness_ns, 99.9) / 1e3, page->lateness_ns.max / 1e3, page->scheduler_wakeups - wakeups0);
+		missed += (notified != BENCH_LATENESS);
+		if (histogram_percentile(&page->lateness_ns, 99) >= 1000000) {
+			late++;
+			host_late += (histogram_percentile(&sleeps, 99) >= 1000000);
 		}
+	}
+	stats = NULL;
+	if (missed) {
+		printf("Error: missed notifications\n");
+	}
+	else if (late > host_late) {
+		printf("Error: p99 over 1 ms, while plain sleeps are on time\n");
+	}
+	else if (late) {
+		printf("p99 over 1 ms, but so are plain sleeps on this machine (its timers are late, not the scheduler)\n");
+	}
+	else {
+		printf("p99 under 1 ms\n");
+	}
+	return missed || late > host_late;
+}
 
-		// The next formula works, since C takes the integer part when dividing; it's an algorithm that allows us to 
-		// divide 60 seconds into subintervals, each going from 0 to some maximum. With this formula, the '0' second
-		// is calculated automatically to restart the new second internval. This also allows accelerating time internally
-		// in a continuous way (no discrete jumps)
-		tm_internal.tm_sec = tm_test.tm_sec - (tm_test.tm_sec/factor) * factor; 
+// History benchmark: 10 years of 1k activities a day (200 names, each with its own habits: how often granny does
+// it, how often she's warned first and how long after the start she answers) recorded through history_record()
+// like the agenda does, then aggregated in one pass over the whole file and over the last 6 months. The totals of
+// the aggregate have to match what was recorded.
+#define BENCH_HISTORY_YEARS 10
+#define BENCH_HISTORY_ACTIVITIES 1000
+#define BENCH_HISTORY_NAMES 200
 
-		if(tm_internal.tm_sec == 0 ) { // 0: first second of the new minute
-			tm_internal.tm_min = tm_internal.tm_min + 1;
-			sleep(1); // to synchronize, otherwise it explodes
-			// The printf below was just for verification, it can be removed
-			//printf("Speedup, minute:%d, second: %d\n",  tm_internal.tm_min, tm_internal.tm_sec);
-			if(tm_internal.tm_min == 60){
-				tm_internal.tm_min = 0;
-				tm_internal.tm_hour = tm_internal.tm_hour + 1;
-				if(tm_internal.tm_hour == 24){
-					tm_internal.tm_hour = 0;
-				}
-			}
+int bench_history(void) {
+	struct schedule sch;
+	struct history h;
+	struct history_summary s;
+	char path[64], name[32];
+	unsigned long long seed = 1;
+	long long expected[4] = { 0, 0, 0, 0 }; // outcomes, done by granny, warned, sum of the answer times
+	long long got[4], start, t0, t1, t2, t3;
+	uint32_t today = local_day(), first = today - BENCH_HISTORY_YEARS * 365, day, id, r;
+	int i, length, habit, failed = 0;
+	bool by_granny;
+
+	snprintf(path, sizeof(path), "/tmp/granny-history.%d", (int)getpid());
+	unlink(path);
+	schedule_init(&sch);
+	for (i = 0; i < BENCH_HISTORY_ACTIVITIES; i++) {
+		length = snprintf(name, sizeof(name), "Activity %d", i % BENCH_HISTORY_NAMES);
+		if (!schedule_add(&sch, i * 1440 / BENCH_HISTORY_ACTIVITIES, i * 1440 / BENCH_HISTORY_ACTIVITIES + 1, name, length, schedule_hash(name, length))) {
+			return 1;
+		}
+	}
+	internal_first_day = first; // (history_answer() counts from it)
+	if (history_open(&h, path, &sch) != 0) {
+		return 1;
+	}
 
+	t0 = bench_ns(CLOCK_MONOTONIC);
+	for (day = first; day < today; day++) {
+		for (i = 0; i < BENCH_HISTORY_ACTIVITIES; i++) {
+			habit = i % BENCH_HISTORY_NAMES;
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			r = seed >> 33;
+			by_granny = (r % 100 < 40 + (uint32_t)habit % 55); // 40% to 94% done
+			if (r / 100 % 4 == 0) {
+				schedule_transition(&sch, i, day, FLAG_WARNED);
+				expected[2]++;
+			}
+			if (by_granny) {
+				schedule_transition(&sch, i, day, FLAG_DONE);
+				start = ((long long)day - internal_first_day) * 86400000 + sch.start[i] * 60000LL;
+				history_answer(&h, i, day, start + (long long)(r / 400 % (habit + 1)) * 60000 + r % 60000);
+				expected[1]++;
+				expected[3] += (long long)(r / 400 % (habit + 1)) * 60000 + r % 60000;
+			}
+			history_record(&h, i, day, by_granny);
+			expected[0]++;
 		}
-		pthread_mutex_unlock(&internal_mutex);
-		// The printf below was for verification, it can be commented out
-		//printf("Speedup, hour: %d, minute:%d, second: %d\n", tm_internal.tm_hour, tm_internal.tm_min, tm_internal.tm_sec);
 	}
+	history_close(&h);
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	printf("%d years x %d activities a day (%d names): %lld outcomes recorded in %.1f ms (%.0f ns each)\n", BENCH_HISTORY_YEARS,
+		BENCH_HISTORY_ACTIVITIES, BENCH_HISTORY_NAMES, expected[0], (t1 - t0) / 1e6, (double)(t1 - t0) / expected[0]);
+	printf("File: %.1f MB in %lld blocks, %.2f bytes per outcome (a journal record takes %zu)\n", h.bytes / 1e6, h.blocks,
+		(double)h.bytes / expected[0], sizeof(struct journal_record));
+
+	t1 = bench_ns(CLOCK_MONOTONIC);
+	if (history_aggregate(path, 0, &s) != 0) {
+		return 1;
+	}
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	memset(got, 0, sizeof(got));
+	for (id = 0; id < s.names.count; id++) {
+		got[0] += s.stats[id].occurrences;
+		got[1] += s.stats[id].granny;
+		got[2] += s.stats[id].warned;
+		got[3] += s.stats[id].answer_ms;
+	}
+	printf("Aggregate of everything: %.1f ms (%.1f M outcomes/s, %.0f MB/s) with %zu kB of memory\n", (t2 - t1) / 1e6,
+		s.outcomes / ((t2 - t1) / 1e3), s.bytes / ((t2 - t1) / 1e3), s.memory / 1024);
+	if (memcmp(got, expected, sizeof(got)) || s.names.count != BENCH_HISTORY_NAMES) {
+		printf("Error: %lld outcomes, %lld done, %lld warned, %lld ms of answers read; %lld, %lld, %lld, %lld recorded\n",
+			got[0], got[1], got[2], got[3], expected[0], expected[1], expected[2], expected[3]);
+		failed = 1;
+	}
+	history_summary_free(&s);
+
+	t2 = bench_ns(CLOCK_MONOTONIC);
+	if (history_aggregate(path, today - 183, &s) != 0) { // (the blocks before are skipped)
+		return 1;
+	}
+	t3 = bench_ns(CLOCK_MONOTONIC);
+	id = history_name(&s.names, "Activity 7", strlen("Activity 7"), false);
+	printf("Last 6 months: %.1f ms for %lld outcomes; Activity 7 was skipped %lld times out of %lld (%.1f%%)\n", (t3 - t2) / 1e6,
+		s.outcomes, s.stats[id].occurrences - s.stats[id].granny, s.stats[id].occurrences,
+		100.0 * (s.stats[id].occurrences - s.stats[id].granny) / s.stats[id].occurrences);
+	history_summary_free(&s);
+	schedule_free(&sch);
+	unlink(path);
+	printf("%s\n", failed ? "Error: the aggregate doesn't match" : "ok");
+	return failed;
 }
+#endif // GRANNY_BENCH